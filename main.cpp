@@ -36,6 +36,12 @@
 #include "pv/application.hpp"
 #include "pv/devicemanager.hpp"
 #include "pv/mainwindow.hpp"
+#include "pv/data/analogsegment.hpp"
+#include "pv/data/logicsegment.hpp"
+#include "pv/data/segment.hpp"
+#ifdef ENABLE_DECODE
+#include "pv/data/decoderstack.hpp"
+#endif
 #ifdef ANDROID
 #include <libsigrokandroidutils/libsigrokandroidutils.h>
 #include "android/assetreader.hpp"
@@ -64,6 +70,18 @@ void usage()
 		"  -l, --loglevel                  Set libsigrok/libsigrokdecode loglevel\n"
 		"  -i, --input-file                Load input from file\n"
 		"  -I, --input-format              Input format\n"
+		"  -s, --spill-threshold           Sample memory (MiB) after which captures\n"
+		"                                  are spilled to disk (0 = never)\n"
+		"  -S, --spill-dir                 Directory for spilled capture data\n"
+		"  -c, --compress-logic            Run-length encode sparse logic captures\n"
+		"  -m, --mipmap-power              Logic mip-map fan-out as a power of two\n"
+		"                                  (4-8)\n"
+		"  -e, --envelope-power            Analog envelope fan-out as a power of two\n"
+		"                                  (4-8)\n"
+#ifdef ENABLE_DECODE
+		"  -P, --parallel-decode           Decode complete captures in parallel\n"
+		"                                  ranges split where the bus is idle\n"
+#endif
 		"\n", PV_BIN_NAME, PV_DESCRIPTION);
 }
 
@@ -89,11 +107,17 @@ int main(int argc, char *argv[])
 			{"loglevel", required_argument, 0, 'l'},
 			{"input-file", required_argument, 0, 'i'},
 			{"input-format", required_argument, 0, 'I'},
+			{"spill-threshold", required_argument, 0, 's'},
+			{"spill-dir", required_argument, 0, 'S'},
+			{"compress-logic", no_argument, 0, 'c'},
+			{"mipmap-power", required_argument, 0, 'm'},
+			{"envelope-power", required_argument, 0, 'e'},
+			{"parallel-decode", no_argument, 0, 'P'},
 			{0, 0, 0, 0}
 		};
 
 		const int c = getopt_long(argc, argv,
-			"l:Vh?i:I:", long_options, nullptr);
+			"l:Vh?i:I:s:S:cm:e:P", long_options, nullptr);
 		if (c == -1)
 			break;
 
@@ -127,6 +151,64 @@ int main(int argc, char *argv[])
 		case 'I':
 			open_file_format = optarg;
 			break;
+
+		case 's':
+		{
+			char *end = nullptr;
+			const unsigned long long mib = strtoull(optarg, &end, 10);
+			if (end == optarg || *end != '\0' ||
+				mib > (UINT64_MAX >> 20)) {
+				fprintf(stderr, "Invalid spill threshold.\n");
+				return 1;
+			}
+			pv::data::Segment::set_spill_threshold(mib << 20);
+			break;
+		}
+
+		case 'S':
+			if (*optarg == '\0') {
+				fprintf(stderr, "Invalid spill directory.\n");
+				return 1;
+			}
+			pv::data::Segment::set_spill_directory(
+				QString::fromLocal8Bit(optarg));
+			break;
+
+		case 'c':
+			pv::data::LogicSegment::set_compression_enabled(true);
+			break;
+
+		case 'm':
+		{
+			const unsigned int power = strtoul(optarg, nullptr, 10);
+			if (power < pv::data::LogicSegment::MinMipMapScalePower ||
+				power > pv::data::LogicSegment::MaxMipMapScalePower) {
+				fprintf(stderr, "Invalid mip-map power.\n");
+				return 1;
+			}
+			pv::data::LogicSegment::set_default_mipmap_scale_power(
+				power);
+			break;
+		}
+
+		case 'e':
+		{
+			const unsigned int power = strtoul(optarg, nullptr, 10);
+			if (power < pv::data::AnalogSegment::MinEnvelopeScalePower ||
+				power > pv::data::AnalogSegment::MaxEnvelopeScalePower) {
+				fprintf(stderr, "Invalid envelope power.\n");
+				return 1;
+			}
+			pv::data::AnalogSegment::set_default_envelope_scale_power(
+				power);
+			break;
+		}
+
+		case 'P':
+#ifdef ENABLE_DECODE
+			pv::data::DecoderStack::set_parallel_decode_enabled(true);
+#endif
+			break;
 		}
 	}
 
@@ -29,37 +29,448 @@
 
 #include "analogsegment.hpp"
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 using std::lock_guard;
 using std::recursive_mutex;
 using std::max;
-using std::max_element;
 using std::min;
-using std::min_element;
+using std::shared_ptr;
+using std::unique_lock;
+using std::vector;
 
 namespace pv {
 namespace data {
 
-const int AnalogSegment::EnvelopeScalePower = 4;
-const int AnalogSegment::EnvelopeScaleFactor = 1 << EnvelopeScalePower;
-const float AnalogSegment::LogEnvelopeScaleFactor =
-	logf(EnvelopeScaleFactor);
+namespace {
+
+typedef AnalogSegment::EnvelopeSample EnvelopeSample;
+
+void envelope_kernel_scalar(const float *src, EnvelopeSample *dest,
+	uint64_t block_count, unsigned int block_length)
+{
+	for (uint64_t b = 0; b < block_count; b++, dest++)
+	{
+		// Find the minimum and maximum in a single pass
+		float min_value = *src, max_value = *src;
+		for (unsigned int i = 0; i < block_length; i++, src++)
+		{
+			if (*src < min_value)
+				min_value = *src;
+			if (max_value < *src)
+				max_value = *src;
+		}
+
+		dest->min = min_value;
+		dest->max = max_value;
+	}
+}
+
+void envelope_reduce_kernel_scalar(const EnvelopeSample *src,
+	EnvelopeSample *dest, uint64_t block_count, unsigned int block_length)
+{
+	for (uint64_t b = 0; b < block_count; b++, dest++)
+	{
+		EnvelopeSample sub_sample = *src;
+		for (unsigned int i = 0; i < block_length; i++, src++)
+		{
+			sub_sample.min = min(sub_sample.min, src->min);
+			sub_sample.max = max(sub_sample.max, src->max);
+		}
+
+		*dest = sub_sample;
+	}
+}
+
+#if defined(__SSE__)
+/**
+ * Finds the lane-wise minima and maxima of 16 samples.
+ */
+inline void min_max_16_sse(const float *src, __m128 &mn, __m128 &mx)
+{
+	const __m128 v0 = _mm_loadu_ps(src);
+	const __m128 v1 = _mm_loadu_ps(src + 4);
+	const __m128 v2 = _mm_loadu_ps(src + 8);
+	const __m128 v3 = _mm_loadu_ps(src + 12);
+	mn = _mm_min_ps(_mm_min_ps(v0, v1), _mm_min_ps(v2, v3));
+	mx = _mm_max_ps(_mm_max_ps(v0, v1), _mm_max_ps(v2, v3));
+}
+
+void envelope_kernel_sse(const float *src, EnvelopeSample *dest,
+	uint64_t block_count, unsigned int block_length)
+{
+	uint64_t b = 0;
+
+	// Process four blocks at a time. The partial results of the blocks
+	// are transposed, so that the final reduction yields the minima and
+	// maxima of all four blocks in one vector each
+	for (; b + 4 <= block_count; b += 4, dest += 4)
+	{
+		__m128 mins[4], maxs[4];
+		for (unsigned int i = 0; i < 4; i++, src += block_length)
+		{
+			min_max_16_sse(src, mins[i], maxs[i]);
+			for (unsigned int j = 16; j < block_length; j += 16)
+			{
+				__m128 mn, mx;
+				min_max_16_sse(src + j, mn, mx);
+				mins[i] = _mm_min_ps(mins[i], mn);
+				maxs[i] = _mm_max_ps(maxs[i], mx);
+			}
+		}
+
+		_MM_TRANSPOSE4_PS(mins[0], mins[1], mins[2], mins[3]);
+		_MM_TRANSPOSE4_PS(maxs[0], maxs[1], maxs[2], maxs[3]);
+
+		const __m128 min_values = _mm_min_ps(
+			_mm_min_ps(mins[0], mins[1]),
+			_mm_min_ps(mins[2], mins[3]));
+		const __m128 max_values = _mm_max_ps(
+			_mm_max_ps(maxs[0], maxs[1]),
+			_mm_max_ps(maxs[2], maxs[3]));
+
+		// Interleave the results into pairs of minimum and maximum
+		_mm_storeu_ps((float*)dest,
+			_mm_unpacklo_ps(min_values, max_values));
+		_mm_storeu_ps((float*)(dest + 2),
+			_mm_unpackhi_ps(min_values, max_values));
+	}
+
+	envelope_kernel_scalar(src, dest, block_count - b, block_length);
+}
+
+void envelope_reduce_kernel_sse(const EnvelopeSample *src,
+	EnvelopeSample *dest, uint64_t block_count, unsigned int block_length)
+{
+	for (uint64_t b = 0; b < block_count; b++, dest++)
+	{
+		// Each vector holds two envelope samples. The minima are
+		// taken from the even lanes, and the maxima from the odd lanes
+		const float *const f = (const float*)src;
+		__m128 mn = _mm_loadu_ps(f), mx = mn;
+		for (unsigned int i = 4; i < block_length * 2; i += 4)
+		{
+			const __m128 v = _mm_loadu_ps(f + i);
+			mn = _mm_min_ps(mn, v);
+			mx = _mm_max_ps(mx, v);
+		}
+
+		mn = _mm_min_ps(mn, _mm_movehl_ps(mn, mn));
+		mx = _mm_max_ps(mx, _mm_movehl_ps(mx, mx));
+		_mm_storel_pi((__m64*)dest, _mm_move_ss(mx, mn));
+
+		src += block_length;
+	}
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+/**
+ * Finds the lane-wise minima and maxima of 16 samples.
+ */
+inline void min_max_16_neon(const float *src, float32x4_t &mn,
+	float32x4_t &mx)
+{
+	const float32x4_t v0 = vld1q_f32(src);
+	const float32x4_t v1 = vld1q_f32(src + 4);
+	const float32x4_t v2 = vld1q_f32(src + 8);
+	const float32x4_t v3 = vld1q_f32(src + 12);
+	mn = vminq_f32(vminq_f32(v0, v1), vminq_f32(v2, v3));
+	mx = vmaxq_f32(vmaxq_f32(v0, v1), vmaxq_f32(v2, v3));
+}
+
+void envelope_kernel_neon(const float *src, EnvelopeSample *dest,
+	uint64_t block_count, unsigned int block_length)
+{
+	for (uint64_t b = 0; b < block_count; b++, dest++)
+	{
+		float32x4_t mn, mx;
+		min_max_16_neon(src, mn, mx);
+		for (unsigned int j = 16; j < block_length; j += 16)
+		{
+			float32x4_t group_mn, group_mx;
+			min_max_16_neon(src + j, group_mn, group_mx);
+			mn = vminq_f32(mn, group_mn);
+			mx = vmaxq_f32(mx, group_mx);
+		}
+		src += block_length;
+
+		float32x2_t mn2 = vpmin_f32(vget_low_f32(mn), vget_high_f32(mn));
+		float32x2_t mx2 = vpmax_f32(vget_low_f32(mx), vget_high_f32(mx));
+		mn2 = vpmin_f32(mn2, mn2);
+		mx2 = vpmax_f32(mx2, mx2);
+
+		vst1_f32((float*)dest, vext_f32(mn2, mx2, 1));
+	}
+}
+
+void envelope_reduce_kernel_neon(const EnvelopeSample *src,
+	EnvelopeSample *dest, uint64_t block_count, unsigned int block_length)
+{
+	for (uint64_t b = 0; b < block_count; b++, dest++)
+	{
+		// Each vector holds two envelope samples. The minima are
+		// taken from the even lanes, and the maxima from the odd lanes
+		const float *const f = (const float*)src;
+		float32x4_t mn = vld1q_f32(f), mx = mn;
+		for (unsigned int i = 4; i < block_length * 2; i += 4)
+		{
+			const float32x4_t v = vld1q_f32(f + i);
+			mn = vminq_f32(mn, v);
+			mx = vmaxq_f32(mx, v);
+		}
+
+		const float32x2_t mn2 = vmin_f32(vget_low_f32(mn),
+			vget_high_f32(mn));
+		const float32x2_t mx2 = vmax_f32(vget_low_f32(mx),
+			vget_high_f32(mx));
+		vst1_f32((float*)dest, vset_lane_f32(
+			vget_lane_f32(mn2, 0), mx2, 0));
+
+		src += block_length;
+	}
+}
+#endif
+
+/**
+ * Computes the sum and the sum of squares of each block of samples.
+ */
+void sum_blocks(const float *src, double *sums, double *squares,
+	uint64_t block_count, unsigned int block_length)
+{
+	for (uint64_t b = 0; b < block_count; b++)
+	{
+		double sum = 0.0, square = 0.0;
+		for (unsigned int i = 0; i < block_length; i++, src++)
+		{
+			sum += *src;
+			square += (double)*src * *src;
+		}
+
+		sums[b] = sum;
+		squares[b] = square;
+	}
+}
+
+/**
+ * Computes the sums and the sums of squares of the next envelope level
+ * from those of the level below.
+ */
+void reduce_sums(const double *src_sums, const double *src_squares,
+	double *sums, double *squares, uint64_t block_count,
+	unsigned int block_length)
+{
+	for (uint64_t b = 0; b < block_count; b++)
+	{
+		double sum = 0.0, square = 0.0;
+		for (unsigned int i = 0; i < block_length; i++)
+		{
+			sum += *src_sums++;
+			square += *src_squares++;
+		}
+
+		sums[b] = sum;
+		squares[b] = square;
+	}
+}
+
+/**
+ * Splits interleaved frames of samples into one buffer per channel.
+ * @param src The interleaved frames, starting at frame @c first .
+ * @param dest The buffers of the channels.
+ * @param channel_count The number of channels in each frame.
+ * @param first The index of the first frame to split.
+ * @param end The index after the last frame to split.
+ */
+void deinterleave_scalar(const float *src, float *const *dest,
+	unsigned int channel_count, uint64_t first, uint64_t end)
+{
+	for (uint64_t i = first; i < end; i++)
+		for (unsigned int c = 0; c < channel_count; c++)
+			dest[c][i] = *src++;
+}
+
+#if defined(__SSE__)
+void deinterleave_sse(const float *src, float *const *dest,
+	unsigned int channel_count, uint64_t count)
+{
+	uint64_t i = 0;
+
+	// Four frames are split at a time with shuffles. Frames of four
+	// and eight channels are treated as 4x4 matrices and transposed
+	switch (channel_count) {
+	case 2:
+		for (; i + 4 <= count; i += 4, src += 8)
+		{
+			const __m128 v0 = _mm_loadu_ps(src);
+			const __m128 v1 = _mm_loadu_ps(src + 4);
+			_mm_storeu_ps(dest[0] + i,
+				_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(dest[1] + i,
+				_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		break;
+
+	case 4:
+	case 8:
+		for (; i + 4 <= count; i += 4, src += channel_count * 4)
+			for (unsigned int c = 0; c < channel_count; c += 4)
+			{
+				__m128 v0 = _mm_loadu_ps(src + c);
+				__m128 v1 = _mm_loadu_ps(src + c + channel_count);
+				__m128 v2 = _mm_loadu_ps(src + c + channel_count * 2);
+				__m128 v3 = _mm_loadu_ps(src + c + channel_count * 3);
+				_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+				_mm_storeu_ps(dest[c] + i, v0);
+				_mm_storeu_ps(dest[c + 1] + i, v1);
+				_mm_storeu_ps(dest[c + 2] + i, v2);
+				_mm_storeu_ps(dest[c + 3] + i, v3);
+			}
+		break;
+
+	default:
+		break;
+	}
+
+	deinterleave_scalar(src, dest, channel_count, i, count);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+void deinterleave_neon(const float *src, float *const *dest,
+	unsigned int channel_count, uint64_t count)
+{
+	uint64_t i = 0;
+
+	// The structure loads split frames of two and four channels
+	switch (channel_count) {
+	case 2:
+		for (; i + 4 <= count; i += 4, src += 8)
+		{
+			const float32x4x2_t v = vld2q_f32(src);
+			vst1q_f32(dest[0] + i, v.val[0]);
+			vst1q_f32(dest[1] + i, v.val[1]);
+		}
+		break;
+
+	case 4:
+		for (; i + 4 <= count; i += 4, src += 16)
+		{
+			const float32x4x4_t v = vld4q_f32(src);
+			vst1q_f32(dest[0] + i, v.val[0]);
+			vst1q_f32(dest[1] + i, v.val[1]);
+			vst1q_f32(dest[2] + i, v.val[2]);
+			vst1q_f32(dest[3] + i, v.val[3]);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	deinterleave_scalar(src, dest, channel_count, i, count);
+}
+#endif
+
+} // anonymous namespace
+
+const unsigned int AnalogSegment::MinEnvelopeScalePower = 4;
+const unsigned int AnalogSegment::MaxEnvelopeScalePower = 8;
 const uint64_t AnalogSegment::EnvelopeDataUnit = 64*1024;	// bytes
 
-AnalogSegment::AnalogSegment(
-	uint64_t samplerate, const uint64_t expected_num_samples) :
-	Segment(samplerate, sizeof(float))
+unsigned int AnalogSegment::default_envelope_scale_power_ = 4;
+
+void AnalogSegment::set_default_envelope_scale_power(unsigned int power)
+{
+	assert(power >= MinEnvelopeScalePower &&
+		power <= MaxEnvelopeScalePower);
+	default_envelope_scale_power_ = min(max(power,
+		MinEnvelopeScalePower), MaxEnvelopeScalePower);
+}
+
+unsigned int AnalogSegment::default_envelope_scale_power()
 {
-	set_capacity(expected_num_samples);
+	return default_envelope_scale_power_;
+}
 
+AnalogSegment::AnalogSegment(uint64_t samplerate) :
+	Segment(samplerate, sizeof(float)),
+	envelope_scale_power_(default_envelope_scale_power_),
+	envelope_scale_factor_(1 << envelope_scale_power_),
+	log_envelope_scale_factor_(logf(envelope_scale_factor_)),
+	scale_step_count_(EnvelopeCoverageBits / envelope_scale_power_)
+{
 	lock_guard<recursive_mutex> lock(mutex_);
 	memset(envelope_levels_, 0, sizeof(envelope_levels_));
+
+	envelope_kernels(fastest_envelope_kernel_set(), envelope_kernel_,
+		envelope_reduce_kernel_);
 }
 
 AnalogSegment::~AnalogSegment()
 {
 	lock_guard<recursive_mutex> lock(mutex_);
-	for (Envelope &e : envelope_levels_)
+	for (Envelope &e : envelope_levels_) {
 		free(e.samples);
+		free(e.sums);
+		free(e.squares);
+	}
+}
+
+void AnalogSegment::append_interleaved_samples(
+	const vector< shared_ptr<AnalogSegment> > &segments,
+	const float *data, size_t sample_count)
+{
+	const unsigned int channel_count = segments.size();
+	if (channel_count == 0)
+		return;
+
+	vector< unique_lock<recursive_mutex> > locks;
+	locks.reserve(channel_count);
+	for (const shared_ptr<AnalogSegment> &s : segments) {
+		assert(s);
+		assert(s->unit_size_ == sizeof(float));
+		locks.emplace_back(s->mutex_);
+	}
+
+	vector<float*> dest(channel_count);
+	while (sample_count > 0)
+	{
+		// Split as many frames as every segment can take contiguously.
+		// If we're out of memory, this will throw std::bad_alloc
+		uint64_t count = sample_count;
+		for (unsigned int c = 0; c < channel_count; c++) {
+			uint64_t available;
+			dest[c] = (float*)segments[c]->get_append_pointer(
+				available);
+			count = min(count, available);
+		}
+
+#if defined(__SSE__)
+		deinterleave_sse(data, dest.data(), channel_count, count);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		deinterleave_neon(data, dest.data(), channel_count, count);
+#else
+		deinterleave_scalar(data, dest.data(), channel_count, 0,
+			count);
+#endif
+
+		for (const shared_ptr<AnalogSegment> &s : segments)
+			s->sample_count_ += count;
+
+		data += count * channel_count;
+		sample_count -= count;
+	}
+
+	// Generate the first mip-map from the data
+	for (const shared_ptr<AnalogSegment> &s : segments)
+		s->append_payload_to_envelope_levels();
 }
 
 void AnalogSegment::append_interleaved_samples(const float *data,
@@ -69,18 +480,23 @@ void AnalogSegment::append_interleaved_samples(const float *data,
 
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	// If we're out of memory, this will throw std::bad_alloc
-	data_.resize((sample_count_ + sample_count) * sizeof(float));
-
-	float *dst = (float*)data_.data() + sample_count_;
-	const float *dst_end = dst + sample_count;
-	while (dst != dst_end)
+	while (sample_count > 0)
 	{
-		*dst++ = *data;
-		data += stride;
-	}
+		// If we're out of memory, this will throw std::bad_alloc
+		uint64_t available;
+		float *dst = (float*)get_append_pointer(available);
+
+		const uint64_t count = min((uint64_t)sample_count, available);
+		const float *dst_end = dst + count;
+		while (dst != dst_end)
+		{
+			*dst++ = *data;
+			data += stride;
+		}
 
-	sample_count_ += sample_count;
+		sample_count_ += count;
+		sample_count -= count;
+	}
 
 	// Generate the first mip-map from the data
 	append_payload_to_envelope_levels();
@@ -98,33 +514,170 @@ const float* AnalogSegment::get_samples(
 	lock_guard<recursive_mutex> lock(mutex_);
 
 	float *const data = new float[end_sample - start_sample];
-	memcpy(data, (float*)data_.data() + start_sample, sizeof(float) *
-		(end_sample - start_sample));
+	get_raw_samples((uint8_t*)data, start_sample, end_sample - start_sample);
 	return data;
 }
 
-void AnalogSegment::get_envelope_section(EnvelopeSection &s,
+AnalogSegment::ReadView::ReadView(const AnalogSegment &segment) :
+	segment_(segment),
+	lock_(segment.mutex_)
+{
+}
+
+uint64_t AnalogSegment::ReadView::sample_count() const
+{
+	return segment_.sample_count_;
+}
+
+const float* AnalogSegment::ReadView::samples(uint64_t start,
+	uint64_t end, uint64_t &count) const
+{
+	assert(start < end);
+	assert(end <= segment_.sample_count_);
+
+	count = min(end - start, segment_.contiguous_samples(start));
+	return (const float*)segment_.get_raw_sample(start);
+}
+
+void AnalogSegment::ReadView::get_envelope_section(EnvelopeSection &s,
 	uint64_t start, uint64_t end, float min_length) const
 {
-	assert(end <= get_sample_count());
+	assert(end <= segment_.sample_count_);
 	assert(start <= end);
 	assert(min_length > 0);
 
-	lock_guard<recursive_mutex> lock(mutex_);
-
-	const unsigned int min_level = max((int)floorf(logf(min_length) /
-		LogEnvelopeScaleFactor) - 1, 0);
+	const unsigned int min_level = min(max((int)floorf(logf(min_length) /
+		segment_.log_envelope_scale_factor_) - 1, 0),
+		(int)segment_.scale_step_count_ - 1);
 	const unsigned int scale_power = (min_level + 1) *
-		EnvelopeScalePower;
-	start >>= scale_power;
-	end >>= scale_power;
+		segment_.envelope_scale_power_;
+	const Envelope &e = segment_.envelope_levels_[min_level];
+	start = min(start >> scale_power, e.length);
+	end = min(end >> scale_power, e.length);
 
 	s.start = start << scale_power;
-	s.scale = 1 << scale_power;
+	s.scale = 1ULL << scale_power;
 	s.length = end - start;
-	s.samples = new EnvelopeSample[s.length];
-	memcpy(s.samples, envelope_levels_[min_level].samples + start,
-		s.length * sizeof(EnvelopeSample));
+	s.samples = e.samples + start;
+}
+
+AnalogSegment::EnvelopeKernelSet AnalogSegment::fastest_envelope_kernel_set()
+{
+#if defined(__SSE__)
+	return SSEKernels;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	return NEONKernels;
+#else
+	return ScalarKernels;
+#endif
+}
+
+bool AnalogSegment::envelope_kernels(EnvelopeKernelSet set,
+	EnvelopeKernel &kernel, EnvelopeReduceKernel &reduce_kernel)
+{
+	switch (set) {
+	case ScalarKernels:
+		kernel = envelope_kernel_scalar;
+		reduce_kernel = envelope_reduce_kernel_scalar;
+		return true;
+
+#if defined(__SSE__)
+	case SSEKernels:
+		kernel = envelope_kernel_sse;
+		reduce_kernel = envelope_reduce_kernel_sse;
+		return true;
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	case NEONKernels:
+		kernel = envelope_kernel_neon;
+		reduce_kernel = envelope_reduce_kernel_neon;
+		return true;
+#endif
+
+	default:
+		break;
+	}
+
+	return false;
+}
+
+AnalogSegment::Statistics AnalogSegment::get_statistics(uint64_t start,
+	uint64_t end) const
+{
+	assert(start <= end);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(end <= sample_count_);
+
+	Statistics s = {end - start, 0.0f, 0.0f, 0.0, 0.0};
+	if (start == end)
+		return s;
+
+	s.min = s.max = *(const float*)get_raw_sample(start);
+	double sum = 0.0, square = 0.0;
+
+	// Climb up the envelope levels while the start of the range is
+	// aligned to the blocks, then descend again towards the end
+	for (uint64_t i = start; i < end;)
+	{
+		int level = -1;
+		while (level + 1 < (int)scale_step_count_) {
+			const unsigned int power =
+				(level + 2) * envelope_scale_power_;
+			const uint64_t block = i >> power;
+			if ((i & ((1ULL << power) - 1)) != 0 ||
+				i + (1ULL << power) > end ||
+				block >= envelope_levels_[level + 1].length)
+				break;
+			level++;
+		}
+
+		if (level < 0) {
+			const float sample = *(const float*)get_raw_sample(i);
+			s.min = min(s.min, sample);
+			s.max = max(s.max, sample);
+			sum += sample;
+			square += (double)sample * sample;
+			i++;
+		} else {
+			const unsigned int power =
+				(level + 1) * envelope_scale_power_;
+			const Envelope &e = envelope_levels_[level];
+			const uint64_t block = i >> power;
+			s.min = min(s.min, e.samples[block].min);
+			s.max = max(s.max, e.samples[block].max);
+			sum += e.sums[block];
+			square += e.squares[block];
+			i += 1ULL << power;
+		}
+	}
+
+	s.mean = sum / s.count;
+	s.rms = sqrt(square / s.count);
+	return s;
+}
+
+uint64_t AnalogSegment::memory_usage() const
+{
+	uint64_t bytes = Segment::memory_usage();
+	for (uint64_t level_bytes : envelope_memory_usage())
+		bytes += level_bytes;
+	return bytes;
+}
+
+vector<uint64_t> AnalogSegment::envelope_memory_usage() const
+{
+	vector<uint64_t> usage;
+
+	lock_guard<recursive_mutex> lock(mutex_);
+	for (unsigned int level = 0; level < scale_step_count_ &&
+		envelope_levels_[level].samples; level++)
+		usage.push_back(envelope_levels_[level].data_length *
+			(sizeof(EnvelopeSample) + 2 * sizeof(double)));
+
+	return usage;
 }
 
 void AnalogSegment::reallocate_envelope(Envelope &e)
@@ -136,6 +689,10 @@ void AnalogSegment::reallocate_envelope(Envelope &e)
 		e.data_length = new_data_length;
 		e.samples = (EnvelopeSample*)realloc(e.samples,
 			new_data_length * sizeof(EnvelopeSample));
+		e.sums = (double*)realloc(e.sums,
+			new_data_length * sizeof(double));
+		e.squares = (double*)realloc(e.squares,
+			new_data_length * sizeof(double));
 	}
 }
 
@@ -147,7 +704,7 @@ void AnalogSegment::append_payload_to_envelope_levels()
 
 	// Expand the data buffer to fit the new samples
 	prev_length = e0.length;
-	e0.length = sample_count_ / EnvelopeScaleFactor;
+	e0.length = sample_count_ / envelope_scale_factor_;
 
 	// Break off if there are no new samples to compute
 	if (e0.length == prev_length)
@@ -157,30 +714,35 @@ void AnalogSegment::append_payload_to_envelope_levels()
 
 	dest_ptr = e0.samples + prev_length;
 
-	// Iterate through the samples to populate the first level mipmap
-	const float *const end_src_ptr = (float*)data_.data() +
-		e0.length * EnvelopeScaleFactor;
-	for (const float *src_ptr = (float*)data_.data() +
-		prev_length * EnvelopeScaleFactor;
-		src_ptr < end_src_ptr; src_ptr += EnvelopeScaleFactor)
+	// Iterate through the samples to populate the first level mipmap.
+	// Envelope blocks never straddle data chunks, so the samples can be
+	// processed one contiguous run per chunk
+	for (uint64_t block = prev_length; block < e0.length;)
 	{
-		const EnvelopeSample sub_sample = {
-			*min_element(src_ptr, src_ptr + EnvelopeScaleFactor),
-			*max_element(src_ptr, src_ptr + EnvelopeScaleFactor),
-		};
-
-		*dest_ptr++ = sub_sample;
+		const uint64_t start_sample = block * envelope_scale_factor_;
+		const uint64_t block_count = min(e0.length - block,
+			contiguous_samples(start_sample) / envelope_scale_factor_);
+
+		const float *const src_ptr =
+			(const float*)get_raw_sample(start_sample);
+		envelope_kernel_(src_ptr, dest_ptr, block_count,
+			envelope_scale_factor_);
+		sum_blocks(src_ptr, e0.sums + block, e0.squares + block,
+			block_count, envelope_scale_factor_);
+
+		dest_ptr += block_count;
+		block += block_count;
 	}
 
 	// Compute higher level mipmaps
-	for (unsigned int level = 1; level < ScaleStepCount; level++)
+	for (unsigned int level = 1; level < scale_step_count_; level++)
 	{
 		Envelope &e = envelope_levels_[level];
 		const Envelope &el = envelope_levels_[level-1];
 
 		// Expand the data buffer to fit the new samples
 		prev_length = e.length;
-		e.length = el.length / EnvelopeScaleFactor;
+		e.length = el.length / envelope_scale_factor_;
 
 		// Break off if there are no more samples to computed
 		if (e.length == prev_length)
@@ -189,25 +751,14 @@ void AnalogSegment::append_payload_to_envelope_levels()
 		reallocate_envelope(e);
 
 		// Subsample the level lower level
-		const EnvelopeSample *src_ptr =
-			el.samples + prev_length * EnvelopeScaleFactor;
-		const EnvelopeSample *const end_dest_ptr = e.samples + e.length;
-		for (dest_ptr = e.samples + prev_length;
-			dest_ptr < end_dest_ptr; dest_ptr++)
-		{
-			const EnvelopeSample *const end_src_ptr =
-				src_ptr + EnvelopeScaleFactor;
-
-			EnvelopeSample sub_sample = *src_ptr++;
-			while (src_ptr < end_src_ptr)
-			{
-				sub_sample.min = min(sub_sample.min, src_ptr->min);
-				sub_sample.max = max(sub_sample.max, src_ptr->max);
-				src_ptr++;
-			}
-
-			*dest_ptr = sub_sample;
-		}
+		envelope_reduce_kernel_(
+			el.samples + prev_length * envelope_scale_factor_,
+			e.samples + prev_length, e.length - prev_length,
+			envelope_scale_factor_);
+		reduce_sums(el.sums + prev_length * envelope_scale_factor_,
+			el.squares + prev_length * envelope_scale_factor_,
+			e.sums + prev_length, e.squares + prev_length,
+			e.length - prev_length, envelope_scale_factor_);
 	}
 }
 
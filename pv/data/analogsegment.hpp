@@ -23,11 +23,15 @@
 
 #include "segment.hpp"
 
+#include <memory>
+#include <mutex>
 #include <utility>
 #include <vector>
 
 namespace AnalogSegmentTest {
 struct Basic;
+struct EnvelopeKernels;
+struct EnvelopeBenchmark;
 }
 
 namespace pv {
@@ -45,9 +49,60 @@ public:
 	struct EnvelopeSection
 	{
 		uint64_t start;
-		unsigned int scale;
+		uint64_t scale;
 		uint64_t length;
-		EnvelopeSample *samples;
+		const EnvelopeSample *samples;
+	};
+
+	struct Statistics
+	{
+		uint64_t count;
+		float min;
+		float max;
+		double mean;
+		double rms;
+	};
+
+	/**
+	 * A read-only view of the samples and the envelope of a segment,
+	 * which are accessed in place without copying. The segment is
+	 * locked for as long as the view exists, so that samples can not be
+	 * appended and the envelope can not be reallocated while it is read.
+	 * Views should therefore be short-lived.
+	 */
+	class ReadView
+	{
+	public:
+		explicit ReadView(const AnalogSegment &segment);
+
+		uint64_t sample_count() const;
+
+		/**
+		 * Gets a pointer to a run of samples that are contiguous in
+		 * memory.
+		 * @param start The index of the first sample.
+		 * @param end The index after the last sample wanted.
+		 * @param count Receives the number of samples at the pointer,
+		 * which is at least 1 and at most @c end - @c start .
+		 */
+		const float* samples(uint64_t start, uint64_t end,
+			uint64_t &count) const;
+
+		/**
+		 * Gets a section of the envelope. The envelope samples are
+		 * only valid for the lifetime of the view.
+		 * @param s Receives the envelope section.
+		 * @param start The index of the first sample to cover.
+		 * @param end The index after the last sample to cover.
+		 * @param min_length The minimum number of samples per envelope
+		 * sample.
+		 */
+		void get_envelope_section(EnvelopeSection &s,
+			uint64_t start, uint64_t end, float min_length) const;
+
+	private:
+		const AnalogSegment &segment_;
+		std::unique_lock<std::recursive_mutex> lock_;
 	};
 
 private:
@@ -56,38 +111,156 @@ private:
 		uint64_t length;
 		uint64_t data_length;
 		EnvelopeSample *samples;
+
+		/// The sums and the sums of squares of the samples covered by
+		/// each envelope sample.
+		double *sums;
+		double *squares;
 	};
 
 private:
-	static const unsigned int ScaleStepCount = 10;
-	static const int EnvelopeScalePower;
-	static const int EnvelopeScaleFactor;
-	static const float LogEnvelopeScaleFactor;
+	/**
+	 * The envelope has enough levels to cover segments of up to
+	 * 2^EnvelopeCoverageBits samples. The number of levels in use
+	 * depends on the scale power, and levels are only allocated once the
+	 * level below has grown long enough to need them.
+	 */
+	static const unsigned int EnvelopeCoverageBits = 60;
+	static const unsigned int MaxScaleStepCount = 15;
 	static const uint64_t EnvelopeDataUnit;
 
+	/**
+	 * A kernel that computes level 0 envelope samples from contiguous
+	 * samples.
+	 * @param src The samples to compute the envelope samples from.
+	 * @param dest The buffer to write the envelope samples into.
+	 * @param block_count The number of envelope samples to compute.
+	 * @param block_length The number of samples per envelope sample.
+	 * Must be a multiple of 16.
+	 */
+	typedef void (*EnvelopeKernel)(const float *src,
+		EnvelopeSample *dest, uint64_t block_count,
+		unsigned int block_length);
+
+	/**
+	 * A kernel that computes envelope samples from the envelope samples
+	 * of the level below.
+	 * @param src The envelope samples to reduce.
+	 * @param dest The buffer to write the envelope samples into.
+	 * @param block_count The number of envelope samples to compute.
+	 * @param block_length The number of envelope samples of the level
+	 * below per envelope sample. Must be a multiple of 16.
+	 */
+	typedef void (*EnvelopeReduceKernel)(const EnvelopeSample *src,
+		EnvelopeSample *dest, uint64_t block_count,
+		unsigned int block_length);
+
+	enum EnvelopeKernelSet {
+		ScalarKernels,
+		SSEKernels,
+		NEONKernels
+	};
+
+public:
+	/// The range of powers accepted by set_default_envelope_scale_power().
+	static const unsigned int MinEnvelopeScalePower;
+	static const unsigned int MaxEnvelopeScalePower;
+
+	/**
+	 * Sets the fan-out of the envelopes of new analog segments. Each
+	 * envelope sample summarises 2^power samples of the level below.
+	 * A larger fan-out uses less memory for the envelope, but leaves
+	 * more samples to be drawn at a given zoom level. The power must be
+	 * between 4 and 8, and is 4 by default.
+	 */
+	static void set_default_envelope_scale_power(unsigned int power);
+
+	static unsigned int default_envelope_scale_power();
+
 public:
-	AnalogSegment(uint64_t samplerate, uint64_t expected_num_samples = 0);
+	AnalogSegment(uint64_t samplerate);
 
 	virtual ~AnalogSegment();
 
+	/**
+	 * Appends interleaved samples of several channels to their segments
+	 * in a single pass over the data.
+	 * @param segments The segments of the channels, in the order in
+	 * which the channels are interleaved.
+	 * @param data The frames of samples.
+	 * @param sample_count The number of samples per channel.
+	 */
+	static void append_interleaved_samples(
+		const std::vector< std::shared_ptr<AnalogSegment> > &segments,
+		const float *data, size_t sample_count);
+
 	void append_interleaved_samples(const float *data,
 		size_t sample_count, size_t stride);
 
+	/**
+	 * Computes the statistics of a range of samples. The envelope is
+	 * used to cover the range with as few blocks as possible, so the
+	 * cost grows with the logarithm of the length of the range.
+	 * @param start The index of the first sample.
+	 * @param end The index after the last sample.
+	 * @return The statistics, with a @c count of zero if the range is
+	 * empty.
+	 */
+	Statistics get_statistics(uint64_t start, uint64_t end) const;
+
+	uint64_t memory_usage() const;
+
+	/**
+	 * Gets the memory used by each level of the envelope.
+	 * @return The number of bytes allocated for each level, from the
+	 * finest level up to the coarsest level computed so far.
+	 */
+	std::vector<uint64_t> envelope_memory_usage() const;
+
+	/**
+	 * Copies a range of samples out of the segment. Use a @c ReadView
+	 * to access the samples without copying them.
+	 * @return The samples, which must be freed with @c delete[] .
+	 */
 	const float* get_samples(int64_t start_sample,
 		int64_t end_sample) const;
 
-	void get_envelope_section(EnvelopeSection &s,
-		uint64_t start, uint64_t end, float min_length) const;
-
 private:
+	/**
+	 * Gets the fastest set of envelope kernels supported by the CPU.
+	 */
+	static EnvelopeKernelSet fastest_envelope_kernel_set();
+
+	/**
+	 * Gets the kernels that compute envelope samples.
+	 * @param set The kernel set to take the kernels from.
+	 * @param kernel Receives the level 0 kernel.
+	 * @param reduce_kernel Receives the kernel for the higher levels.
+	 * @return false if the set is not available in this build.
+	 */
+	static bool envelope_kernels(EnvelopeKernelSet set,
+		EnvelopeKernel &kernel, EnvelopeReduceKernel &reduce_kernel);
+
 	void reallocate_envelope(Envelope &l);
 
 	void append_payload_to_envelope_levels();
 
 private:
-	struct Envelope envelope_levels_[ScaleStepCount];
+	static unsigned int default_envelope_scale_power_;
+
+	const unsigned int envelope_scale_power_;
+	const unsigned int envelope_scale_factor_;
+	const float log_envelope_scale_factor_;
+	const unsigned int scale_step_count_;
+
+	struct Envelope envelope_levels_[MaxScaleStepCount];
+
+	EnvelopeKernel envelope_kernel_;
+	EnvelopeReduceKernel envelope_reduce_kernel_;
 
 	friend struct AnalogSegmentTest::Basic;
+	friend struct AnalogSegmentTest::EnvelopeKernels;
+	friend struct AnalogSegmentTest::EnvelopeBenchmark;
 };
 
 } // namespace data
@@ -26,27 +26,39 @@ extern "C" {
 #include <vector>
 
 #include "annotation.hpp"
+#include "stringtable.hpp"
 
 namespace pv {
 namespace data {
 namespace decode {
 
-Annotation::Annotation(const srd_proto_data *const pdata) :
+Annotation::Annotation(const srd_proto_data *const pdata,
+	const std::shared_ptr<StringTable> &strings) :
 	start_sample_(pdata->start_sample),
-	end_sample_(pdata->end_sample)
+	end_sample_(pdata->end_sample),
+	strings_(strings)
 {
 	assert(pdata);
+	assert(strings);
 	const srd_proto_data_annotation *const pda =
 		(const srd_proto_data_annotation*)pdata->data;
 	assert(pda);
 
 	format_ = pda->ann_class;
 
-	const char *const *annotations = (char**)pda->ann_text;
-	while (*annotations) {
-		annotations_.push_back(QString::fromUtf8(*annotations));
-		annotations++;
-	}
+	annotations_ = &strings->intern((char**)pda->ann_text);
+}
+
+Annotation::Annotation(uint64_t start_sample, uint64_t end_sample,
+	int format, const std::shared_ptr<const StringTable> &strings,
+	const std::vector<QString> &annotations) :
+	start_sample_(start_sample),
+	end_sample_(end_sample),
+	format_(format),
+	strings_(strings),
+	annotations_(&annotations)
+{
+	assert(strings);
 }
 
 uint64_t Annotation::start_sample() const
@@ -66,7 +78,7 @@ int Annotation::format() const
 
 const std::vector<QString>& Annotation::annotations() const
 {
-	return annotations_;
+	return *annotations_;
 }
 
 } // namespace decode
@@ -21,6 +21,9 @@
 #ifndef PULSEVIEW_PV_VIEW_DECODE_ANNOTATION_HPP
 #define PULSEVIEW_PV_VIEW_DECODE_ANNOTATION_HPP
 
+#include <memory>
+#include <vector>
+
 #include <stdint.h>
 
 #include <QString>
@@ -31,10 +34,25 @@ namespace pv {
 namespace data {
 namespace decode {
 
+class StringTable;
+
+/**
+ * A fixed-size record of an annotation. The texts are interned in a
+ * @c StringTable , which the annotation and its copies keep alive.
+ */
 class Annotation
 {
 public:
-	Annotation(const srd_proto_data *const pdata);
+	Annotation(const srd_proto_data *const pdata,
+		const std::shared_ptr<StringTable> &strings);
+
+	/**
+	 * Constructs an annotation from its fields.
+	 * @param strings the table that @c annotations is interned in.
+	 */
+	Annotation(uint64_t start_sample, uint64_t end_sample, int format,
+		const std::shared_ptr<const StringTable> &strings,
+		const std::vector<QString> &annotations);
 
 	uint64_t start_sample() const;
 	uint64_t end_sample() const;
@@ -45,7 +63,8 @@ private:
 	uint64_t start_sample_;
 	uint64_t end_sample_;
 	int format_;
-	std::vector<QString> annotations_;
+	std::shared_ptr<const StringTable> strings_;
+	const std::vector<QString> *annotations_;
 };
 
 } // namespace decode
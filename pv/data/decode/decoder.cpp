@@ -38,7 +38,8 @@ namespace decode {
 
 Decoder::Decoder(const srd_decoder *const dec) :
 	decoder_(dec),
-	shown_(true)
+	shown_(true),
+	revision_(0)
 {
 }
 
@@ -72,7 +73,10 @@ Decoder::channels() const
 void Decoder::set_channels(std::map<const srd_channel*,
 	std::shared_ptr<view::LogicSignal> > channels)
 {
-	channels_ = channels;
+	if (channels != channels_) {
+		channels_ = channels;
+		revision_++;
+	}
 }
 
 const std::map<std::string, GVariant*>& Decoder::options() const
@@ -83,8 +87,21 @@ const std::map<std::string, GVariant*>& Decoder::options() const
 void Decoder::set_option(const char *id, GVariant *value)
 {
 	assert(value);
+
+	GVariant *&option = options_[id];
+	if (option && g_variant_equal(option, value))
+		return;
+
 	g_variant_ref(value);
-	options_[id] = value;
+	if (option)
+		g_variant_unref(option);
+	option = value;
+	revision_++;
+}
+
+uint64_t Decoder::revision() const
+{
+	return revision_;
 }
 
 bool Decoder::have_required_channels() const
@@ -111,40 +128,62 @@ set< shared_ptr<pv::data::Logic> > Decoder::get_data()
 	return data;
 }
 
-srd_decoder_inst* Decoder::create_decoder_inst(srd_session *session) const
+Decoder::Config Decoder::config() const
+{
+	Config config;
+	config.decoder = decoder_;
+
+	for (const auto &o : options_) {
+		gchar *const value = g_variant_print(o.second, TRUE);
+		config.options[o.first] = value;
+		g_free(value);
+	}
+
+	for (const auto &c : channels_) {
+		assert(c.second);
+		config.channels[c.first->id] = c.second->channel()->index();
+	}
+
+	return config;
+}
+
+srd_decoder_inst* Decoder::Config::create_decoder_inst(
+	srd_session *session) const
 {
 	GHashTable *const opt_hash = g_hash_table_new_full(g_str_hash,
 		g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
 
-	for (auto i = options_.cbegin(); i != options_.cend(); i++)
+	for (const auto &o : options)
 	{
-		GVariant *const value = (*i).second;
-		g_variant_ref(value);
-		g_hash_table_replace(opt_hash, (void*)g_strdup(
-			(*i).first.c_str()), value);
+		GVariant *const value = g_variant_parse(nullptr,
+			o.second.c_str(), nullptr, nullptr, nullptr);
+		assert(value);
+		if (value)
+			g_hash_table_replace(opt_hash,
+				(void*)g_strdup(o.first.c_str()), value);
 	}
 
 	srd_decoder_inst *const decoder_inst = srd_inst_new(
-		session, decoder_->id, opt_hash);
+		session, decoder->id, opt_hash);
 	g_hash_table_destroy(opt_hash);
 
 	if (!decoder_inst)
 		return nullptr;
 
 	// Setup the channels
-	GHashTable *const channels = g_hash_table_new_full(g_str_hash,
+	GHashTable *const channel_hash = g_hash_table_new_full(g_str_hash,
 		g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
 
-	for (auto i = channels_.cbegin(); i != channels_.cend(); i++)
+	for (const auto &c : channels)
 	{
-		shared_ptr<view::LogicSignal> signal((*i).second);
-		GVariant *const gvar = g_variant_new_int32(
-			signal->channel()->index());
+		GVariant *const gvar = g_variant_new_int32(c.second);
 		g_variant_ref_sink(gvar);
-		g_hash_table_insert(channels, (*i).first->id, gvar);
+		g_hash_table_insert(channel_hash, g_strdup(c.first.c_str()),
+			gvar);
 	}
 
-	srd_inst_channel_set_all(decoder_inst, channels);
+	srd_inst_channel_set_all(decoder_inst, channel_hash);
+	g_hash_table_destroy(channel_hash);
 
 	return decoder_inst;
 }
@@ -24,6 +24,9 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
+
+#include <stdint.h>
 
 #include <glib.h>
 
@@ -46,6 +49,27 @@ namespace decode {
 
 class Decoder
 {
+public:
+	/**
+	 * A copy of the configuration of a decoder, taken for a decode on
+	 * the thread that configures the decoder, so that the decode thread
+	 * never reads the decoder while it is being changed.
+	 */
+	struct Config
+	{
+		const srd_decoder *decoder;
+
+		/// The options, with their values printed with their types.
+		std::map<std::string, std::string> options;
+
+		/// The index of the logic channel of each decoder channel, by
+		/// the ID of the decoder channel.
+		std::map<std::string, unsigned int> channels;
+
+		srd_decoder_inst* create_decoder_inst(
+			srd_session *session) const;
+	};
+
 public:
 	Decoder(const srd_decoder *const decoder);
 
@@ -67,8 +91,16 @@ public:
 
 	bool have_required_channels() const;
 
-	srd_decoder_inst* create_decoder_inst(
-		srd_session *session) const;
+	/**
+	 * Gets the revision of the configuration of the decoder, which
+	 * changes whenever the channels or options are changed.
+	 */
+	uint64_t revision() const;
+
+	/**
+	 * Takes a copy of the configuration of the decoder.
+	 */
+	Config config() const;
 
 	std::set< std::shared_ptr<pv::data::Logic> > get_data();
 
@@ -80,6 +112,8 @@ private:
 	std::map<const srd_channel*, std::shared_ptr<pv::view::LogicSignal> >
 		channels_;
 	std::map<std::string, GVariant*> options_;
+
+	uint64_t revision_;
 };
 
 } // namespace decode
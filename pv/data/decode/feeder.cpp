@@ -0,0 +1,201 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include <QCryptographicHash>
+
+#include "feeder.hpp"
+
+#include <pv/data/logicsegment.hpp>
+
+using std::atomic;
+using std::lock_guard;
+using std::make_shared;
+using std::map;
+using std::min;
+using std::mutex;
+using std::shared_ptr;
+using std::weak_ptr;
+
+namespace pv {
+namespace data {
+namespace decode {
+
+const int64_t Feeder::ChunkBytes = 4 * 1024 * 1024;
+const unsigned int Feeder::CacheLength = 2;
+
+namespace {
+
+/**
+ * Gets the least power of two number of samples that is at least
+ * @c Feeder::ChunkBytes long.
+ */
+int64_t chunk_length_for(unsigned int unit_size)
+{
+	int64_t length = 1;
+	while (length * unit_size < Feeder::ChunkBytes)
+		length <<= 1;
+	return length;
+}
+
+} // anonymous namespace
+
+mutex Feeder::feeders_mutex_;
+map< const LogicSegment*, weak_ptr<Feeder> > Feeder::feeders_;
+
+Feeder::Feeder(shared_ptr<const LogicSegment> segment) :
+	segment_(segment),
+	unit_size_(segment->unit_size()),
+	chunk_length_(chunk_length_for(segment->unit_size())),
+	chunks_read_(0),
+	digest_sample_count_(-1)
+{
+}
+
+shared_ptr<Feeder> Feeder::get(shared_ptr<const LogicSegment> segment)
+{
+	assert(segment);
+
+	lock_guard<mutex> lock(feeders_mutex_);
+
+	// Forget the feeders that are no longer used
+	for (auto i = feeders_.begin(); i != feeders_.end();)
+		if ((*i).second.expired())
+			i = feeders_.erase(i);
+		else
+			i++;
+
+	shared_ptr<Feeder> feeder = feeders_[segment.get()].lock();
+	if (!feeder) {
+		feeder = shared_ptr<Feeder>(new Feeder(segment));
+		feeders_[segment.get()] = feeder;
+	}
+
+	return feeder;
+}
+
+shared_ptr<const Feeder::Chunk> Feeder::get_chunk(int64_t sample)
+{
+	const int64_t index = sample / chunk_length_;
+	const int64_t start = index * chunk_length_;
+	const int64_t end = min(start + chunk_length_,
+		(int64_t)segment_->get_sample_count());
+
+	lock_guard<mutex> lock(mutex_);
+
+	// Use the chunk if it has been read, unless it was read before
+	// the samples at its end had been appended
+	shared_ptr<const Chunk> chunk = chunks_[index].lock();
+	if (chunk && chunk->end >= end)
+		return chunk;
+
+	chunk = read_chunk(start, end);
+	chunks_[index] = chunk;
+	chunks_read_++;
+
+	recent_chunks_.push_back(chunk);
+	if (recent_chunks_.size() > CacheLength)
+		recent_chunks_.pop_front();
+
+	// Forget the chunks that are no longer used
+	if (chunks_.size() > 2 * CacheLength) {
+		for (auto i = chunks_.begin(); i != chunks_.end();)
+			if ((*i).second.expired())
+				i = chunks_.erase(i);
+			else
+				i++;
+	}
+
+	return chunk;
+}
+
+unsigned int Feeder::unit_size() const
+{
+	return unit_size_;
+}
+
+int64_t Feeder::chunk_length() const
+{
+	return chunk_length_;
+}
+
+uint64_t Feeder::chunks_read() const
+{
+	lock_guard<mutex> lock(mutex_);
+	return chunks_read_;
+}
+
+QByteArray Feeder::sample_digest(int64_t sample_count,
+	const atomic<bool> &interrupt)
+{
+	// The mutex is held while the samples are hashed, so that stacks
+	// which ask at the same time wait for the digest, rather than
+	// computing it again
+	lock_guard<mutex> lock(digest_mutex_);
+	if (digest_sample_count_ == sample_count)
+		return digest_;
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	for (int64_t i = 0; i < sample_count;) {
+		if (interrupt)
+			return QByteArray();
+
+		const shared_ptr<const Chunk> chunk = get_chunk(i);
+		const int64_t end = min(sample_count, chunk->end);
+		if (end <= i)
+			return QByteArray();
+		hash.addData((const char*)chunk->data +
+			(i - chunk->start) * unit_size_,
+			(end - i) * unit_size_);
+		i = end;
+	}
+
+	digest_ = hash.result();
+	digest_sample_count_ = sample_count;
+	return digest_;
+}
+
+shared_ptr<Feeder::Chunk> Feeder::read_chunk(int64_t start,
+	int64_t end) const
+{
+	const shared_ptr<Chunk> chunk = make_shared<Chunk>();
+	chunk->start = start;
+	chunk->end = end;
+
+	// Refer to the samples in place if they are stored contiguously,
+	// and copy them otherwise
+	uint64_t count = 0;
+	chunk->data = (start < end) ? segment_->get_contiguous_samples(
+		start, end, count) : nullptr;
+	if (!chunk->data || (int64_t)count != end - start) {
+		chunk->buffer.resize((end - start) * unit_size_);
+		if (start < end)
+			segment_->get_samples(chunk->buffer.data(), start, end);
+		chunk->data = chunk->buffer.data();
+	}
+
+	return chunk;
+}
+
+} // decode
+} // data
+} // pv
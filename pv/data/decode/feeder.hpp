@@ -0,0 +1,155 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef PULSEVIEW_PV_DATA_DECODE_FEEDER_HPP
+#define PULSEVIEW_PV_DATA_DECODE_FEEDER_HPP
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+#include <QByteArray>
+
+namespace pv {
+namespace data {
+
+class LogicSegment;
+
+namespace decode {
+
+/**
+ * Reads the samples of a logic segment in chunks for the decoder stacks
+ * that decode it.
+ *
+ * All the decoder stacks on a segment share one feeder, so each chunk is
+ * read out of the segment once, and handed to every stack that asks for
+ * it. Chunks are reference-counted: a chunk stays alive while any stack
+ * is sending it, and the most recently read chunks are also kept by the
+ * feeder, so that stacks which decode at about the same pace share them.
+ * A stack that falls further behind reads its chunks again, rather than
+ * holding the others back.
+ */
+class Feeder
+{
+public:
+	/**
+	 * The least length of the chunks in bytes. It is no less than the
+	 * longest chunk that a decoder stack sends, so that a send is taken
+	 * from no more than two chunks, and the samples are sent in place.
+	 */
+	static const int64_t ChunkBytes;
+
+	/**
+	 * The number of recently read chunks kept by the feeder. The chunks
+	 * are long, so few are kept, to bound the memory used by chunks
+	 * that are copied out of a compressed segment.
+	 */
+	static const unsigned int CacheLength;
+
+	/**
+	 * A chunk of samples.
+	 */
+	struct Chunk
+	{
+		/// The index of the first sample, and the index after the last
+		/// sample of the chunk.
+		int64_t start, end;
+
+		/// The samples, which are either in the memory of the segment
+		/// or in @c buffer .
+		const uint8_t *data;
+
+		std::vector<uint8_t> buffer;
+	};
+
+public:
+	/**
+	 * Gets the feeder of a segment, which is created if the segment
+	 * has none.
+	 */
+	static std::shared_ptr<Feeder> get(
+		std::shared_ptr<const LogicSegment> segment);
+
+	/**
+	 * Gets the chunk that contains a sample. The chunk extends to the
+	 * end of its span of @c chunk_length() samples, or to the last sample
+	 * in the segment.
+	 */
+	std::shared_ptr<const Chunk> get_chunk(int64_t sample);
+
+	unsigned int unit_size() const;
+
+	/**
+	 * Gets the length of the chunks in samples. It is a power of two,
+	 * so that the chunks do not straddle the chunks of the segment.
+	 */
+	int64_t chunk_length() const;
+
+	/**
+	 * Gets the number of chunks that have been read out of the segment.
+	 */
+	uint64_t chunks_read() const;
+
+	/**
+	 * Gets the SHA-1 digest of the first samples of the segment. The
+	 * samples of a complete frame do not change, so the digest is kept,
+	 * and is only computed once for all the decoder stacks and all
+	 * their decodes.
+	 * @param sample_count The number of samples to digest.
+	 * @param interrupt The digest is abandoned once this is set.
+	 * @return The digest, or an empty array if it was abandoned.
+	 */
+	QByteArray sample_digest(int64_t sample_count,
+		const std::atomic<bool> &interrupt);
+
+private:
+	explicit Feeder(std::shared_ptr<const LogicSegment> segment);
+
+	std::shared_ptr<Chunk> read_chunk(int64_t start, int64_t end) const;
+
+private:
+	static std::mutex feeders_mutex_;
+	static std::map< const LogicSegment*, std::weak_ptr<Feeder> >
+		feeders_;
+
+	const std::shared_ptr<const LogicSegment> segment_;
+	const unsigned int unit_size_;
+	const int64_t chunk_length_;
+
+	mutable std::mutex mutex_;
+	std::map< int64_t, std::weak_ptr<const Chunk> > chunks_;
+	std::deque< std::shared_ptr<const Chunk> > recent_chunks_;
+	uint64_t chunks_read_;
+
+	std::mutex digest_mutex_;
+	int64_t digest_sample_count_;
+	QByteArray digest_;
+};
+
+} // decode
+} // data
+} // pv
+
+#endif // PULSEVIEW_PV_DATA_DECODE_FEEDER_HPP
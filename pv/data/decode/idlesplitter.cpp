@@ -0,0 +1,111 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "idlesplitter.hpp"
+
+#include <pv/data/logicsegment.hpp>
+
+using boost::optional;
+using std::max;
+using std::min;
+using std::sort;
+using std::vector;
+
+namespace pv {
+namespace data {
+namespace decode {
+
+vector<int64_t> IdleSplitter::split(LogicSegment &segment,
+	uint64_t sig_mask, int64_t sample_count, unsigned int range_count,
+	int64_t min_idle_length)
+{
+	vector<int64_t> points(1, 0);
+
+	const int64_t range_length = (range_count > 0) ?
+		sample_count / range_count : 0;
+
+	if (sig_mask && range_length > 0)
+		for (unsigned int i = 1; i < range_count; i++) {
+			// Look for an idle point within a quarter of a range of
+			// the ideal boundary, which keeps the windows apart
+			const int64_t target = i * range_length;
+			const int64_t start = target - range_length / 4;
+			const int64_t end = min(target + range_length / 4,
+				sample_count - 1);
+			if (start >= end)
+				continue;
+
+			const optional<int64_t> point = find_idle_point(segment,
+				sig_mask, start, end, min_idle_length);
+			if (point)
+				points.push_back(*point);
+		}
+
+	points.push_back(sample_count);
+	return points;
+}
+
+optional<int64_t> IdleSplitter::find_idle_point(LogicSegment &segment,
+	uint64_t sig_mask, int64_t start, int64_t end,
+	int64_t min_idle_length)
+{
+	assert(start < end);
+	assert(end < (int64_t)segment.get_sample_count());
+
+	// The edges only need to be resolved to a fraction of the idle
+	// length, which lets the search skip through the coarse levels of
+	// the mip-map
+	const int64_t resolution = max<int64_t>(min_idle_length / 4, 1);
+
+	vector< vector<LogicSegment::EdgePair> > edges;
+	segment.get_subsampled_edges(edges, start, end, resolution, sig_mask);
+
+	// The ends of the window are treated as edges, because the channels
+	// may change just outside it
+	vector<int64_t> positions;
+	positions.push_back(start);
+	positions.push_back(end);
+	for (const auto &e : edges)
+		for (const LogicSegment::EdgePair &p : e)
+			positions.push_back(min<int64_t>(p.first, end));
+	sort(positions.begin(), positions.end());
+
+	// An edge lies somewhere in the block of the resolution that it
+	// was found in, so each stretch is shortened by a block at either
+	// end
+	int64_t longest = 0, point = 0;
+	for (size_t i = 1; i < positions.size(); i++) {
+		const int64_t length = positions[i] - positions[i - 1] -
+			2 * resolution;
+		if (length > longest) {
+			longest = length;
+			point = (positions[i - 1] + positions[i]) / 2;
+		}
+	}
+
+	return boost::make_optional(longest >= min_idle_length, point);
+}
+
+} // decode
+} // data
+} // pv
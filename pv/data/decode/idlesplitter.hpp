@@ -0,0 +1,86 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef PULSEVIEW_PV_DATA_DECODE_IDLESPLITTER_HPP
+#define PULSEVIEW_PV_DATA_DECODE_IDLESPLITTER_HPP
+
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/optional.hpp>
+
+namespace pv {
+namespace data {
+
+class LogicSegment;
+
+namespace decode {
+
+/**
+ * Splits a logic segment into ranges that can be decoded independently.
+ *
+ * Many protocols reset their decoders whenever the bus is idle, such as
+ * UART between frames, or I2C between a STOP and the next START. The
+ * splitter searches the mip-map of the segment for long stretches in
+ * which none of the decoded channels changes, and places the boundaries
+ * of the ranges in the middle of them, so that a decoder session which
+ * starts at a boundary sees an idle bus.
+ */
+class IdleSplitter
+{
+public:
+	/**
+	 * Splits a segment into about equal ranges at idle points.
+	 * @param segment The segment to split.
+	 * @param sig_mask A bit mask of the channels that must be idle.
+	 * @param sample_count The number of samples to split.
+	 * @param range_count The number of ranges wanted.
+	 * @param min_idle_length The minimum number of samples for which all
+	 * the channels must be idle around a boundary.
+	 * @return The boundaries of the ranges, starting with 0 and ending
+	 * with @c sample_count . There are fewer ranges than wanted where
+	 * no idle point was found near the ideal boundary.
+	 */
+	static std::vector<int64_t> split(LogicSegment &segment,
+		uint64_t sig_mask, int64_t sample_count,
+		unsigned int range_count, int64_t min_idle_length);
+
+	/**
+	 * Finds the middle of the longest idle stretch between two samples.
+	 * @param segment The segment to search.
+	 * @param sig_mask A bit mask of the channels that must be idle.
+	 * @param start The first sample to search.
+	 * @param end The last sample to search, which must be before the
+	 * end of the segment.
+	 * @param min_idle_length The minimum length of the idle stretch.
+	 * @return The idle point, or nothing if there is no stretch of at
+	 * least @c min_idle_length samples.
+	 */
+	static boost::optional<int64_t> find_idle_point(LogicSegment &segment,
+		uint64_t sig_mask, int64_t start, int64_t end,
+		int64_t min_idle_length);
+};
+
+} // decode
+} // data
+} // pv
+
+#endif // PULSEVIEW_PV_DATA_DECODE_IDLESPLITTER_HPP
@@ -0,0 +1,394 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <libsigrokdecode/libsigrokdecode.h>
+
+#include <cstddef>
+#include <cstring>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+#include "resultcache.hpp"
+#include "decoder.hpp"
+#include "stringtable.hpp"
+
+using std::make_pair;
+using std::map;
+using std::shared_ptr;
+using std::vector;
+
+namespace pv {
+namespace data {
+namespace decode {
+
+namespace {
+
+const char Magic[8] = {'P', 'V', 'D', 'E', 'C', 'O', 'D', 'E'};
+const uint32_t Version = 1;
+
+/// The value of RowHeader::ann_row for the row of a decoder without a
+/// list of annotation rows.
+const uint32_t NoAnnotationRow = 0xFFFFFFFF;
+
+struct FileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t row_count;
+	uint64_t list_count;
+	uint64_t lists_offset;
+	uint64_t file_size;
+};
+
+struct RowHeader
+{
+	/// The index of the decoder in the stack.
+	uint32_t layer;
+
+	/// The index of the row in the annotation rows of the decoder.
+	uint32_t ann_row;
+
+	uint64_t annotation_count;
+};
+
+struct AnnotationRecord
+{
+	uint64_t start_sample;
+	uint64_t end_sample;
+	int32_t format;
+
+	/// The index of the list of texts.
+	uint32_t texts;
+};
+
+} // anonymous namespace
+
+QString ResultCache::directory_;
+
+void ResultCache::set_directory(const QString &directory)
+{
+	directory_ = directory;
+}
+
+QString ResultCache::directory()
+{
+	if (!directory_.isEmpty())
+		return directory_;
+
+#if QT_VERSION >= 0x050000
+	const QString location = QStandardPaths::writableLocation(
+		QStandardPaths::CacheLocation);
+#else
+	const QString location = QDesktopServices::storageLocation(
+		QDesktopServices::CacheLocation);
+#endif
+	return location.isEmpty() ? QString() :
+		QDir(location).filePath("decode");
+}
+
+QByteArray ResultCache::key(const QByteArray &sample_digest,
+	unsigned int unit_size, int64_t sample_count, double samplerate,
+	const vector<Decoder::Config> &stack)
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+
+	// The samples are hashed once by the feeder, so only their digest
+	// is mixed in here
+	hash.addData(QString("%1 %2 %3 %4\n").arg(Version).arg(unit_size).
+		arg(sample_count).arg(samplerate, 0, 'g', 17).toUtf8());
+	hash.addData(sample_digest);
+
+	// The decoders have no version of their own, so hash the version of
+	// libsigrokdecode, which they are installed with, and the classes and
+	// rows of annotations that they declare
+	hash.addData(QByteArray(SRD_PACKAGE_VERSION_STRING "\n"));
+
+	// Hash the configuration of the decoders. The options are sorted by
+	// name, and the channels are sorted by their ID, so that the key
+	// does not depend on the addresses of the channels
+	for (const Decoder::Config &dec : stack) {
+		const srd_decoder *const decc = dec.decoder;
+		QString config = QString::fromUtf8(decc->id) + "\n";
+
+		for (const GSList *l = decc->annotations; l; l = l->next) {
+			const char *const *const ann = (const char**)l->data;
+			config += QString("class %1 %2\n").arg(
+				QString::fromUtf8(ann[0]),
+				QString::fromUtf8(ann[1]));
+		}
+
+		for (const GSList *l = decc->annotation_rows; l; l = l->next) {
+			const srd_decoder_annotation_row *const ann_row =
+				(const srd_decoder_annotation_row*)l->data;
+			config += QString("row %1").arg(
+				QString::fromUtf8(ann_row->id));
+			for (const GSList *ll = ann_row->ann_classes; ll;
+				ll = ll->next)
+				config += QString(" %1").arg(
+					GPOINTER_TO_INT(ll->data));
+			config += "\n";
+		}
+
+		for (const auto &o : dec.options)
+			config += QString::fromUtf8(o.first.c_str()) + "=" +
+				QString::fromUtf8(o.second.c_str()) + "\n";
+
+		for (const auto &c : dec.channels)
+			config += QString("%1:%2\n").arg(
+				QString::fromUtf8(c.first.c_str())).arg(c.second);
+
+		hash.addData(config.toUtf8());
+	}
+
+	return hash.result();
+}
+
+bool ResultCache::load(const QByteArray &key,
+	const vector<Decoder::Config> &stack,
+	map<const Row, RowData> &rows, const shared_ptr<StringTable> &strings)
+{
+	const QString path = file_path(key);
+	if (path.isEmpty())
+		return false;
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly) ||
+		file.size() < (qint64)sizeof(FileHeader))
+		return false;
+
+	const qint64 size = file.size();
+	const uchar *const base = file.map(0, size);
+	if (!base)
+		return false;
+	const uchar *const end = base + size;
+
+	FileHeader header;
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+		header.version != Version ||
+		header.file_size != (uint64_t)size ||
+		header.lists_offset < sizeof(FileHeader) ||
+		header.lists_offset > (uint64_t)size)
+		return false;
+
+	// Intern the lists of texts, which are null-terminated in the file
+	vector<const StringTable::StringList*> lists;
+	vector<const char*> texts;
+	const uchar *p = base + header.lists_offset;
+	for (uint64_t i = 0; i < header.list_count; i++) {
+		uint32_t text_count, length;
+		if (end - p < 4)
+			return false;
+		memcpy(&text_count, p, 4);
+		p += 4;
+
+		texts.clear();
+		for (uint32_t t = 0; t < text_count; t++) {
+			if (end - p < 4)
+				return false;
+			memcpy(&length, p, 4);
+			p += 4;
+			if ((uint64_t)(end - p) <= length || p[length] != 0)
+				return false;
+			texts.push_back((const char*)p);
+			p += length + 1;
+		}
+		texts.push_back(nullptr);
+
+		p = base + ((p - base + 3) & ~3);
+		lists.push_back(&strings->intern(texts.data()));
+	}
+
+	// Read the rows
+	const uchar *const rows_end = base + header.lists_offset;
+	p = base + sizeof(FileHeader);
+	for (uint32_t r = 0; r < header.row_count; r++) {
+		RowHeader row_header;
+		if (rows_end - p < (ptrdiff_t)sizeof(RowHeader))
+			return false;
+		memcpy(&row_header, p, sizeof(RowHeader));
+		p += sizeof(RowHeader);
+
+		if (row_header.layer >= stack.size())
+			return false;
+		const srd_decoder *const decc = stack[row_header.layer].decoder;
+		const int class_count = g_slist_length(decc->annotations);
+
+		Row row(decc);
+		if (row_header.ann_row != NoAnnotationRow) {
+			const srd_decoder_annotation_row *const ann_row =
+				(const srd_decoder_annotation_row*)
+				g_slist_nth_data(decc->annotation_rows,
+					row_header.ann_row);
+			if (!ann_row)
+				return false;
+			row = Row(decc, ann_row);
+		}
+
+		if (row_header.annotation_count > (uint64_t)(rows_end - p) /
+			sizeof(AnnotationRecord))
+			return false;
+
+		RowData &data = rows[row];
+		const AnnotationRecord *const records =
+			(const AnnotationRecord*)p;
+		for (uint64_t i = 0; i < row_header.annotation_count; i++) {
+			const AnnotationRecord &a = records[i];
+			if (a.texts >= lists.size() || a.format < 0 ||
+				a.format >= class_count)
+				return false;
+			data.push_annotation(Annotation(a.start_sample,
+				a.end_sample, a.format, strings,
+				*lists[a.texts]));
+		}
+
+		p += row_header.annotation_count * sizeof(AnnotationRecord);
+	}
+
+	return true;
+}
+
+bool ResultCache::store(const QByteArray &key,
+	const vector<Decoder::Config> &stack,
+	const map<const Row, RowData> &rows)
+{
+	const QString path = file_path(key);
+	if (path.isEmpty() || !QDir().mkpath(directory()))
+		return false;
+
+	// Write to a temporary file, which replaces the cache file once it
+	// is complete, so that a partly written file is never read
+	QFile file(path + ".tmp");
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.row_count = rows.size();
+
+	bool ok = file.write((const char*)&header, sizeof(header)) ==
+		sizeof(header);
+
+	// Write the rows, and number the lists of texts that they use
+	map<const StringTable::StringList*, uint32_t> list_indices;
+	vector<const StringTable::StringList*> lists;
+	vector<AnnotationRecord> records;
+
+	for (const auto &r : rows) {
+		const Row &row = r.first;
+
+		RowHeader row_header;
+		row_header.layer = 0;
+		for (const Decoder::Config &dec : stack) {
+			if (dec.decoder == row.decoder())
+				break;
+			row_header.layer++;
+		}
+		if (row_header.layer == stack.size()) {
+			ok = false;
+			break;
+		}
+
+		row_header.ann_row = row.row() ? (uint32_t)g_slist_index(
+			row.decoder()->annotation_rows, row.row()) :
+			NoAnnotationRow;
+		row_header.annotation_count = r.second.annotations().size();
+
+		records.clear();
+		for (const Annotation &a : r.second.annotations()) {
+			const auto l = list_indices.insert(make_pair(
+				&a.annotations(), (uint32_t)lists.size()));
+			if (l.second)
+				lists.push_back(&a.annotations());
+
+			AnnotationRecord record;
+			record.start_sample = a.start_sample();
+			record.end_sample = a.end_sample();
+			record.format = a.format();
+			record.texts = (*l.first).second;
+			records.push_back(record);
+		}
+
+		ok = ok && file.write((const char*)&row_header,
+			sizeof(row_header)) == sizeof(row_header);
+		ok = ok && file.write((const char*)records.data(),
+			records.size() * sizeof(AnnotationRecord)) ==
+			(qint64)(records.size() * sizeof(AnnotationRecord));
+	}
+
+	// Write the lists of texts, each aligned to 4 bytes
+	header.list_count = lists.size();
+	header.lists_offset = file.pos();
+	for (const StringTable::StringList *l : lists) {
+		QByteArray entry;
+		const uint32_t text_count = l->size();
+		entry.append((const char*)&text_count, 4);
+		for (const QString &text : *l) {
+			const QByteArray utf8 = text.toUtf8();
+			const uint32_t length = utf8.size();
+			entry.append((const char*)&length, 4);
+			entry.append(utf8);
+			entry.append('\0');
+		}
+		while (entry.size() % 4 != 0)
+			entry.append('\0');
+		ok = ok && file.write(entry) == entry.size();
+	}
+
+	header.file_size = file.pos();
+	ok = ok && file.seek(0) &&
+		file.write((const char*)&header, sizeof(header)) ==
+			sizeof(header);
+	file.close();
+
+	QFile::remove(path);
+	if (!ok || !file.rename(path)) {
+		file.remove();
+		return false;
+	}
+
+	return true;
+}
+
+QString ResultCache::file_path(const QByteArray &key)
+{
+	const QString dir = directory();
+	if (dir.isEmpty())
+		return QString();
+	return QDir(dir).filePath(QString::fromLatin1(key.toHex()) +
+		".pvdc");
+}
+
+} // decode
+} // data
+} // pv
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef PULSEVIEW_PV_DATA_DECODE_RESULTCACHE_HPP
+#define PULSEVIEW_PV_DATA_DECODE_RESULTCACHE_HPP
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include "decoder.hpp"
+#include "row.hpp"
+#include "rowdata.hpp"
+
+namespace pv {
+namespace data {
+namespace decode {
+
+class StringTable;
+
+/**
+ * A cache of decoded annotations on disk.
+ *
+ * The annotations of a decoder stack are stored in a file named after a
+ * hash of the samples that were decoded, of the configuration of the
+ * decoders, and of the version of the decoders, so that the rows can be
+ * loaded instead of decoded when the same capture is decoded again in
+ * the same way.
+ *
+ * The file holds fixed-size records that are aligned as they would be in
+ * memory, and is mapped when it is read:
+ * - a header;
+ * - for each row, a row header followed by its annotation records;
+ * - the lists of texts of the annotations, which the records refer to by
+ *   index.
+ */
+class ResultCache
+{
+public:
+	/**
+	 * Sets the directory in which the cache files are kept. If it is
+	 * empty, a directory in the cache location of the platform is used.
+	 */
+	static void set_directory(const QString &directory);
+
+	static QString directory();
+
+	/**
+	 * Computes the key of the decode of a segment.
+	 * @param sample_digest the digest of the samples that are decoded,
+	 * from Feeder::sample_digest.
+	 * @param unit_size the unit size of the samples.
+	 * @param sample_count the number of samples that are decoded.
+	 * @param samplerate the samplerate given to the decoders.
+	 * @param stack the configuration of the decoders of the stack.
+	 */
+	static QByteArray key(const QByteArray &sample_digest,
+		unsigned int unit_size, int64_t sample_count,
+		double samplerate, const std::vector<Decoder::Config> &stack);
+
+	/**
+	 * Loads the rows of a decode from the cache.
+	 * @param key the key of the decode.
+	 * @param stack the configuration of the decoders of the stack,
+	 * which the rows belong to.
+	 * @param rows receives the rows.
+	 * @param strings the table to intern the texts of the annotations in.
+	 * @return true if the decode was found in the cache.
+	 */
+	static bool load(const QByteArray &key,
+		const std::vector<Decoder::Config> &stack,
+		std::map<const Row, RowData> &rows,
+		const std::shared_ptr<StringTable> &strings);
+
+	/**
+	 * Stores the rows of a decode in the cache.
+	 * @return true if the rows were stored.
+	 */
+	static bool store(const QByteArray &key,
+		const std::vector<Decoder::Config> &stack,
+		const std::map<const Row, RowData> &rows);
+
+private:
+	static QString file_path(const QByteArray &key);
+
+private:
+	static QString directory_;
+};
+
+} // decode
+} // data
+} // pv
+
+#endif // PULSEVIEW_PV_DATA_DECODE_RESULTCACHE_HPP
@@ -18,38 +18,231 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
  */
 
+#include <algorithm>
+#include <cassert>
+
 #include "rowdata.hpp"
 
+using std::lower_bound;
+using std::max;
+using std::min;
+using std::upper_bound;
 using std::vector;
 
 namespace pv {
 namespace data {
 namespace decode {
 
-RowData::RowData()
+const unsigned int RowData::IndexBlockLength = 64;
+
+const unsigned int RowData::SummaryBasePower = 4;
+const unsigned int RowData::SummaryScalePower = 2;
+const unsigned int RowData::SummaryLevelCount = 14;
+
+RowData::RowData() :
+	spans_(SummaryLevelCount)
 {
 }
 
 uint64_t RowData::get_max_sample() const
 {
-	if (annotations_.empty())
+	if (max_end_samples_.empty())
 		return 0;
-	return annotations_.back().end_sample();
+
+	const vector<uint64_t> &top = max_end_samples_.back();
+	return *std::max_element(top.begin(), top.end());
+}
+
+size_t RowData::size() const
+{
+	return annotations_.size();
+}
+
+const vector<Annotation>& RowData::annotations() const
+{
+	return annotations_;
+}
+
+uint64_t RowData::memory_usage() const
+{
+	uint64_t bytes = annotations_.capacity() * sizeof(Annotation);
+	for (const vector<uint64_t> &m : max_end_samples_)
+		bytes += m.capacity() * sizeof(uint64_t);
+	for (const vector<Span> &s : spans_)
+		bytes += s.capacity() * sizeof(Span);
+	return bytes;
 }
 
 void RowData::get_annotation_subset(
 	vector<pv::data::decode::Annotation> &dest,
 	uint64_t start_sample, uint64_t end_sample) const
 {
-	for (auto i = annotations_.cbegin(); i != annotations_.cend(); i++)
-		if ((*i).end_sample() > start_sample &&
-			(*i).start_sample() <= end_sample)
-			dest.push_back(*i);
+	if (annotations_.empty())
+		return;
+
+	// Only the annotations that start no later than the end of the
+	// range can overlap it
+	const size_t end = upper_bound(annotations_.begin(),
+		annotations_.end(), end_sample,
+		[](uint64_t sample, const Annotation &a) {
+			return sample < a.start_sample(); }) -
+		annotations_.begin();
+
+	// Descend the index into the blocks that end after the start of the
+	// range
+	const unsigned int top_level = max_end_samples_.size() - 1;
+	for (size_t node = 0; node < max_end_samples_[top_level].size();
+		node++)
+		get_annotation_subset(dest, top_level, node, start_sample, end);
+}
+
+void RowData::get_annotation_subset(
+	vector<pv::data::decode::Annotation> &dest,
+	unsigned int level, size_t node, uint64_t start_sample,
+	size_t end) const
+{
+	if (max_end_samples_[level][node] <= start_sample)
+		return;
+
+	const size_t first = node * IndexBlockLength;
+	if (level == 0) {
+		const size_t last = min(first + IndexBlockLength, end);
+		for (size_t i = first; i < last; i++)
+			if (annotations_[i].end_sample() > start_sample)
+				dest.push_back(annotations_[i]);
+		return;
+	}
+
+	// The number of annotations covered by each child node
+	size_t child_span = IndexBlockLength;
+	for (unsigned int l = 1; l < level; l++)
+		child_span *= IndexBlockLength;
+
+	const size_t last = min(first + IndexBlockLength,
+		max_end_samples_[level - 1].size());
+	for (size_t child = first; child < last &&
+		child * child_span < end; child++)
+		get_annotation_subset(dest, level - 1, child, start_sample,
+			end);
 }
 
 void RowData::push_annotation(const Annotation &a)
 {
-	annotations_.push_back(a);
+	// Insert the annotation after the annotations that start no later
+	// than it, so that annotations with the same start sample keep the
+	// order in which they arrived. This is nearly always at the end
+	auto iter = annotations_.end();
+	if (!annotations_.empty() &&
+		a.start_sample() < annotations_.back().start_sample())
+		iter = upper_bound(annotations_.begin(), annotations_.end(),
+			a.start_sample(),
+			[](uint64_t sample, const Annotation &b) {
+				return sample < b.start_sample(); });
+
+	const size_t index = iter - annotations_.begin();
+	annotations_.insert(iter, a);
+	update_index(index);
+	update_summary(a);
+}
+
+bool RowData::get_coverage_spans(vector<Span> &dest,
+	uint64_t start_sample, uint64_t end_sample, double max_gap) const
+{
+	// Find the coarsest level that does not hide gaps wider than
+	// max_gap
+	unsigned int level = 0;
+	if ((double)(1ULL << SummaryBasePower) > max_gap)
+		return false;
+	while (level + 1 < SummaryLevelCount &&
+		(double)(1ULL << (SummaryBasePower + (level + 1) *
+			SummaryScalePower)) <= max_gap)
+		level++;
+
+	const vector<Span> &spans = spans_[level];
+	auto iter = lower_bound(spans.begin(), spans.end(), start_sample,
+		[](const Span &s, uint64_t sample) {
+			return s.end_sample < sample; });
+	for (; iter != spans.end() && (*iter).start_sample <= end_sample;
+		iter++)
+		dest.push_back(*iter);
+
+	return true;
+}
+
+void RowData::update_index(size_t first)
+{
+	size_t count = annotations_.size();
+	for (unsigned int level = 0; ; level++) {
+		const size_t block_count = (count + IndexBlockLength - 1) /
+			IndexBlockLength;
+
+		// A new level must be computed in full
+		size_t first_block = first / IndexBlockLength;
+		if (level == max_end_samples_.size()) {
+			max_end_samples_.emplace_back();
+			first_block = 0;
+		}
+
+		vector<uint64_t> &m = max_end_samples_[level];
+		m.resize(block_count);
+
+		for (size_t b = first_block; b < block_count; b++) {
+			const size_t last = min((b + 1) * IndexBlockLength,
+				count);
+			uint64_t end_sample = 0;
+			for (size_t i = b * IndexBlockLength; i < last; i++)
+				end_sample = max(end_sample, (level == 0) ?
+					annotations_[i].end_sample() :
+					max_end_samples_[level - 1][i]);
+			m[b] = end_sample;
+		}
+
+		if (block_count <= IndexBlockLength) {
+			max_end_samples_.resize(level + 1);
+			break;
+		}
+
+		first = first_block;
+		count = block_count;
+	}
+}
+
+void RowData::update_summary(const Annotation &a)
+{
+	for (unsigned int level = 0; level < SummaryLevelCount; level++) {
+		const uint64_t gap = 1ULL << (SummaryBasePower +
+			level * SummaryScalePower);
+		vector<Span> &spans = spans_[level];
+
+		// Find the first span that ends less than a gap before the
+		// annotation. This is usually the last span
+		auto first = spans.end();
+		if (!spans.empty() &&
+			spans.back().end_sample + gap > a.start_sample())
+			first = lower_bound(spans.begin(), spans.end(),
+				a.start_sample(), [gap](const Span &s,
+					uint64_t sample) {
+					return s.end_sample + gap <= sample; });
+
+		// Merge the spans that start less than a gap after it
+		Span merged = {a.start_sample(), a.end_sample(), 1};
+		auto last = first;
+		for (; last != spans.end() &&
+			(*last).start_sample < merged.end_sample + gap; last++) {
+			merged.start_sample = min(merged.start_sample,
+				(*last).start_sample);
+			merged.end_sample = max(merged.end_sample,
+				(*last).end_sample);
+			merged.annotation_count += (*last).annotation_count;
+		}
+
+		if (first == last) {
+			spans.insert(first, merged);
+		} else {
+			*first = merged;
+			spans.erase(first + 1, last);
+		}
+	}
 }
 
 } // decode
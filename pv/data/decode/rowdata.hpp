@@ -29,25 +29,141 @@ namespace pv {
 namespace data {
 namespace decode {
 
+/**
+ * The annotations of a decoder row.
+ *
+ * The annotations are kept sorted by their start sample, and are indexed
+ * by a pyramid of the maximum end sample of each block of annotations, so
+ * that the annotations which overlap a range of samples can be found
+ * without examining every annotation.
+ *
+ * The row also keeps a summary of its annotations at several
+ * resolutions. At each level, the annotations that are separated by less
+ * than the gap of the level are merged into spans of coverage, which
+ * record how many annotations they contain. When the view is zoomed out,
+ * the spans can be drawn in place of the annotations, at a cost that
+ * depends on the width of the view rather than on the number of
+ * annotations.
+ */
 class RowData
 {
+private:
+	/**
+	 * The number of entries summarised by each entry of the index
+	 * level above.
+	 */
+	static const unsigned int IndexBlockLength;
+
+	/**
+	 * The gap between spans at summary level @c n is
+	 * <tt>1 << (SummaryBasePower + n * SummaryScalePower)</tt> samples.
+	 */
+	static const unsigned int SummaryBasePower;
+	static const unsigned int SummaryScalePower;
+	static const unsigned int SummaryLevelCount;
+
+public:
+	/**
+	 * A span of samples covered by annotations.
+	 */
+	struct Span
+	{
+		uint64_t start_sample;
+		uint64_t end_sample;
+
+		/// The number of annotations merged into the span.
+		uint64_t annotation_count;
+	};
+
 public:
 	RowData();
 
 public:
 	uint64_t get_max_sample() const;
 
+	/**
+	 * Gets the number of annotations in the row.
+	 */
+	size_t size() const;
+
+	/**
+	 * Gets all the annotations of the row, sorted by start sample.
+	 */
+	const std::vector<Annotation>& annotations() const;
+
+	/**
+	 * Gets the number of bytes of memory used by the annotation records,
+	 * the index and the summary, excluding the interned texts.
+	 */
+	uint64_t memory_usage() const;
+
 	/**
 	 * Extracts sorted annotations between two period into a vector.
+	 * Annotations are extracted if they end after @c start_sample and
+	 * start no later than @c end_sample. The cost is logarithmic in the
+	 * number of annotations in the row, plus the cost of each annotation
+	 * extracted.
 	 */
 	void get_annotation_subset(
 		std::vector<pv::data::decode::Annotation> &dest,
 		uint64_t start_sample, uint64_t end_sample) const;
 
+	/**
+	 * Adds an annotation to the row. Annotations usually arrive in order
+	 * of their start sample, and are appended at the end. Others are
+	 * inserted at their place, which is usually near the end.
+	 */
 	void push_annotation(const Annotation &a);
 
+	/**
+	 * Extracts the spans of coverage between two samples into a vector,
+	 * from the summary level that merges the most annotations while
+	 * keeping gaps of @c max_gap samples or more.
+	 * @param dest the vector to append the spans to.
+	 * @param start_sample the first sample of the range.
+	 * @param end_sample the last sample of the range.
+	 * @param max_gap the largest gap that may be hidden by merging.
+	 * @return false if even the finest summary level merges annotations
+	 * across gaps larger than @c max_gap , in which case @c dest is left
+	 * unchanged.
+	 */
+	bool get_coverage_spans(std::vector<Span> &dest,
+		uint64_t start_sample, uint64_t end_sample,
+		double max_gap) const;
+
+private:
+	/**
+	 * Recomputes the index from the block that contains an annotation.
+	 */
+	void update_index(size_t first);
+
+	void get_annotation_subset(
+		std::vector<pv::data::decode::Annotation> &dest,
+		unsigned int level, size_t node, uint64_t start_sample,
+		size_t end) const;
+
+	/**
+	 * Merges an annotation into the spans of each summary level.
+	 */
+	void update_summary(const Annotation &a);
+
 private:
 	std::vector<Annotation> annotations_;
+
+	/**
+	 * The index of the annotations. Entry @c b of level 0 is the largest
+	 * end sample of the annotations in block @c b, and each entry of a
+	 * higher level is the largest of a block of entries of the level
+	 * below. The top level has no more than @c IndexBlockLength entries.
+	 */
+	std::vector< std::vector<uint64_t> > max_end_samples_;
+
+	/**
+	 * The spans of each summary level, sorted by start sample. The
+	 * spans of a level never overlap, and are separated by at least the
+	 * gap of the level.
+	 */
+	std::vector< std::vector<Span> > spans_;
 };
 
 }
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cassert>
+
+#include "scheduler.hpp"
+
+using std::chrono::duration;
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+namespace pv {
+namespace data {
+namespace decode {
+
+Scheduler::Slot::Slot(Scheduler &scheduler) :
+	scheduler_(scheduler),
+	samples_(0)
+{
+	scheduler_.acquire();
+	start_ = Clock::now();
+}
+
+Scheduler::Slot::~Slot()
+{
+	scheduler_.release(held_time(), samples_);
+}
+
+void Scheduler::Slot::add_samples(uint64_t samples)
+{
+	samples_ += samples;
+}
+
+Scheduler::Clock::duration Scheduler::Slot::held_time() const
+{
+	return Clock::now() - start_;
+}
+
+Scheduler::Scheduler(unsigned int slot_count) :
+	slot_count_(slot_count),
+	busy_slots_(0),
+	period_start_(Clock::now()),
+	busy_time_(Clock::duration::zero()),
+	samples_decoded_(0)
+{
+	assert(slot_count_ > 0);
+}
+
+unsigned int Scheduler::slot_count() const
+{
+	return slot_count_;
+}
+
+Scheduler::Statistics Scheduler::take_statistics()
+{
+	lock_guard<mutex> lock(mutex_);
+
+	const Clock::time_point now = Clock::now();
+	const double period = duration<double>(now - period_start_).count();
+	const double busy = duration<double>(busy_time_).count();
+
+	Statistics s;
+	s.slot_count = slot_count_;
+	s.busy_slots = busy_slots_;
+	s.utilisation = (period > 0.0) ? busy / (period * slot_count_) : 0.0;
+	s.samples_per_second = (period > 0.0) ?
+		samples_decoded_ / period : 0.0;
+
+	period_start_ = now;
+	busy_time_ = Clock::duration::zero();
+	samples_decoded_ = 0;
+
+	return s;
+}
+
+void Scheduler::acquire()
+{
+	unique_lock<mutex> lock(mutex_);
+	while (busy_slots_ >= slot_count_)
+		slot_cond_.wait(lock);
+	busy_slots_++;
+}
+
+void Scheduler::release(Clock::duration held_time, uint64_t samples)
+{
+	{
+		lock_guard<mutex> lock(mutex_);
+		assert(busy_slots_ > 0);
+		busy_slots_--;
+		busy_time_ += held_time;
+		samples_decoded_ += samples;
+	}
+	slot_cond_.notify_one();
+}
+
+} // decode
+} // data
+} // pv
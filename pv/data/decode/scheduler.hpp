@@ -0,0 +1,136 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef PULSEVIEW_PV_DATA_DECODE_SCHEDULER_HPP
+#define PULSEVIEW_PV_DATA_DECODE_SCHEDULER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <stdint.h>
+
+namespace pv {
+namespace data {
+namespace decode {
+
+/**
+ * Shares a bounded number of decode slots between the decoder stacks.
+ *
+ * Each decoder stack decodes in its own thread, but must hold a slot
+ * while it feeds a chunk of samples to its decoder session. The number of
+ * slots bounds how many sessions run at once. If the decoder library can
+ * not run sessions in several threads at once, there is only one slot.
+ *
+ * The scheduler also measures the time that the slots are held, and the
+ * number of samples decoded, so that the utilisation of the slots and the
+ * throughput of the decoders can be reported.
+ */
+class Scheduler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	 * A slot held for the lifetime of the object.
+	 */
+	class Slot
+	{
+	public:
+		/**
+		 * Waits until a slot is free, and takes it.
+		 */
+		explicit Slot(Scheduler &scheduler);
+
+		/**
+		 * Releases the slot, and accounts for the time it was held.
+		 */
+		~Slot();
+
+		/**
+		 * Counts samples decoded while holding the slot.
+		 */
+		void add_samples(uint64_t samples);
+
+		/**
+		 * Gets the time since the slot was taken.
+		 */
+		Clock::duration held_time() const;
+
+	private:
+		Slot(const Slot&);
+		Slot& operator=(const Slot&);
+
+	private:
+		Scheduler &scheduler_;
+		Clock::time_point start_;
+		uint64_t samples_;
+	};
+
+	struct Statistics
+	{
+		unsigned int slot_count;
+		unsigned int busy_slots;
+
+		/// The fraction of the slot time that was spent decoding during
+		/// the period, from 0 to 1.
+		double utilisation;
+
+		/// The number of samples decoded per second during the period,
+		/// summed over all the decoder stacks.
+		double samples_per_second;
+	};
+
+public:
+	/**
+	 * Constructor.
+	 * @param slot_count The number of sessions that may run at once.
+	 */
+	explicit Scheduler(unsigned int slot_count);
+
+	unsigned int slot_count() const;
+
+	/**
+	 * Gets the statistics of the period since the previous call, and
+	 * begins a new period.
+	 */
+	Statistics take_statistics();
+
+private:
+	void acquire();
+	void release(Clock::duration held_time, uint64_t samples);
+
+private:
+	const unsigned int slot_count_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable slot_cond_;
+	unsigned int busy_slots_;
+
+	Clock::time_point period_start_;
+	Clock::duration busy_time_;
+	uint64_t samples_decoded_;
+};
+
+} // decode
+} // data
+} // pv
+
+#endif // PULSEVIEW_PV_DATA_DECODE_SCHEDULER_HPP
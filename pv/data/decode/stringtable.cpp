@@ -0,0 +1,82 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstring>
+
+#include "stringtable.hpp"
+
+using std::lock_guard;
+using std::mutex;
+using std::string;
+
+namespace pv {
+namespace data {
+namespace decode {
+
+StringTable::StringTable()
+{
+}
+
+const StringTable::StringList& StringTable::intern(
+	const char *const *texts)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	// The key is the texts, each followed by a null character
+	key_.clear();
+	for (const char *const *t = texts; *t; t++)
+		key_.append(*t, std::strlen(*t) + 1);
+
+	const auto iter = lists_.find(key_);
+	if (iter != lists_.end())
+		return (*iter).second;
+
+	StringList &list = lists_[key_];
+	for (const char *const *t = texts; *t; t++)
+		list.push_back(QString::fromUtf8(*t));
+	return list;
+}
+
+size_t StringTable::size() const
+{
+	lock_guard<mutex> lock(mutex_);
+	return lists_.size();
+}
+
+uint64_t StringTable::memory_usage() const
+{
+	lock_guard<mutex> lock(mutex_);
+
+	// Each QString holds a header of about the size of three pointers
+	// before its UTF-16 text
+	uint64_t bytes = lists_.bucket_count() * sizeof(void*);
+	for (const auto &l : lists_) {
+		bytes += sizeof(l) + sizeof(void*) + l.first.capacity() +
+			l.second.capacity() * sizeof(QString);
+		for (const QString &s : l.second)
+			bytes += 3 * sizeof(void*) +
+				(s.size() + 1) * sizeof(QChar);
+	}
+	return bytes;
+}
+
+} // namespace decode
+} // namespace data
+} // namespace pv
@@ -0,0 +1,84 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef PULSEVIEW_PV_DATA_DECODE_STRINGTABLE_HPP
+#define PULSEVIEW_PV_DATA_DECODE_STRINGTABLE_HPP
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+#include <QString>
+
+namespace pv {
+namespace data {
+namespace decode {
+
+/**
+ * A table of the interned texts of annotations.
+ *
+ * Decoders repeat the same few texts many times, so each distinct list
+ * of texts is stored once, and annotations refer to it. The lists are
+ * never moved or removed, so references to them stay valid for the
+ * lifetime of the table, and may be read without locking while other
+ * lists are being added. The table itself may be used from any thread.
+ */
+class StringTable
+{
+public:
+	typedef std::vector<QString> StringList;
+
+public:
+	StringTable();
+
+	/**
+	 * Finds or adds a list of texts.
+	 * @param texts a null-terminated array of UTF-8 strings.
+	 * @return the interned list.
+	 */
+	const StringList& intern(const char *const *texts);
+
+	/**
+	 * Gets the number of distinct lists in the table.
+	 */
+	size_t size() const;
+
+	/**
+	 * Estimates the number of bytes of memory used by the table.
+	 */
+	uint64_t memory_usage() const;
+
+private:
+	mutable std::mutex mutex_;
+	std::unordered_map<std::string, StringList> lists_;
+
+	/// A buffer to build keys in, kept to avoid an allocation for each
+	/// lookup.
+	std::string key_;
+};
+
+} // namespace decode
+} // namespace data
+} // namespace pv
+
+#endif // PULSEVIEW_PV_DATA_DECODE_STRINGTABLE_HPP
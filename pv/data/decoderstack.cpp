@@ -18,9 +18,12 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
  */
 
+#include <libsigrokcxx/libsigrokcxx.hpp>
 #include <libsigrokdecode/libsigrokdecode.h>
 
+#include <functional>
 #include <stdexcept>
+#include <thread>
 
 #include <QDebug>
 
@@ -29,10 +32,14 @@
 #include <pv/data/logic.hpp>
 #include <pv/data/logicsegment.hpp>
 #include <pv/data/decode/decoder.hpp>
+#include <pv/data/decode/feeder.hpp>
+#include <pv/data/decode/idlesplitter.hpp>
+#include <pv/data/decode/resultcache.hpp>
 #include <pv/data/decode/annotation.hpp>
 #include <pv/session.hpp>
 #include <pv/view/logicsignal.hpp>
 
+using std::chrono::duration;
 using std::lock_guard;
 using std::mutex;
 using boost::optional;
@@ -44,7 +51,9 @@ using std::min;
 using std::list;
 using std::map;
 using std::pair;
+using std::set;
 using std::shared_ptr;
+using std::thread;
 using std::vector;
 
 using namespace pv::data::decode;
@@ -52,12 +61,39 @@ using namespace pv::data::decode;
 namespace pv {
 namespace data {
 
+namespace {
+
+/**
+ * Gets the number of decode sessions that may run at once. Since version
+ * 0.5, libsigrokdecode takes the Python GIL whenever it calls into the
+ * interpreter, so sessions may be used from several threads. Older
+ * versions must only be used by one thread at a time.
+ */
+unsigned int decode_slot_count()
+{
+#if SRD_PACKAGE_VERSION_MAJOR > 0 || SRD_PACKAGE_VERSION_MINOR >= 5
+	return max(1U, std::thread::hardware_concurrency());
+#else
+	return 1;
+#endif
+}
+
+} // anonymous namespace
+
 const double DecoderStack::DecodeMargin = 1.0;
 const double DecoderStack::DecodeThreshold = 0.2;
-const int64_t DecoderStack::DecodeChunkLength = 4096;
+const int64_t DecoderStack::MinDecodeChunkLength = 4096;	// bytes
+const int64_t DecoderStack::MaxDecodeChunkLength = 4*1024*1024;	// bytes
+const double DecoderStack::DecodeChunkTime = 0.02;	// seconds
 const unsigned int DecoderStack::DecodeNotifyPeriod = 65536;
+const double DecoderStack::ParallelSplitIdleTime = 0.01;	// seconds
+const int64_t DecoderStack::MinParallelSplitIdleLength = 1024;
+const int64_t DecoderStack::MinParallelRangeLength = 1024*1024;
+const unsigned int DecoderStack::ParallelRangesPerSlot = 2;
 
-mutex DecoderStack::global_decode_mutex_;
+Scheduler DecoderStack::scheduler_(decode_slot_count());
+bool DecoderStack::parallel_decode_enabled_ = false;
+mutex DecoderStack::session_mutex_;
 
 DecoderStack::DecoderStack(pv::Session &session,
 	const srd_decoder *const dec) :
@@ -66,7 +102,11 @@ DecoderStack::DecoderStack(pv::Session &session,
 	samplerate_(0),
 	sample_count_(0),
 	frame_complete_(false),
-	samples_decoded_(0)
+	samples_decoded_(0),
+	decode_time_(Scheduler::Clock::duration::zero()),
+	cache_status_(CacheUnused),
+	strings_(std::make_shared<decode::StringTable>()),
+	chunk_end_(0)
 {
 	connect(&session_, SIGNAL(frame_began()),
 		this, SLOT(on_new_frame()));
@@ -88,6 +128,16 @@ DecoderStack::~DecoderStack()
 	}
 }
 
+void DecoderStack::set_parallel_decode_enabled(bool enabled)
+{
+	parallel_decode_enabled_ = enabled;
+}
+
+bool DecoderStack::parallel_decode_enabled()
+{
+	return parallel_decode_enabled_;
+}
+
 const std::list< std::shared_ptr<decode::Decoder> >&
 DecoderStack::stack() const
 {
@@ -130,6 +180,24 @@ int64_t DecoderStack::samples_decoded() const
 	return samples_decoded_;
 }
 
+DecoderStack::CacheStatus DecoderStack::cache_status() const
+{
+	lock_guard<mutex> lock(output_mutex_);
+	return cache_status_;
+}
+
+double DecoderStack::samples_per_second() const
+{
+	lock_guard<mutex> decode_lock(output_mutex_);
+	const double seconds = duration<double>(decode_time_).count();
+	return (seconds > 0.0) ? samples_decoded_ / seconds : 0.0;
+}
+
+Scheduler& DecoderStack::scheduler()
+{
+	return scheduler_;
+}
+
 std::vector<Row> DecoderStack::get_visible_rows() const
 {
 	lock_guard<mutex> lock(output_mutex_);
@@ -175,6 +243,20 @@ void DecoderStack::get_annotation_subset(
 			start_sample, end_sample);
 }
 
+bool DecoderStack::get_coverage_spans(
+	std::vector<pv::data::decode::RowData::Span> &dest,
+	const Row &row, uint64_t start_sample,
+	uint64_t end_sample, double max_gap) const
+{
+	lock_guard<mutex> lock(output_mutex_);
+
+	const auto iter = rows_.find(row);
+	if (iter == rows_.end())
+		return false;
+	return (*iter).second.get_coverage_spans(dest,
+		start_sample, end_sample, max_gap);
+}
+
 QString DecoderStack::error_message()
 {
 	lock_guard<mutex> lock(output_mutex_);
@@ -182,19 +264,64 @@ QString DecoderStack::error_message()
 }
 
 void DecoderStack::clear()
+{
+	clear(set<const srd_decoder*>());
+	decoded_layers_.clear();
+}
+
+void DecoderStack::clear(const set<const srd_decoder*> &kept_decoders)
 {
 	sample_count_ = 0;
 	frame_complete_ = false;
 	samples_decoded_ = 0;
+	decode_time_ = Scheduler::Clock::duration::zero();
+	cache_status_ = CacheUnused;
 	error_message_ = QString();
-	rows_.clear();
 	class_rows_.clear();
+	decoder_rows_.clear();
+	staged_annotations_.clear();
+
+	// The annotations of kept rows keep the previous table alive
+	strings_ = std::make_shared<decode::StringTable>();
+
+	for (auto i = rows_.begin(); i != rows_.end();)
+		if (kept_decoders.count((*i).first.decoder()))
+			i++;
+		else
+			i = rows_.erase(i);
 }
 
 void DecoderStack::begin_decode()
 {
-	shared_ptr<pv::view::LogicSignal> logic_signal;
-	shared_ptr<pv::data::Logic> data;
+	const shared_ptr<LogicSegment> segment = find_segment();
+
+	// Note the decoders and their configuration
+	vector<DecodedLayer> layers;
+	for (const shared_ptr<decode::Decoder> &dec : stack_) {
+		DecodedLayer l;
+		l.decoder = dec;
+		l.revision = dec->revision();
+		l.sample_count = 0;
+		layers.push_back(l);
+	}
+
+	// Count the layers at the bottom of the stack that are configured as
+	// they were for the previous decode of the same segment. Nothing
+	// needs to be done if no layer has changed
+	size_t kept_layers = 0;
+	if (segment && segment == segment_) {
+		while (kept_layers < min(layers.size(),
+			decoded_layers_.size()) &&
+			layers[kept_layers].decoder ==
+				decoded_layers_[kept_layers].decoder &&
+			layers[kept_layers].revision ==
+				decoded_layers_[kept_layers].revision)
+			kept_layers++;
+
+		if (kept_layers == layers.size() &&
+			layers.size() == decoded_layers_.size())
+			return;
+	}
 
 	if (decode_thread_.joinable()) {
 		interrupt_ = true;
@@ -202,7 +329,27 @@ void DecoderStack::begin_decode()
 		decode_thread_.join();
 	}
 
-	clear();
+	// The rows of the kept layers hold the annotations of the samples
+	// that have been decoded by any decode since they were last changed
+	set<const srd_decoder*> kept_decoders;
+	for (size_t i = 0; i < kept_layers; i++) {
+		layers[i].sample_count = max(decoded_layers_[i].sample_count,
+			samples_decoded_);
+		kept_decoders.insert(layers[i].decoder->decoder());
+	}
+
+	// A decoder of the same type in a changed layer would share the
+	// rows, so they can not be kept
+	for (size_t i = kept_layers; i < layers.size(); i++)
+		if (kept_decoders.erase(layers[i].decoder->decoder()))
+			for (size_t j = 0; j < kept_layers; j++)
+				if (layers[j].decoder->decoder() ==
+					layers[i].decoder->decoder())
+					layers[j].sample_count = 0;
+
+	const bool frame_complete = frame_complete_ && segment == segment_;
+	clear(kept_decoders);
+	decoded_layers_ = layers;
 
 	// Check that all decoders have the required channels
 	for (const shared_ptr<decode::Decoder> &dec : stack_)
@@ -212,6 +359,11 @@ void DecoderStack::begin_decode()
 			return;
 		}
 
+	// Take the configuration of the decoders for the decode thread
+	decoder_configs_.clear();
+	for (const shared_ptr<decode::Decoder> &dec : stack_)
+		decoder_configs_.push_back(dec->config());
+
 	// Add classes
 	for (const shared_ptr<decode::Decoder> &dec : stack_)
 	{
@@ -219,9 +371,10 @@ void DecoderStack::begin_decode()
 		const srd_decoder *const decc = dec->decoder();
 		assert(dec->decoder());
 
-		// Add a row for the decoder if it doesn't have a row list
+		// Add a row for the decoder if it doesn't have a row list.
+		// The rows of kept decoders keep their annotations
 		if (!decc->annotation_rows)
-			rows_[Row(decc)] = decode::RowData();
+			rows_[Row(decc)];
 
 		// Add the decoder rows
 		for (const GSList *l = decc->annotation_rows; l; l = l->next)
@@ -232,8 +385,8 @@ void DecoderStack::begin_decode()
 
 			const Row row(decc, ann_row);
 
-			// Add a new empty row data object
-			rows_[row] = decode::RowData();
+			// Add an empty row data object, unless the row was kept
+			rows_[row];
 
 			// Map out all the classes
 			for (const GSList *ll = ann_row->ann_classes;
@@ -243,6 +396,69 @@ void DecoderStack::begin_decode()
 		}
 	}
 
+	// Cache the row of each class for the decode thread. The row data
+	// objects stay in place until the stack is next cleared
+	for (const DecodedLayer &l : decoded_layers_)
+	{
+		const srd_decoder *const decc = l.decoder->decoder();
+		const auto decoder_row = rows_.find(Row(decc));
+
+		DecoderRows r;
+		r.decoder = decc;
+		r.kept_sample_count = l.sample_count;
+		for (int c = 0; c < (int)g_slist_length(decc->annotations);
+			c++) {
+			const auto class_row = class_rows_.find(
+				make_pair(decc, c));
+			if (class_row != class_rows_.end())
+				r.class_rows.push_back(
+					&rows_[(*class_row).second]);
+			else if (decoder_row != rows_.end())
+				r.class_rows.push_back(&(*decoder_row).second);
+			else
+				r.class_rows.push_back(nullptr);
+		}
+
+		decoder_rows_.push_back(r);
+	}
+
+	if (!segment)
+		return;
+
+	segment_ = segment;
+	feeder_ = Feeder::get(segment_);
+
+	// Get the samplerate and start time
+	start_time_ = segment_->start_time();
+	samplerate_ = segment_->samplerate();
+	if (samplerate_ == 0.0)
+		samplerate_ = 1.0;
+
+	// If decoders have only been removed from the top of the stack,
+	// and the rest had decoded the whole frame, there is nothing left
+	// to decode
+	frame_complete_ = frame_complete;
+	sample_count_ = segment_->get_sample_count();
+	if (frame_complete_ && kept_layers == decoded_layers_.size()) {
+		int64_t kept_sample_count = sample_count_;
+		for (const DecodedLayer &l : decoded_layers_)
+			kept_sample_count = min(kept_sample_count,
+				l.sample_count);
+		if (kept_sample_count == sample_count_) {
+			samples_decoded_ = sample_count_;
+			return;
+		}
+	}
+
+	interrupt_ = false;
+	decode_thread_ = std::thread(&DecoderStack::decode_proc, this);
+}
+
+shared_ptr<LogicSegment> DecoderStack::find_segment() const
+{
+	shared_ptr<pv::view::LogicSignal> logic_signal;
+	shared_ptr<pv::data::Logic> data;
+
 	// We get the logic data of the first channel in the list.
 	// This works because we are currently assuming all
 	// LogicSignals have the same data/segment
@@ -253,23 +469,14 @@ void DecoderStack::begin_decode()
 			break;
 
 	if (!data)
-		return;
+		return nullptr;
 
 	// Check we have a segment of data
 	const deque< shared_ptr<pv::data::LogicSegment> > &segments =
 		data->logic_segments();
 	if (segments.empty())
-		return;
-	segment_ = segments.front();
-
-	// Get the samplerate and start time
-	start_time_ = segment_->start_time();
-	samplerate_ = segment_->samplerate();
-	if (samplerate_ == 0.0)
-		samplerate_ = 1.0;
-
-	interrupt_ = false;
-	decode_thread_ = std::thread(&DecoderStack::decode_proc, this);
+		return nullptr;
+	return segments.front();
 }
 
 uint64_t DecoderStack::max_sample_count() const
@@ -283,6 +490,26 @@ uint64_t DecoderStack::max_sample_count() const
 	return max_sample_count;
 }
 
+uint64_t DecoderStack::annotation_count() const
+{
+	lock_guard<mutex> lock(output_mutex_);
+
+	uint64_t count = 0;
+	for (const auto &r : rows_)
+		count += r.second.size();
+	return count;
+}
+
+uint64_t DecoderStack::annotation_memory_usage() const
+{
+	lock_guard<mutex> lock(output_mutex_);
+
+	uint64_t bytes = strings_->memory_usage();
+	for (const auto &r : rows_)
+		bytes += r.second.memory_usage();
+	return bytes;
+}
+
 optional<int64_t> DecoderStack::wait_for_data() const
 {
 	unique_lock<mutex> input_lock(input_mutex_);
@@ -298,62 +525,148 @@ void DecoderStack::decode_data(
 	const int64_t sample_count, const unsigned int unit_size,
 	srd_session *const session)
 {
-	uint8_t chunk[DecodeChunkLength];
+	int64_t chunk_sample_count = MinDecodeChunkLength / unit_size;
 
-	const unsigned int chunk_sample_count =
-		DecodeChunkLength / segment_->unit_size();
-
-	for (int64_t i = 0; !interrupt_ && i < sample_count;
-		i += chunk_sample_count)
+	// Continue from where the previous call left off
+	int64_t i;
 	{
-		lock_guard<mutex> decode_lock(global_decode_mutex_);
-
-		const int64_t chunk_end = min(
-			i + chunk_sample_count, sample_count);
-		segment_->get_samples(chunk, i, chunk_end);
+		lock_guard<mutex> lock(output_mutex_);
+		i = samples_decoded_;
+	}
+	int64_t notify_sample = i;
+	Scheduler::Clock::duration unpublished_time =
+		Scheduler::Clock::duration::zero();
 
-		if (srd_session_send(session, i, chunk_end, chunk,
-				(chunk_end - i) * unit_size, unit_size) != SRD_OK) {
+	while (!interrupt_ && i < sample_count)
+	{
+		Scheduler::Slot slot(scheduler_);
+
+		// Split the chunks where the annotations of kept rows end, so
+		// that each chunk is either wholly before or after that point
+		chunk_end_ = min(i + chunk_sample_count, sample_count);
+		for (const DecoderRows &r : decoder_rows_)
+			if (i < r.kept_sample_count)
+				chunk_end_ = min(chunk_end_, r.kept_sample_count);
+
+		const int64_t chunk_end = send_chunk(session, *feeder_, i,
+			chunk_end_, 0);
+		if (chunk_end < 0) {
 			error_message_ = tr("Decoder reported an error");
 			break;
 		}
 
-		{
-			lock_guard<mutex> lock(output_mutex_);
-			samples_decoded_ = chunk_end;
-		}
+		slot.add_samples(chunk_end - i);
+		chunk_sample_count = adapt_chunk_length(chunk_sample_count,
+			chunk_end - i, slot.held_time(), unit_size);
+		unpublished_time += slot.held_time();
 
-		if (i % DecodeNotifyPeriod == 0)
+		// Publish the chunk unless a reader holds the output mutex,
+		// in which case it is published with a later chunk
+		if (publish_output(chunk_end, unpublished_time, false))
+			unpublished_time = Scheduler::Clock::duration::zero();
+
+		i = chunk_end;
+		if (i - notify_sample >= DecodeNotifyPeriod) {
+			notify_sample = i;
 			new_decode_data();
+		}
 	}
 
+	publish_output(i, unpublished_time, true);
 	new_decode_data();
 }
 
-void DecoderStack::decode_proc()
+bool DecoderStack::publish_output(int64_t samples_decoded,
+	Scheduler::Clock::duration decode_time, bool wait)
+{
+	unique_lock<mutex> lock(output_mutex_, std::defer_lock);
+	if (wait)
+		lock.lock();
+	else if (!lock.try_lock())
+		return false;
+
+	for (const auto &s : staged_annotations_)
+		s.first->push_annotation(s.second);
+	staged_annotations_.clear();
+
+	samples_decoded_ = samples_decoded;
+	decode_time_ += decode_time;
+
+	return true;
+}
+
+const DecoderStack::DecoderRows* DecoderStack::find_decoder_rows(
+	const srd_decoder *decoder) const
+{
+	for (const DecoderRows &r : decoder_rows_)
+		if (r.decoder == decoder)
+			return &r;
+	return nullptr;
+}
+
+int64_t DecoderStack::send_chunk(srd_session *session,
+	Feeder &feeder, int64_t start, int64_t end, int64_t session_start)
+{
+	const unsigned int unit_size = feeder.unit_size();
+
+	while (start < end) {
+		const shared_ptr<const Feeder::Chunk> chunk =
+			feeder.get_chunk(start);
+		const int64_t send_end = min(end, chunk->end);
+		if (send_end <= start)
+			break;
+
+		if (srd_session_send(session, start - session_start,
+				send_end - session_start,
+				chunk->data + (start - chunk->start) * unit_size,
+				(send_end - start) * unit_size,
+				unit_size) != SRD_OK)
+			return -1;
+
+		start = send_end;
+	}
+
+	return start;
+}
+
+int64_t DecoderStack::adapt_chunk_length(int64_t length, int64_t samples,
+	Scheduler::Clock::duration time, unsigned int unit_size)
+{
+	const double seconds = duration<double>(time).count();
+
+	// Aim for the target time, but change the length by no more than a
+	// factor of two at once, so that a single slow chunk does not
+	// collapse the length
+	const int64_t target = (seconds > 0.0) ?
+		(int64_t)(samples * DecodeChunkTime / seconds) : length * 2;
+	length = min(max(target, length / 2), length * 2);
+
+	return min(max(length, MinDecodeChunkLength / unit_size),
+		MaxDecodeChunkLength / unit_size);
+}
+
+srd_session* DecoderStack::create_session(
+	void (*callback)(srd_proto_data*, void*), void *callback_data)
 {
-	optional<int64_t> sample_count;
 	srd_session *session;
 	srd_decoder_inst *prev_di = nullptr;
 
-	assert(segment_);
+	lock_guard<mutex> lock(session_mutex_);
 
 	// Create the session
 	srd_session_new(&session);
 	assert(session);
 
 	// Create the decoders
-	const unsigned int unit_size = segment_->unit_size();
-
-	for (const shared_ptr<decode::Decoder> &dec : stack_)
+	for (const decode::Decoder::Config &dec : decoder_configs_)
 	{
-		srd_decoder_inst *const di = dec->create_decoder_inst(session);
+		srd_decoder_inst *const di = dec.create_decoder_inst(session);
 
 		if (!di)
 		{
-			error_message_ = tr("Failed to create decoder instance");
+			// The session mutex is already held
 			srd_session_destroy(session);
-			return;
+			return nullptr;
 		}
 
 		if (prev_di)
@@ -362,27 +675,300 @@ void DecoderStack::decode_proc()
 		prev_di = di;
 	}
 
-	// Get the intial sample count
-	{
-		unique_lock<mutex> input_lock(input_mutex_);
-		sample_count = sample_count_ = segment_->get_sample_count();
-	}
-
 	// Start the session
 	srd_session_metadata_set(session, SRD_CONF_SAMPLERATE,
 		g_variant_new_uint64((uint64_t)samplerate_));
 
 	srd_pd_output_callback_add(session, SRD_OUTPUT_ANN,
-		DecoderStack::annotation_callback, this);
+		callback, callback_data);
 
 	srd_session_start(session);
 
+	return session;
+}
+
+void DecoderStack::destroy_session(srd_session *session)
+{
+	lock_guard<mutex> lock(session_mutex_);
+	srd_session_destroy(session);
+}
+
+bool DecoderStack::decode_ranges(int64_t sample_count)
+{
+	if (!parallel_decode_enabled_ || scheduler_.slot_count() < 2)
+		return false;
+
+	// The sessions of the ranges all start afresh, so only a decode
+	// from the start of the frame can be split
+	{
+		lock_guard<mutex> lock(output_mutex_);
+		if (samples_decoded_ != 0)
+			return false;
+	}
+	for (const DecoderRows &r : decoder_rows_)
+		if (r.kept_sample_count != 0)
+			return false;
+
+	const int64_t range_count = min<int64_t>(
+		scheduler_.slot_count() * ParallelRangesPerSlot,
+		sample_count / MinParallelRangeLength);
+	if (range_count < 2)
+		return false;
+
+	// Split the frame where all the decoded channels are idle
+	uint64_t sig_mask = 0;
+	for (const decode::Decoder::Config &dec : decoder_configs_)
+		for (const auto &c : dec.channels)
+			sig_mask |= 1ULL << c.second;
+
+	const int64_t min_idle_length = max(
+		(int64_t)(samplerate_ * ParallelSplitIdleTime),
+		MinParallelSplitIdleLength);
+	const vector<int64_t> points = IdleSplitter::split(*segment_,
+		sig_mask, sample_count, (unsigned int)range_count,
+		min_idle_length);
+	if (points.size() < 3)
+		return false;
+
+	RangeQueue queue;
+	queue.next_range = 0;
+	queue.failed = false;
+	for (size_t i = 1; i < points.size(); i++) {
+		DecodeRange r;
+		r.stack = this;
+		r.start = points[i - 1];
+		r.end = points[i];
+		r.decode_time = Scheduler::Clock::duration::zero();
+		r.done = false;
+		queue.ranges.push_back(std::move(r));
+	}
+
+	qDebug() << "Decoding" << sample_count << "samples in" <<
+		queue.ranges.size() << "ranges in parallel";
+
+	vector<thread> workers;
+	for (size_t i = 0; i < min<size_t>(scheduler_.slot_count(),
+		queue.ranges.size()); i++)
+		workers.push_back(thread(&DecoderStack::range_proc, this,
+			std::ref(queue)));
+
+	// Publish the annotations of the ranges in order, so that the rows
+	// are appended to, and the decoded samples are contiguous
+	for (DecodeRange &r : queue.ranges) {
+		{
+			unique_lock<mutex> lock(queue.mutex);
+			while (!r.done && !interrupt_ && !queue.failed)
+				queue.done_cond.wait(lock);
+			if (!r.done)
+				break;
+		}
+
+		staged_annotations_.swap(r.annotations);
+		publish_output(r.end, r.decode_time, true);
+		new_decode_data();
+		vector< pair<RowData*, Annotation> >().swap(r.annotations);
+	}
+
+	for (thread &t : workers)
+		t.join();
+
+	if (queue.failed)
+		error_message_ = tr("Decoder reported an error");
+
+	return true;
+}
+
+void DecoderStack::range_proc(RangeQueue &queue)
+{
+	while (!interrupt_ && !queue.failed) {
+		const size_t index = queue.next_range++;
+		if (index >= queue.ranges.size())
+			break;
+
+		DecodeRange &r = queue.ranges[index];
+		if (!decode_range(r))
+			queue.failed = true;
+
+		{
+			lock_guard<mutex> lock(queue.mutex);
+			r.done = !queue.failed && !interrupt_;
+		}
+		queue.done_cond.notify_all();
+	}
+
+	// Wake the publishing thread if it waits for a range that will not
+	// be decoded. The mutex is taken so that the wake-up can not slip in
+	// between its check of the flags and its wait
+	{
+		lock_guard<mutex> lock(queue.mutex);
+	}
+	queue.done_cond.notify_all();
+}
+
+bool DecoderStack::decode_range(DecodeRange &range)
+{
+	const unsigned int unit_size = segment_->unit_size();
+	int64_t chunk_sample_count = MinDecodeChunkLength / unit_size;
+
+	srd_session *const session = create_session(
+		DecoderStack::range_annotation_callback, &range);
+	if (!session)
+		return false;
+
+	for (int64_t i = range.start; !interrupt_ && i < range.end;)
+	{
+		Scheduler::Slot slot(scheduler_);
+
+		// The session numbers the samples from the start of the range
+		const int64_t chunk_end = send_chunk(session, *feeder_, i,
+			min(i + chunk_sample_count, range.end), range.start);
+		if (chunk_end < 0) {
+			destroy_session(session);
+			return false;
+		}
+
+		slot.add_samples(chunk_end - i);
+		chunk_sample_count = adapt_chunk_length(chunk_sample_count,
+			chunk_end - i, slot.held_time(), unit_size);
+		range.decode_time += slot.held_time();
+
+		i = chunk_end;
+	}
+
+	destroy_session(session);
+	return true;
+}
+
+void DecoderStack::decode_proc()
+{
+	optional<int64_t> sample_count;
+
+	assert(segment_);
+
+	const unsigned int unit_size = segment_->unit_size();
+
+	srd_session *const session = create_session(
+		DecoderStack::annotation_callback, this);
+	if (!session) {
+		error_message_ = tr("Failed to create decoder instance");
+		return;
+	}
+
+	// Get the intial sample count
+	{
+		unique_lock<mutex> input_lock(input_mutex_);
+		sample_count = sample_count_ = segment_->get_sample_count();
+	}
+
+	// Once the whole frame is available, look for the annotations in the
+	// decode cache before decoding any more of it, and otherwise try to
+	// decode it in parallel
+	QByteArray cache_key;
 	do {
+		bool frame_complete;
+		{
+			lock_guard<mutex> input_lock(input_mutex_);
+			frame_complete = frame_complete_;
+		}
+
+		if (frame_complete && cache_key.isEmpty()) {
+			const int64_t frame_sample_count =
+				segment_->get_sample_count();
+			cache_key = make_cache_key(frame_sample_count);
+			if (cache_key.isEmpty())
+				break;
+			if (load_cached_rows(cache_key, frame_sample_count) ||
+				decode_ranges(frame_sample_count))
+				break;
+		}
+
 		decode_data(*sample_count, unit_size, session);
 	} while (error_message_.isEmpty() && (sample_count = wait_for_data()));
 
+	// Store the annotations of a complete decode in the cache. The rows
+	// are only changed by this thread, so they are read without locking
+	if (!interrupt_ && error_message_.isEmpty() && frame_decoded() &&
+		cache_status() != CacheHit) {
+		if (cache_key.isEmpty())
+			cache_key = make_cache_key(samples_decoded());
+		if (!cache_key.isEmpty() &&
+			!ResultCache::store(cache_key, decoder_configs_, rows_))
+			qDebug() << "Failed to store the annotations in the "
+				"decode cache";
+	}
+
+	if (!interrupt_ && cache_status() != CacheHit) {
+		qDebug() << "Decoded" << samples_decoded() << "samples at" <<
+			samples_per_second() / 1e6 << "MS/s, sharing" <<
+			scheduler_.slot_count() << "decode slots";
+
+		const uint64_t count = annotation_count();
+		const uint64_t bytes = annotation_memory_usage();
+		if (count != 0)
+			qDebug() << "Stored" << count << "annotations in" <<
+				bytes << "bytes," << (double)bytes / count <<
+				"bytes per annotation";
+	}
+
 	// Destroy the session
-	srd_session_destroy(session);
+	destroy_session(session);
+}
+
+QByteArray DecoderStack::make_cache_key(int64_t sample_count) const
+{
+	const QByteArray digest = feeder_->sample_digest(sample_count,
+		interrupt_);
+	if (digest.isEmpty())
+		return QByteArray();
+
+	return ResultCache::key(digest, feeder_->unit_size(), sample_count,
+		samplerate_, decoder_configs_);
+}
+
+bool DecoderStack::load_cached_rows(const QByteArray &key,
+	int64_t sample_count)
+{
+	map<const Row, RowData> rows;
+	if (!ResultCache::load(key, decoder_configs_, rows, strings_)) {
+		qDebug() << "Decode cache miss";
+		lock_guard<mutex> lock(output_mutex_);
+		cache_status_ = CacheMiss;
+		return false;
+	}
+
+	{
+		lock_guard<mutex> lock(output_mutex_);
+
+		// Assign to the rows in place, so that the cache of rows for
+		// the decode thread stays valid
+		for (auto &r : rows_) {
+			const auto iter = rows.find(r.first);
+			r.second = (iter != rows.end()) ?
+				std::move((*iter).second) : RowData();
+		}
+		staged_annotations_.clear();
+		samples_decoded_ = sample_count;
+		cache_status_ = CacheHit;
+	}
+
+	qDebug() << "Decode cache hit: loaded" << annotation_count() <<
+		"annotations";
+	new_decode_data();
+
+	return true;
+}
+
+bool DecoderStack::frame_decoded() const
+{
+	int64_t samples_decoded;
+	{
+		lock_guard<mutex> lock(output_mutex_);
+		samples_decoded = samples_decoded_;
+	}
+
+	lock_guard<mutex> input_lock(input_mutex_);
+	return frame_complete_ &&
+		samples_decoded == (int64_t)segment_->get_sample_count();
 }
 
 void DecoderStack::annotation_callback(srd_proto_data *pdata, void *decoder)
@@ -393,38 +979,69 @@ void DecoderStack::annotation_callback(srd_proto_data *pdata, void *decoder)
 	DecoderStack *const d = (DecoderStack*)decoder;
 	assert(d);
 
-	lock_guard<mutex> lock(d->output_mutex_);
+	assert(pdata->pdo);
+	assert(pdata->pdo->di);
+
+	// Drop the annotations that the rows were kept with
+	const DecoderRows *const rows =
+		d->find_decoder_rows(pdata->pdo->di->decoder);
+	if (rows && d->chunk_end_ <= rows->kept_sample_count)
+		return;
 
-	const Annotation a(pdata);
+	RowData *const row = d->find_annotation_row(pdata);
+	if (!row)
+		return;
 
-	// Find the row
+	// Stage the annotation until the end of the chunk
+	d->staged_annotations_.emplace_back(row,
+		Annotation(pdata, d->strings_));
+}
+
+void DecoderStack::range_annotation_callback(srd_proto_data *pdata,
+	void *range)
+{
+	assert(pdata);
+	assert(range);
+
+	DecodeRange *const r = (DecodeRange*)range;
+	assert(r->stack);
+
+	RowData *const row = r->stack->find_annotation_row(pdata);
+	if (!row)
+		return;
+
+	// Keep the annotation until the range is published, numbering its
+	// samples from the start of the frame
+	const srd_proto_data_annotation *const pda =
+		(const srd_proto_data_annotation*)pdata->data;
+	const shared_ptr<decode::StringTable> &strings = r->stack->strings_;
+	r->annotations.emplace_back(row, Annotation(
+		pdata->start_sample + r->start, pdata->end_sample + r->start,
+		pda->ann_class, strings, strings->intern(pda->ann_text)));
+}
+
+RowData* DecoderStack::find_annotation_row(const srd_proto_data *pdata) const
+{
 	assert(pdata->pdo);
 	assert(pdata->pdo->di);
 	const srd_decoder *const decc = pdata->pdo->di->decoder;
 	assert(decc);
 
-	auto row_iter = d->rows_.end();
+	const DecoderRows *const rows = find_decoder_rows(decc);
+	const int ann_class = ((const srd_proto_data_annotation*)
+		pdata->data)->ann_class;
 
-	// Try looking up the sub-row of this class
-	const auto r = d->class_rows_.find(make_pair(decc, a.format()));
-	if (r != d->class_rows_.end())
-		row_iter = d->rows_.find((*r).second);
-	else
-	{
-		// Failing that, use the decoder as a key
-		row_iter = d->rows_.find(Row(decc));	
-	}
-
-	assert(row_iter != d->rows_.end());
-	if (row_iter == d->rows_.end()) {
+	RowData *const row = (rows && ann_class >= 0 &&
+		ann_class < (int)rows->class_rows.size()) ?
+		rows->class_rows[ann_class] : nullptr;
+	assert(row);
+	if (!row) {
 		qDebug() << "Unexpected annotation: decoder = " << decc <<
-			", format = " << a.format();
+			", format = " << ann_class;
 		assert(0);
-		return;
 	}
 
-	// Add the annotation
-	(*row_iter).second.push_annotation(a);
+	return row;
 }
 
 void DecoderStack::on_new_frame()
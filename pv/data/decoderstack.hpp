@@ -28,15 +28,22 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <thread>
+#include <vector>
 
 #include <boost/optional.hpp>
 
+#include <QByteArray>
 #include <QObject>
 #include <QString>
 
+#include <pv/data/decode/decoder.hpp>
 #include <pv/data/decode/row.hpp>
 #include <pv/data/decode/rowdata.hpp>
+#include <pv/data/decode/scheduler.hpp>
+#include <pv/data/decode/stringtable.hpp>
 #include <pv/util.hpp>
 
 struct srd_decoder;
@@ -46,6 +53,8 @@ struct srd_proto_data;
 struct srd_session;
 
 namespace DecoderStackTest {
+struct DecodeBenchmark;
+struct StackDecode;
 struct TwoDecoderStack;
 }
 
@@ -63,7 +72,7 @@ class LogicSegment;
 
 namespace decode {
 class Annotation;
-class Decoder;
+class Feeder;
 }
 
 class Logic;
@@ -72,11 +81,92 @@ class DecoderStack : public QObject
 {
 	Q_OBJECT
 
+private:
+	/**
+	 * The rows that the annotation classes of a decoder are placed in,
+	 * cached so that the decode thread can find the row of an
+	 * annotation without looking it up in @c class_rows_ and @c rows_ .
+	 */
+	struct DecoderRows
+	{
+		const srd_decoder *decoder;
+
+		/// The number of samples whose annotations the rows of the
+		/// decoder were kept with from a previous decode.
+		int64_t kept_sample_count;
+
+		/// The row of each annotation class, or nullptr if the class
+		/// has no row.
+		std::vector<decode::RowData*> class_rows;
+	};
+
+	/**
+	 * A layer of the stack, as it was configured for a decode.
+	 */
+	struct DecodedLayer
+	{
+		std::shared_ptr<decode::Decoder> decoder;
+		uint64_t revision;
+
+		/// The number of samples whose annotations are in the rows
+		/// of the layer, from this or earlier decodes.
+		int64_t sample_count;
+	};
+
+	/**
+	 * A range of samples decoded in a session of its own, when the
+	 * frame is decoded in parallel.
+	 */
+	struct DecodeRange
+	{
+		DecoderStack *stack;
+		int64_t start, end;
+
+		/// The annotations of the range, which are published once the
+		/// ranges before it have been.
+		std::vector< std::pair<decode::RowData*, decode::Annotation> >
+			annotations;
+
+		decode::Scheduler::Clock::duration decode_time;
+		bool done;
+	};
+
+	/**
+	 * The ranges of a parallel decode, which the worker threads take in
+	 * order.
+	 */
+	struct RangeQueue
+	{
+		std::vector<DecodeRange> ranges;
+		std::atomic<size_t> next_range;
+		std::atomic<bool> failed;
+
+		/// Protects the @c done flags of the ranges.
+		std::mutex mutex;
+		std::condition_variable done_cond;
+	};
+
 private:
 	static const double DecodeMargin;
 	static const double DecodeThreshold;
-	static const int64_t DecodeChunkLength;
+	static const int64_t MinDecodeChunkLength;
+	static const int64_t MaxDecodeChunkLength;
+	static const double DecodeChunkTime;
 	static const unsigned int DecodeNotifyPeriod;
+	static const double ParallelSplitIdleTime;
+	static const int64_t MinParallelSplitIdleLength;
+	static const int64_t MinParallelRangeLength;
+	static const unsigned int ParallelRangesPerSlot;
+
+public:
+	/**
+	 * Whether the annotations were loaded from the decode cache.
+	 */
+	enum CacheStatus {
+		CacheUnused,	///< The cache has not been looked in yet.
+		CacheMiss,	///< The annotations were not in the cache.
+		CacheHit	///< The annotations were loaded from the cache.
+	};
 
 public:
 	DecoderStack(pv::Session &session_,
@@ -84,6 +174,21 @@ public:
 
 	virtual ~DecoderStack();
 
+	/**
+	 * Enables or disables parallel decoding of complete frames.
+	 *
+	 * When enabled, a frame that is complete before its decode begins is
+	 * split at points where all the decoded channels are idle, and the
+	 * ranges are decoded in separate sessions at once. This suits
+	 * protocols whose decoders reset when the bus is idle, such as UART
+	 * or I2C, but decoders that carry state across idle stretches may
+	 * annotate the start of a range differently. This is disabled by
+	 * default, and has no effect if there is only one decode slot.
+	 */
+	static void set_parallel_decode_enabled(bool enabled);
+
+	static bool parallel_decode_enabled();
+
 	const std::list< std::shared_ptr<decode::Decoder> >& stack() const;
 	void push(std::shared_ptr<decode::Decoder> decoder);
 	void remove(int index);
@@ -94,6 +199,21 @@ public:
 
 	int64_t samples_decoded() const;
 
+	/**
+	 * Gets the decode throughput of the stack.
+	 * @return The number of samples decoded per second of the time that
+	 * the stack has held a decode slot.
+	 */
+	double samples_per_second() const;
+
+	CacheStatus cache_status() const;
+
+	/**
+	 * Gets the scheduler that shares the decode slots between all the
+	 * decoder stacks.
+	 */
+	static decode::Scheduler& scheduler();
+
 	std::vector<decode::Row> get_visible_rows() const;
 
 	/**
@@ -104,12 +224,33 @@ public:
 		const decode::Row &row, uint64_t start_sample,
 		uint64_t end_sample) const;
 
+	/**
+	 * Extracts the spans of coverage of a row between two samples into
+	 * a vector.
+	 * @see pv::data::decode::RowData::get_coverage_spans
+	 */
+	bool get_coverage_spans(
+		std::vector<pv::data::decode::RowData::Span> &dest,
+		const decode::Row &row, uint64_t start_sample,
+		uint64_t end_sample, double max_gap) const;
+
 	QString error_message();
 
 	void clear();
 
 	uint64_t max_sample_count() const;
 
+	/**
+	 * Gets the number of annotations in all the rows.
+	 */
+	uint64_t annotation_count() const;
+
+	/**
+	 * Gets the number of bytes of memory used by the annotations,
+	 * including their interned texts.
+	 */
+	uint64_t annotation_memory_usage() const;
+
 	void begin_decode();
 
 private:
@@ -118,11 +259,142 @@ private:
 	void decode_data(const int64_t sample_count,
 		const unsigned int unit_size, srd_session *const session);
 
+	/**
+	 * Publishes the staged annotations to their rows, together with the
+	 * progress of the decode, so that readers see the output of whole
+	 * chunks.
+	 * @param samples_decoded The number of samples decoded so far.
+	 * @param decode_time The decode time since the last publication.
+	 * @param wait If false, nothing is published if a reader holds the
+	 * output mutex, and the annotations stay staged.
+	 * @return true if the output was published.
+	 */
+	bool publish_output(int64_t samples_decoded,
+		decode::Scheduler::Clock::duration decode_time, bool wait);
+
+	/**
+	 * Creates a session with an instance of each decoder of the stack,
+	 * and starts it.
+	 * @param callback The function to pass the annotations to.
+	 * @param callback_data The data to pass to the callback.
+	 * @return The session, or nullptr if a decoder instance could not be
+	 * created.
+	 */
+	srd_session* create_session(
+		void (*callback)(srd_proto_data*, void*), void *callback_data);
+
+	/**
+	 * Destroys a session made by create_session.
+	 */
+	static void destroy_session(srd_session *session);
+
+	/**
+	 * Decodes a complete frame in parallel, if it is enabled and the
+	 * frame can be split at idle points.
+	 * @param sample_count The number of samples of the frame.
+	 * @return true if the frame was decoded in parallel, false if it
+	 * must be decoded in one session.
+	 */
+	bool decode_ranges(int64_t sample_count);
+
+	/**
+	 * Decodes ranges taken from a queue until it is empty.
+	 */
+	void range_proc(RangeQueue &queue);
+
+	/**
+	 * Decodes a range of samples in a session of its own. The session
+	 * numbers the samples from the start of the range, and the callback
+	 * numbers the annotations from the start of the frame again.
+	 * @return false if the decoder reported an error.
+	 */
+	bool decode_range(DecodeRange &range);
+
+	/**
+	 * Computes the key of a decode of the first samples of the segment
+	 * in the decode cache.
+	 * @param sample_count The number of samples of the decode.
+	 * @return The key, or an empty array if the decode was interrupted
+	 * while the samples were hashed.
+	 */
+	QByteArray make_cache_key(int64_t sample_count) const;
+
+	/**
+	 * Replaces the rows with the rows of a decode in the cache.
+	 * @param key The key of the decode.
+	 * @param sample_count The number of samples of the decode.
+	 * @return true if the decode was found in the cache.
+	 */
+	bool load_cached_rows(const QByteArray &key, int64_t sample_count);
+
+	/**
+	 * Gets whether the whole frame has been decoded.
+	 */
+	bool frame_decoded() const;
+
+	/**
+	 * Finds the cached rows of a decoder.
+	 * @return the rows, or nullptr if the decoder is not in the stack.
+	 */
+	const DecoderRows* find_decoder_rows(
+		const srd_decoder *decoder) const;
+
+	/**
+	 * Finds the row that an annotation is placed in.
+	 * @return the row, or nullptr if the annotation has no row.
+	 */
+	decode::RowData* find_annotation_row(
+		const srd_proto_data *pdata) const;
+
+	/**
+	 * Finds the segment that the decoders take their samples from.
+	 */
+	std::shared_ptr<LogicSegment> find_segment() const;
+
+	/**
+	 * Clears the stack, but keeps the rows of some decoders.
+	 * @param kept_decoders The decoders whose rows are kept.
+	 */
+	void clear(const std::set<const srd_decoder*> &kept_decoders);
+
+	/**
+	 * Sends a chunk of samples to a decoder session. The samples are
+	 * taken from the chunks of the feeder, which are shared with the
+	 * other decoder stacks on the segment.
+	 * @param session The session to send the samples to.
+	 * @param feeder The feeder of the segment to take the samples from.
+	 * @param start The index of the first sample to send.
+	 * @param end The index after the last sample to send.
+	 * @param session_start The index of the sample that the session
+	 * numbers 0, which is where the session began decoding.
+	 * @return The index after the last sample sent, which may be less
+	 * than @c end, or -1 if the decoder reported an error.
+	 */
+	static int64_t send_chunk(srd_session *session,
+		decode::Feeder &feeder, int64_t start, int64_t end,
+		int64_t session_start);
+
+	/**
+	 * Adapts the length of the decode chunks to the decode rate, so
+	 * that each chunk takes about @c DecodeChunkTime to decode.
+	 * @param length The current chunk length in samples.
+	 * @param samples The number of samples in the last chunk.
+	 * @param time The time taken to decode the last chunk.
+	 * @param unit_size The unit size of the samples.
+	 * @return The new chunk length in samples.
+	 */
+	static int64_t adapt_chunk_length(int64_t length, int64_t samples,
+		decode::Scheduler::Clock::duration time,
+		unsigned int unit_size);
+
 	void decode_proc();
 
 	static void annotation_callback(srd_proto_data *pdata,
 		void *decoder);
 
+	static void range_annotation_callback(srd_proto_data *pdata,
+		void *range);
+
 private Q_SLOTS:
 	void on_new_frame();
 
@@ -139,17 +411,20 @@ private:
 	pv::util::Timestamp start_time_;
 	double samplerate_;
 
+	static decode::Scheduler scheduler_;
+	static bool parallel_decode_enabled_;
+
 	/**
-	 * This mutex prevents more than one decode operation occuring
-	 * concurrently.
-	 * @todo A proper solution should be implemented to allow multiple
-	 * decode operations.
+	 * libsigrokdecode keeps its sessions in a global list without
+	 * locking it, so sessions are created and destroyed by one thread
+	 * at a time.
 	 */
-	static std::mutex global_decode_mutex_;
+	static std::mutex session_mutex_;
 
 	std::list< std::shared_ptr<decode::Decoder> > stack_;
 
 	std::shared_ptr<pv::data::LogicSegment> segment_;
+	std::shared_ptr<decode::Feeder> feeder_;
 
 	mutable std::mutex input_mutex_;
 	mutable std::condition_variable input_cond_;
@@ -158,16 +433,45 @@ private:
 
 	mutable std::mutex output_mutex_;
 	int64_t	samples_decoded_;
+	decode::Scheduler::Clock::duration decode_time_;
+	CacheStatus cache_status_;
 
 	std::map<const decode::Row, decode::RowData> rows_;
 
 	std::map<std::pair<const srd_decoder*, int>, decode::Row> class_rows_;
 
+	/// The texts of the annotations of the current decode. Each decode
+	/// starts a new table, and the annotations keep theirs alive, so a
+	/// table is freed with the last row or copy that refers to it.
+	std::shared_ptr<decode::StringTable> strings_;
+
+	/// The configuration of each decoder in the stack, taken when the
+	/// decode began. The decode thread uses it in place of the decoders,
+	/// which may be changed while it runs.
+	std::vector<decode::Decoder::Config> decoder_configs_;
+
+	/// The rows of each decoder in the stack, set up with @c rows_ .
+	std::vector<DecoderRows> decoder_rows_;
+
+	/// The layers of the stack as they were configured for the last
+	/// decode.
+	std::vector<DecodedLayer> decoded_layers_;
+
+	/// The end of the chunk that the decode thread is sending.
+	int64_t chunk_end_;
+
+	/// The annotations received by the decode thread since the last
+	/// publication. Only the decode thread uses them.
+	std::vector< std::pair<decode::RowData*, decode::Annotation> >
+		staged_annotations_;
+
 	QString error_message_;
 
 	std::thread decode_thread_;
 	std::atomic<bool> interrupt_;
 
+	friend struct DecoderStackTest::DecodeBenchmark;
+	friend struct DecoderStackTest::StackDecode;
 	friend struct DecoderStackTest::TwoDecoderStack;
 };
 
@@ -23,43 +23,362 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <cmath>
 
 #include "logicsegment.hpp"
 
 #include <libsigrokcxx/libsigrokcxx.hpp>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENABLE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 using std::lock_guard;
+using std::lower_bound;
+using std::mutex;
 using std::recursive_mutex;
 using std::max;
 using std::min;
 using std::pair;
 using std::shared_ptr;
+using std::unique_lock;
+using std::upper_bound;
+using std::vector;
 
 using sigrok::Logic;
 
 namespace pv {
 namespace data {
 
-const int LogicSegment::MipMapScalePower = 4;
-const int LogicSegment::MipMapScaleFactor = 1 << MipMapScalePower;
-const float LogicSegment::LogMipMapScaleFactor = logf(MipMapScaleFactor);
+const unsigned int LogicSegment::MinMipMapScalePower = 4;
+const unsigned int LogicSegment::MaxMipMapScalePower = 8;
 const uint64_t LogicSegment::MipMapDataUnit = 64*1024;	// bytes
+const uint64_t LogicSegment::MipMapBatchLength = 64*1024;	// level 0 samples
 
-LogicSegment::LogicSegment(shared_ptr<Logic> logic, uint64_t samplerate,
-                             const uint64_t expected_num_samples) :
-	Segment(samplerate, logic->unit_size()),
-	last_append_sample_(0)
+const uint64_t LogicSegment::CompressionProbeLength = 64*1024;	// samples
+const unsigned int LogicSegment::MinCompressionRatio = 4;
+const uint64_t LogicSegment::ExpansionBatchLength = 1024*1024;	// samples
+
+const uint64_t LogicSegment::TransitionIndexProbeLength = 64*1024;	// samples
+const unsigned int LogicSegment::MinTransitionSpacing = 256;	// samples
+
+bool LogicSegment::compression_enabled_ = false;
+unsigned int LogicSegment::default_mipmap_scale_power_ = 4;
+
+namespace {
+
+/**
+ * Reads a sample of any unit size, without reading beyond its last byte.
+ */
+uint64_t read_sample(const uint8_t *ptr, unsigned int unit_size)
 {
-	set_capacity(expected_num_samples);
+	uint64_t value = 0;
+	for (unsigned int i = 0; i < unit_size; i++)
+		value |= (uint64_t)ptr[i] << (i * 8);
+	return value;
+}
 
-	lock_guard<recursive_mutex> lock(mutex_);
+/**
+ * Gets the index of the lowest set bit of a non-zero word.
+ */
+unsigned int lowest_set_bit(uint64_t x)
+{
+	assert(x);
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#else
+	unsigned int bit = 0;
+	for (; !(x & 1); x >>= 1)
+		bit++;
+	return bit;
+#endif
+}
+
+/**
+ * Fills a buffer with copies of one sample.
+ */
+void fill_samples(uint8_t *dest, uint64_t value, uint64_t count,
+	unsigned int unit_size)
+{
+	if (count == 0)
+		return;
+
+	for (unsigned int i = 0; i < unit_size; i++)
+		dest[i] = value >> (i * 8);
+
+	// Double the filled region with each copy
+	const uint64_t length = count * unit_size;
+	for (uint64_t filled = unit_size; filled < length; filled *= 2)
+		memcpy(dest + filled, dest, min(filled, length - filled));
+}
+
+template<unsigned int UnitSize>
+uint64_t load_sample(const uint8_t *ptr)
+{
+	uint64_t value = 0;
+	memcpy(&value, ptr, UnitSize);
+	return value;
+}
+
+/**
+ * ORs together the samples packed into a little-endian word, leaving the
+ * result in the lowest sample of the word.
+ */
+template<unsigned int UnitSize>
+uint64_t fold_samples(uint64_t word)
+{
+	if (UnitSize < 8)
+		word |= word >> 32;
+	if (UnitSize < 4)
+		word |= word >> 16;
+	if (UnitSize < 2)
+		word |= word >> 8;
+	return word;
+}
+
+template<unsigned int UnitSize>
+void mipmap_kernel_scalar(const uint8_t *src, uint8_t *dest,
+	uint64_t block_count, unsigned int block_length, uint64_t &last_sample)
+{
+	uint64_t last = last_sample;
+
+	for (uint64_t b = 0; b < block_count; b++, dest += UnitSize)
+	{
+		// Accumulate transitions which have occurred in this block
+		uint64_t accumulator = 0;
+		for (unsigned int i = 0; i < block_length; i++, src += UnitSize)
+		{
+			const uint64_t sample = load_sample<UnitSize>(src);
+			accumulator |= last ^ sample;
+			last = sample;
+		}
+
+		memcpy(dest, &accumulator, UnitSize);
+	}
+
+	last_sample = last;
+}
+
+// The vector kernels compare each 16-byte vector of samples with the same
+// vector shifted back by one sample. The first block is processed by the
+// scalar kernel, because the sample preceding it may not be adjacent in
+// memory.
+
+#if defined(__SSE2__)
+template<unsigned int UnitSize>
+void mipmap_kernel_sse2(const uint8_t *src, uint8_t *dest,
+	uint64_t block_count, unsigned int block_length, uint64_t &last_sample)
+{
+	if (block_count == 0)
+		return;
+
+	mipmap_kernel_scalar<UnitSize>(src, dest, 1, block_length, last_sample);
+	src += block_length * UnitSize;
+	dest += UnitSize;
+
+	const unsigned int block_bytes = block_length * UnitSize;
+	for (uint64_t b = 1; b < block_count; b++, dest += UnitSize)
+	{
+		__m128i acc = _mm_setzero_si128();
+		for (unsigned int i = 0; i < block_bytes; i += 16, src += 16)
+		{
+			const __m128i cur = _mm_loadu_si128((const __m128i*)src);
+			const __m128i prev = _mm_loadu_si128(
+				(const __m128i*)(src - UnitSize));
+			acc = _mm_or_si128(acc, _mm_xor_si128(cur, prev));
+		}
+
+		acc = _mm_or_si128(acc, _mm_srli_si128(acc, 8));
+
+		uint64_t word;
+		_mm_storel_epi64((__m128i*)&word, acc);
+		word = fold_samples<UnitSize>(word);
+		memcpy(dest, &word, UnitSize);
+	}
+
+	last_sample = load_sample<UnitSize>(src - UnitSize);
+}
+#endif
+
+#if defined(ENABLE_AVX2_KERNELS)
+template<unsigned int UnitSize>
+__attribute__((target("avx2")))
+void mipmap_kernel_avx2(const uint8_t *src, uint8_t *dest,
+	uint64_t block_count, unsigned int block_length, uint64_t &last_sample)
+{
+	if (block_count == 0)
+		return;
+
+	mipmap_kernel_scalar<UnitSize>(src, dest, 1, block_length, last_sample);
+	src += block_length * UnitSize;
+	dest += UnitSize;
+
+	const unsigned int block_bytes = block_length * UnitSize;
+	uint64_t b = 1;
+
+	if (block_bytes == 16) {
+		// Each 128-bit lane holds one block, so two blocks are
+		// processed at a time
+		for (; b + 2 <= block_count; b += 2, src += 32)
+		{
+			const __m256i cur = _mm256_loadu_si256((const __m256i*)src);
+			const __m256i prev = _mm256_loadu_si256(
+				(const __m256i*)(src - UnitSize));
+			__m256i acc = _mm256_xor_si256(cur, prev);
+			acc = _mm256_or_si256(acc, _mm256_srli_si256(acc, 8));
+
+			uint64_t word;
+			_mm_storel_epi64((__m128i*)&word,
+				_mm256_castsi256_si128(acc));
+			word = fold_samples<UnitSize>(word);
+			memcpy(dest, &word, UnitSize);
+			dest += UnitSize;
+
+			_mm_storel_epi64((__m128i*)&word,
+				_mm256_extracti128_si256(acc, 1));
+			word = fold_samples<UnitSize>(word);
+			memcpy(dest, &word, UnitSize);
+			dest += UnitSize;
+		}
+
+		// Process any odd block that remains
+		if (b < block_count) {
+			last_sample = load_sample<UnitSize>(src - UnitSize);
+			mipmap_kernel_scalar<UnitSize>(src, dest, 1,
+				block_length, last_sample);
+			return;
+		}
+	} else {
+		for (; b < block_count; b++, dest += UnitSize)
+		{
+			__m256i acc = _mm256_setzero_si256();
+			for (unsigned int i = 0; i < block_bytes;
+				i += 32, src += 32)
+			{
+				const __m256i cur = _mm256_loadu_si256(
+					(const __m256i*)src);
+				const __m256i prev = _mm256_loadu_si256(
+					(const __m256i*)(src - UnitSize));
+				acc = _mm256_or_si256(acc,
+					_mm256_xor_si256(cur, prev));
+			}
+
+			__m128i acc128 = _mm_or_si128(
+				_mm256_castsi256_si128(acc),
+				_mm256_extracti128_si256(acc, 1));
+			acc128 = _mm_or_si128(acc128, _mm_srli_si128(acc128, 8));
+
+			uint64_t word;
+			_mm_storel_epi64((__m128i*)&word, acc128);
+			word = fold_samples<UnitSize>(word);
+			memcpy(dest, &word, UnitSize);
+		}
+	}
+
+	last_sample = load_sample<UnitSize>(src - UnitSize);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+template<unsigned int UnitSize>
+void mipmap_kernel_neon(const uint8_t *src, uint8_t *dest,
+	uint64_t block_count, unsigned int block_length, uint64_t &last_sample)
+{
+	if (block_count == 0)
+		return;
+
+	mipmap_kernel_scalar<UnitSize>(src, dest, 1, block_length, last_sample);
+	src += block_length * UnitSize;
+	dest += UnitSize;
+
+	const unsigned int block_bytes = block_length * UnitSize;
+	for (uint64_t b = 1; b < block_count; b++, dest += UnitSize)
+	{
+		uint8x16_t acc = vdupq_n_u8(0);
+		for (unsigned int i = 0; i < block_bytes; i += 16, src += 16)
+		{
+			const uint8x16_t cur = vld1q_u8(src);
+			const uint8x16_t prev = vld1q_u8(src - UnitSize);
+			acc = vorrq_u8(acc, veorq_u8(cur, prev));
+		}
+
+		const uint64x2_t acc64 = vreinterpretq_u64_u8(acc);
+		uint64_t word = vgetq_lane_u64(acc64, 0) |
+			vgetq_lane_u64(acc64, 1);
+		word = fold_samples<UnitSize>(word);
+		memcpy(dest, &word, UnitSize);
+	}
+
+	last_sample = load_sample<UnitSize>(src - UnitSize);
+}
+#endif
+
+} // anonymous namespace
+
+void LogicSegment::set_compression_enabled(bool enabled)
+{
+	compression_enabled_ = enabled;
+}
+
+bool LogicSegment::compression_enabled()
+{
+	return compression_enabled_;
+}
+
+void LogicSegment::set_default_mipmap_scale_power(unsigned int power)
+{
+	assert(power >= MinMipMapScalePower && power <= MaxMipMapScalePower);
+	default_mipmap_scale_power_ = min(max(power, MinMipMapScalePower),
+		MaxMipMapScalePower);
+}
+
+unsigned int LogicSegment::default_mipmap_scale_power()
+{
+	return default_mipmap_scale_power_;
+}
+
+LogicSegment::LogicSegment(shared_ptr<Logic> logic, uint64_t samplerate) :
+	Segment(samplerate, logic->unit_size()),
+	compressed_(compression_enabled_),
+	window_start_sample_(0),
+	window_start_run_(0),
+	expanding_(false),
+	expanded_samples_(0),
+	mipmap_scale_power_(default_mipmap_scale_power_),
+	mipmap_scale_factor_(1 << mipmap_scale_power_),
+	log_mipmap_scale_factor_(logf(mipmap_scale_factor_)),
+	scale_step_count_(MipMapCoverageBits / mipmap_scale_power_),
+	last_append_sample_(0),
+	mipmap_kernel_(mipmap_kernel(logic->unit_size(),
+		fastest_mipmap_kernel_set())),
+	indexed_channels_(unit_size_ >= 8 ? ~0ULL :
+		(1ULL << (unit_size_ * 8)) - 1),
+	last_index_sample_(0),
+	mipmap_sample_count_(0),
+	mipmap_input_samples_(0),
+	mipmap_interrupt_(false)
+{
 	memset(mip_map_, 0, sizeof(mip_map_));
+	transitions_.resize(unit_size_ * 8);
 	append_payload(logic);
+
+	mipmap_thread_ = std::thread(&LogicSegment::mipmap_proc, this);
 }
 
 LogicSegment::~LogicSegment()
 {
+	stop_mipmap_thread();
+
 	lock_guard<recursive_mutex> lock(mutex_);
 	for (MipMapLevel &l : mip_map_)
 		free(l.data);
@@ -146,11 +465,45 @@ void LogicSegment::append_payload(shared_ptr<Logic> logic)
 
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	append_data(logic->data_pointer(),
-		logic->data_length() / unit_size_);
+	const uint8_t *const data = (const uint8_t*)logic->data_pointer();
+	const uint64_t samples = logic->data_length() / unit_size_;
+
+	if (compressed_) {
+		append_payload_to_runs(data, samples);
+
+		// Fall back to raw samples if the latest window of samples is
+		// too busy to compress well. Each run takes two 64-bit words.
+		// Only the window is measured, so that a busy signal is noticed
+		// however long the segment has compressed well
+		const uint64_t window_length = sample_count_ -
+			window_start_sample_;
+		if (!expanding_ && window_length >= CompressionProbeLength) {
+			if ((run_starts_.size() - window_start_run_) * 2 *
+				sizeof(uint64_t) * MinCompressionRatio >
+				window_length * unit_size_) {
+				{
+					lock_guard<mutex> input_lock(
+						mipmap_input_mutex_);
+					expanding_ = true;
+				}
+				mipmap_input_cond_.notify_one();
+			} else {
+				window_start_sample_ = sample_count_;
+				window_start_run_ = run_starts_.size();
+			}
+		}
+
+		return;
+	}
+
+	append_data(data, samples);
 
-	// Generate the first mip-map from the data
-	append_payload_to_mipmap();
+	// Hand the new samples over to the mip-map worker
+	{
+		lock_guard<mutex> input_lock(mipmap_input_mutex_);
+		mipmap_input_samples_ = sample_count_;
+	}
+	mipmap_input_cond_.notify_one();
 }
 
 void LogicSegment::get_samples(uint8_t *const data,
@@ -165,8 +518,108 @@ void LogicSegment::get_samples(uint8_t *const data,
 
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	const size_t size = (end_sample - start_sample) * unit_size_;
-	memcpy(data, (const uint8_t*)data_.data() + start_sample * unit_size_, size);
+	if (compressed_)
+		get_run_samples(data, start_sample, end_sample - start_sample);
+	else
+		get_raw_samples(data, start_sample, end_sample - start_sample);
+}
+
+const uint8_t* LogicSegment::get_contiguous_samples(uint64_t start,
+	uint64_t end, uint64_t &count) const
+{
+	assert(start < end);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(end <= sample_count_);
+
+	if (compressed_) {
+		count = 0;
+		return nullptr;
+	}
+
+	count = min(end - start, contiguous_samples(start));
+	return get_raw_sample(start);
+}
+
+uint64_t LogicSegment::get_mipmap_sample_count() const
+{
+	return mipmap_sample_count_;
+}
+
+bool LogicSegment::is_compressed() const
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+	return compressed_;
+}
+
+uint64_t LogicSegment::memory_usage() const
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	uint64_t bytes = Segment::memory_usage() +
+		(run_starts_.capacity() + run_values_.capacity()) *
+		sizeof(uint64_t);
+
+	for (uint64_t level_bytes : mipmap_memory_usage())
+		bytes += level_bytes;
+
+	lock_guard<mutex> mipmap_lock(mipmap_mutex_);
+	for (const vector<uint64_t> &t : transitions_)
+		bytes += t.capacity() * sizeof(uint64_t);
+
+	return bytes;
+}
+
+vector<uint64_t> LogicSegment::mipmap_memory_usage() const
+{
+	vector<uint64_t> usage;
+
+	lock_guard<mutex> mipmap_lock(mipmap_mutex_);
+	for (unsigned int level = 0; level < scale_step_count_ &&
+		mip_map_[level].data; level++)
+		usage.push_back(mip_map_[level].data_length * unit_size_ +
+			sizeof(uint64_t));
+
+	return usage;
+}
+
+boost::optional<uint64_t> LogicSegment::get_edge_count(uint64_t start,
+	uint64_t end, int sig_index) const
+{
+	assert(start <= end);
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(end < sample_count_);
+
+	const uint64_t sig_mask = 1ULL << sig_index;
+
+	if (compressed_) {
+		// Count the runs in which the signal changes state
+		uint64_t count = 0;
+		uint64_t run = find_run(start);
+		bool last_sample = (run_values_[run] & sig_mask) != 0;
+		for (run++; run < run_starts_.size() &&
+			run_starts_[run] <= end; run++) {
+			const bool sample = (run_values_[run] & sig_mask) != 0;
+			if (sample != last_sample)
+				count++;
+			last_sample = sample;
+		}
+		return count;
+	}
+
+	lock_guard<mutex> mipmap_lock(mipmap_mutex_);
+
+	if (!(indexed_channels_ & sig_mask) || end >= mipmap_sample_count_)
+		return boost::none;
+
+	const vector<uint64_t> &t = transitions_[sig_index];
+	return (uint64_t)(upper_bound(t.begin(), t.end(), end) -
+		upper_bound(t.begin(), t.end(), start));
 }
 
 void LogicSegment::reallocate_mipmap_level(MipMapLevel &m)
@@ -183,7 +636,7 @@ void LogicSegment::reallocate_mipmap_level(MipMapLevel &m)
 	}
 }
 
-void LogicSegment::append_payload_to_mipmap()
+void LogicSegment::append_payload_to_mipmap(uint64_t sample_count)
 {
 	MipMapLevel &m0 = mip_map_[0];
 	uint64_t prev_length;
@@ -192,76 +645,407 @@ void LogicSegment::append_payload_to_mipmap()
 	uint64_t accumulator;
 	unsigned int diff_counter;
 
-	// Expand the data buffer to fit the new samples
-	prev_length = m0.length;
-	m0.length = sample_count_ / MipMapScaleFactor;
+	const uint64_t end_block = sample_count / mipmap_scale_factor_;
 
-	// Break off if there are no new samples to compute
-	if (m0.length == prev_length)
-		return;
+	while (!mipmap_interrupt_ && m0.length < end_block)
+	{
+		// Find the samples of the next batch. Mip-map blocks never
+		// straddle data chunks, so each batch is one contiguous run of
+		// samples. The chunks themselves never move, but the chunk
+		// list may be reallocated by append_data()
+		const uint64_t start_sample = m0.length * mipmap_scale_factor_;
+		uint64_t block_count;
+		{
+			lock_guard<recursive_mutex> lock(mutex_);
+			src_ptr = get_raw_sample(start_sample);
+			block_count = min(end_block - m0.length,
+				contiguous_samples(start_sample) / mipmap_scale_factor_);
+		}
+		block_count = min(block_count, MipMapBatchLength);
 
-	reallocate_mipmap_level(m0);
+		const uint8_t *const batch_src = src_ptr;
 
-	dest_ptr = (uint8_t*)m0.data + prev_length * unit_size_;
+		lock_guard<mutex> mipmap_lock(mipmap_mutex_);
 
-	// Iterate through the samples to populate the first level mipmap
-	const uint8_t *const end_src_ptr = (uint8_t*)data_.data() +
-		m0.length * unit_size_ * MipMapScaleFactor;
-	for (src_ptr = (uint8_t*)data_.data() +
-		prev_length * unit_size_ * MipMapScaleFactor;
-		src_ptr < end_src_ptr;)
-	{
-		// Accumulate transitions which have occurred in this sample
-		accumulator = 0;
-		diff_counter = MipMapScaleFactor;
-		while (diff_counter-- > 0)
+		// Expand the data buffer to fit the new samples
+		prev_length = m0.length;
+		m0.length += block_count;
+		reallocate_mipmap_level(m0);
+
+		dest_ptr = (uint8_t*)m0.data + prev_length * unit_size_;
+
+		// Iterate through the samples to populate the first level mipmap
+		if (mipmap_kernel_) {
+			mipmap_kernel_(src_ptr, dest_ptr, block_count,
+				mipmap_scale_factor_, last_append_sample_);
+		} else {
+			const uint8_t *const end_src_ptr = src_ptr +
+				block_count * mipmap_scale_factor_ * unit_size_;
+			while (src_ptr < end_src_ptr)
+			{
+				// Accumulate transitions which have occurred in
+				// this sample
+				accumulator = 0;
+				diff_counter = mipmap_scale_factor_;
+				while (diff_counter-- > 0)
+				{
+					const uint64_t sample =
+						unpack_sample(src_ptr);
+					accumulator |= last_append_sample_ ^ sample;
+					last_append_sample_ = sample;
+					src_ptr += unit_size_;
+				}
+
+				pack_sample(dest_ptr, accumulator);
+				dest_ptr += unit_size_;
+			}
+		}
+
+		index_transitions(batch_src, prev_length, block_count);
+
+		// Compute higher level mipmaps
+		for (unsigned int level = 1; level < scale_step_count_; level++)
 		{
-			const uint64_t sample = unpack_sample(src_ptr);
-			accumulator |= last_append_sample_ ^ sample;
-			last_append_sample_ = sample;
-			src_ptr += unit_size_;
+			MipMapLevel &m = mip_map_[level];
+			const MipMapLevel &ml = mip_map_[level-1];
+
+			// Expand the data buffer to fit the new samples
+			prev_length = m.length;
+			m.length = ml.length / mipmap_scale_factor_;
+
+			// Break off if there are no more samples to computed
+			if (m.length == prev_length)
+				break;
+
+			reallocate_mipmap_level(m);
+
+			// Subsample the level lower level
+			src_ptr = (uint8_t*)ml.data +
+				unit_size_ * prev_length * mipmap_scale_factor_;
+			const uint8_t *const end_dest_ptr =
+				(uint8_t*)m.data + unit_size_ * m.length;
+			for (dest_ptr = (uint8_t*)m.data +
+				unit_size_ * prev_length;
+				dest_ptr < end_dest_ptr;
+				dest_ptr += unit_size_)
+			{
+				accumulator = 0;
+				diff_counter = mipmap_scale_factor_;
+				while (diff_counter-- > 0)
+				{
+					accumulator |=
+						unpack_sample(src_ptr);
+					src_ptr += unit_size_;
+				}
+
+				pack_sample(dest_ptr, accumulator);
+			}
 		}
 
-		pack_sample(dest_ptr, accumulator);
-		dest_ptr += unit_size_;
+		// Publish the new watermark
+		mipmap_sample_count_ = m0.length * mipmap_scale_factor_;
 	}
+}
 
-	// Compute higher level mipmaps
-	for (unsigned int level = 1; level < ScaleStepCount; level++)
+void LogicSegment::index_transitions(const uint8_t *src,
+	uint64_t first_block, uint64_t block_count)
+{
+	const uint8_t *const m0_data = (const uint8_t*)mip_map_[0].data;
+	const uint64_t end_block = first_block + block_count;
+	const uint64_t probe_blocks =
+		TransitionIndexProbeLength / mipmap_scale_factor_;
+	uint64_t index = first_block * mipmap_scale_factor_;
+
+	// There is no transition into the first sample
+	if (index == 0)
+		last_index_sample_ = unpack_sample(src) &
+			indexed_channels_;
+
+	for (uint64_t block = first_block; block < end_block &&
+		indexed_channels_;
+		block++, src += mipmap_scale_factor_ * unit_size_,
+		index += mipmap_scale_factor_)
 	{
-		MipMapLevel &m = mip_map_[level];
-		const MipMapLevel &ml = mip_map_[level-1];
+		// The level 0 mip-map tells which channels change in this
+		// block. Blocks without changes can be skipped
+		if (unpack_sample(m0_data + block * unit_size_) &
+			indexed_channels_) {
+			const uint8_t *ptr = src;
+			for (unsigned int i = 0; i < mipmap_scale_factor_;
+				i++, ptr += unit_size_)
+			{
+				const uint64_t sample =
+					unpack_sample(ptr) &
+					indexed_channels_;
+				for (uint64_t diff = sample ^ last_index_sample_;
+					diff; diff &= diff - 1)
+					transitions_[lowest_set_bit(diff)].push_back(
+						index + i);
+				last_index_sample_ = sample;
+			}
+		}
 
-		// Expand the data buffer to fit the new samples
-		prev_length = m.length;
-		m.length = ml.length / MipMapScaleFactor;
+		// Periodically drop the index of channels which change too
+		// often for it to be worth its memory. The mip-map remains
+		// for those
+		if ((block + 1) % probe_blocks == 0)
+			drop_dense_channels(index + mipmap_scale_factor_);
+	}
+}
 
-		// Break off if there are no more samples to computed
-		if (m.length == prev_length)
-			break;
+void LogicSegment::drop_dense_channels(uint64_t sample_count)
+{
+	for (unsigned int channel = 0; channel < transitions_.size();
+		channel++) {
+		vector<uint64_t> &t = transitions_[channel];
+		if ((indexed_channels_ & (1ULL << channel)) &&
+			t.size() * MinTransitionSpacing > sample_count) {
+			indexed_channels_ &= ~(1ULL << channel);
+			vector<uint64_t>().swap(t);
+		}
+	}
 
-		reallocate_mipmap_level(m);
-
-		// Subsample the level lower level
-		src_ptr = (uint8_t*)ml.data +
-			unit_size_ * prev_length * MipMapScaleFactor;
-		const uint8_t *const end_dest_ptr =
-			(uint8_t*)m.data + unit_size_ * m.length;
-		for (dest_ptr = (uint8_t*)m.data +
-			unit_size_ * prev_length;
-			dest_ptr < end_dest_ptr;
-			dest_ptr += unit_size_)
+	last_index_sample_ &= indexed_channels_;
+}
+
+void LogicSegment::mipmap_proc()
+{
+	uint64_t sample_count;
+
+	while (!mipmap_interrupt_)
+	{
+		// Convert poorly compressed samples to raw samples first
+		if (expanding_) {
+			expand_runs();
+			continue;
+		}
+
+		// Wait until there is at least one new level 0 block to
+		// compute
 		{
-			accumulator = 0;
-			diff_counter = MipMapScaleFactor;
-			while (diff_counter-- > 0)
-			{
-				accumulator |= unpack_sample(src_ptr);
-				src_ptr += unit_size_;
+			unique_lock<mutex> input_lock(mipmap_input_mutex_);
+			while (!mipmap_interrupt_ && !expanding_ &&
+				mipmap_input_samples_ / mipmap_scale_factor_ <=
+				mipmap_sample_count_ / mipmap_scale_factor_)
+				mipmap_input_cond_.wait(input_lock);
+			sample_count = mipmap_input_samples_;
+		}
+
+		append_payload_to_mipmap(sample_count);
+	}
+}
+
+void LogicSegment::append_payload_to_runs(const uint8_t *data,
+	uint64_t samples)
+{
+	const unsigned int unit_size = unit_size_;
+	const unsigned int word_samples = sizeof(uint64_t) / unit_size;
+
+	if (samples == 0)
+		return;
+
+	// The first sample either continues the last run, or starts a new one
+	const uint64_t first_value = read_sample(data, unit_size);
+	if (run_values_.empty() || run_values_.back() != first_value) {
+		run_starts_.push_back(sample_count_);
+		run_values_.push_back(first_value);
+	}
+
+	const uint8_t *ptr = data + unit_size;
+	const uint8_t *const end_ptr = data + samples * unit_size;
+	uint64_t index = sample_count_ + 1;
+
+	while (ptr < end_ptr)
+	{
+		// If a word of bytes equals the word one sample earlier, all
+		// the samples in it equal the preceding sample, and can be
+		// skipped at once
+		if (word_samples && ptr + sizeof(uint64_t) <= end_ptr) {
+			uint64_t word, prev_word;
+			memcpy(&word, ptr, sizeof(uint64_t));
+			memcpy(&prev_word, ptr - unit_size, sizeof(uint64_t));
+			if (word == prev_word) {
+				ptr += word_samples * unit_size;
+				index += word_samples;
+				continue;
 			}
+		}
 
-			pack_sample(dest_ptr, accumulator);
+		if (memcmp(ptr, ptr - unit_size, unit_size) != 0) {
+			run_starts_.push_back(index);
+			run_values_.push_back(read_sample(ptr, unit_size));
 		}
+
+		ptr += unit_size;
+		index++;
+	}
+
+	sample_count_ += samples;
+}
+
+void LogicSegment::expand_runs()
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(compressed_);
+
+	// Fill the chunks behind the runs, which stay in use meanwhile
+	const uint64_t end = min(sample_count_,
+		expanded_samples_ + ExpansionBatchLength);
+	for (uint64_t run = find_run(expanded_samples_);
+		expanded_samples_ < end; run++) {
+		const uint64_t run_end = min(end, (run + 1 < run_starts_.size()) ?
+			run_starts_[run + 1] : sample_count_);
+		while (expanded_samples_ < run_end) {
+			uint64_t available;
+			uint8_t *const ptr = get_append_pointer(expanded_samples_,
+				available);
+			const uint64_t count = min(available,
+				run_end - expanded_samples_);
+			fill_samples(ptr, run_values_[run], count, unit_size_);
+			expanded_samples_ += count;
+		}
+	}
+
+	if (expanded_samples_ < sample_count_)
+		return;
+
+	// Switch to the raw samples, and hand them over to the mip-map
+	// worker
+	compressed_ = false;
+	expanding_ = false;
+	vector<uint64_t>().swap(run_starts_);
+	vector<uint64_t>().swap(run_values_);
+
+	lock_guard<mutex> input_lock(mipmap_input_mutex_);
+	mipmap_input_samples_ = sample_count_;
+}
+
+uint64_t LogicSegment::find_run(uint64_t index, uint64_t first_run) const
+{
+	assert(first_run < run_starts_.size());
+	assert(run_starts_[first_run] <= index);
+
+	return upper_bound(run_starts_.begin() + first_run,
+		run_starts_.end(), index) - run_starts_.begin() - 1;
+}
+
+void LogicSegment::get_run_samples(uint8_t *dest, uint64_t start,
+	uint64_t count) const
+{
+	if (count == 0)
+		return;
+
+	const uint64_t end = start + count;
+	for (uint64_t run = find_run(start), index = start; index < end; run++)
+	{
+		const uint64_t run_end = min(end, (run + 1 < run_starts_.size()) ?
+			run_starts_[run + 1] : sample_count_);
+		fill_samples(dest, run_values_[run], run_end - index,
+			unit_size_);
+		dest += (run_end - index) * unit_size_;
+		index = run_end;
+	}
+}
+
+void LogicSegment::get_run_edges(
+	std::vector< std::vector<EdgePair> > &edges,
+	uint64_t start, uint64_t end,
+	float min_length, uint64_t sig_mask) const
+{
+	const uint64_t block_length = (uint64_t)max(min_length, 1.0f);
+	const uint64_t run_count = run_starts_.size();
+
+	// The edge found last for each signal, and the end of its
+	// quantization block
+	uint64_t edge_index[64], final_index[64];
+
+	// Store the initial state
+	uint64_t run = find_run(start);
+	uint64_t last_bits = run_values_[run] & sig_mask;
+	for (uint64_t m = sig_mask; m; m &= m - 1) {
+		const int sig_index = lowest_set_bit(m);
+		edges[sig_index].push_back(pair<int64_t, bool>(start,
+			(last_bits >> sig_index) & 1));
+	}
+
+	// Each signal either searches for its next edge, or waits for the
+	// end of the quantization block of its last edge, which gives the
+	// state after the edge
+	uint64_t searching = sig_mask, pending = 0;
+	uint64_t prev_value = run_values_[run];
+
+	for (run++; run < run_count && run_starts_[run] <= end &&
+		(searching | pending); run++)
+	{
+		const uint64_t run_start = run_starts_[run];
+		const uint64_t value = run_values_[run];
+
+		// Store the edges whose quantization blocks end before this run
+		for (uint64_t m = pending; m; m &= m - 1) {
+			const int sig_index = lowest_set_bit(m);
+			const uint64_t bit = 1ULL << sig_index;
+			if (final_index[sig_index] > run_start)
+				continue;
+
+			last_bits = (last_bits & ~bit) | (prev_value & bit);
+			edges[sig_index].push_back(pair<int64_t, bool>(
+				edge_index[sig_index], (prev_value & bit) != 0));
+			pending &= ~bit;
+			searching |= bit;
+		}
+
+		// Find the signals which change in this run
+		for (uint64_t m = (value ^ last_bits) & searching; m;
+			m &= m - 1) {
+			const int sig_index = lowest_set_bit(m);
+			const uint64_t bit = 1ULL << sig_index;
+			searching &= ~bit;
+			if (run_start + block_length > end)
+				continue;
+
+			edge_index[sig_index] = run_start;
+			final_index[sig_index] = run_start + block_length;
+			pending |= bit;
+		}
+
+		prev_value = value;
+	}
+
+	// Store the edges whose quantization blocks end in the last run
+	for (uint64_t m = pending; m; m &= m - 1) {
+		const int sig_index = lowest_set_bit(m);
+		const uint64_t bit = 1ULL << sig_index;
+		const uint64_t value =
+			run_values_[find_run(final_index[sig_index] - 1)];
+		last_bits = (last_bits & ~bit) | (value & bit);
+		edges[sig_index].push_back(pair<int64_t, bool>(
+			edge_index[sig_index], (value & bit) != 0));
+	}
+
+	// Add the final state
+	const uint64_t end_value = run_values_[find_run(end)];
+	for (uint64_t m = sig_mask; m; m &= m - 1) {
+		const int sig_index = lowest_set_bit(m);
+		const bool last_sample = (last_bits >> sig_index) & 1;
+		const bool end_sample = (end_value >> sig_index) & 1;
+		if (last_sample != end_sample)
+			edges[sig_index].push_back(
+				pair<int64_t, bool>(end, end_sample));
+		edges[sig_index].push_back(
+			pair<int64_t, bool>(end + 1, end_sample));
+	}
+}
+
+void LogicSegment::stop_mipmap_thread()
+{
+	if (mipmap_thread_.joinable()) {
+		{
+			lock_guard<mutex> input_lock(mipmap_input_mutex_);
+			mipmap_interrupt_ = true;
+		}
+		mipmap_input_cond_.notify_one();
+		mipmap_thread_.join();
 	}
 }
 
@@ -269,7 +1053,7 @@ uint64_t LogicSegment::get_sample(uint64_t index) const
 {
 	assert(index < sample_count_);
 
-	return unpack_sample((uint8_t*)data_.data() + index * unit_size_);
+	return unpack_sample(get_raw_sample(index));
 }
 
 void LogicSegment::get_subsampled_edges(
@@ -277,168 +1061,359 @@ void LogicSegment::get_subsampled_edges(
 	uint64_t start, uint64_t end,
 	float min_length, int sig_index)
 {
-	uint64_t index = start;
-	unsigned int level;
-	bool last_sample;
-	bool fast_forward;
+	assert(sig_index >= 0);
+	assert(sig_index < 64);
+
+	vector< vector<EdgePair> > signal_edges(sig_index + 1);
+	signal_edges[sig_index].swap(edges);
+	get_subsampled_edges(signal_edges, start, end, min_length,
+		1ULL << sig_index);
+	edges.swap(signal_edges[sig_index]);
+}
 
+void LogicSegment::get_subsampled_edges(
+	std::vector< std::vector<EdgePair> > &edges,
+	uint64_t start, uint64_t end,
+	float min_length, uint64_t sig_mask)
+{
 	assert(end <= get_sample_count());
 	assert(start <= end);
 	assert(min_length > 0);
-	assert(sig_index >= 0);
-	assert(sig_index < 64);
+
+	if (!sig_mask)
+		return;
+
+	// Make room for the highest signal
+	unsigned int sig_count = 0;
+	for (uint64_t m = sig_mask; m; m >>= 1)
+		sig_count++;
+	if (edges.size() < sig_count)
+		edges.resize(sig_count);
 
 	lock_guard<recursive_mutex> lock(mutex_);
 
+	// Run-length encoded samples are searched in one pass over the runs
+	if (compressed_) {
+		get_run_edges(edges, start, end, min_length, sig_mask);
+		return;
+	}
+
+	lock_guard<mutex> mipmap_lock(mipmap_mutex_);
+
+	// The mip-map may lag behind the samples. Beyond the watermark the
+	// search examines the raw samples instead
+	const uint64_t mipmap_end = mipmap_sample_count_;
+
+	// Channels are searched with their transition index if it covers
+	// the range, and through the mip-map otherwise
+	const uint64_t indexed = (end < mipmap_end) ?
+		(sig_mask & indexed_channels_) : 0;
+
+	for (uint64_t m = indexed; m; m &= m - 1) {
+		const int sig_index = lowest_set_bit(m);
+		get_indexed_edges(edges[sig_index], start, end,
+			min_length, sig_index);
+	}
+
+	// The other channels are searched together in one walk of the
+	// mip-map
+	if (sig_mask & ~indexed)
+		get_mipmap_edges(edges, start, end, min_length,
+			sig_mask & ~indexed);
+}
+
+void LogicSegment::get_mipmap_edges(
+	std::vector< std::vector<EdgePair> > &edges,
+	uint64_t start, uint64_t end,
+	float min_length, uint64_t sig_mask) const
+{
 	const uint64_t block_length = (uint64_t)max(min_length, 1.0f);
-	const unsigned int min_level = max((int)floorf(logf(min_length) /
-		LogMipMapScaleFactor) - 1, 0);
-	const uint64_t sig_mask = 1ULL << sig_index;
+	const unsigned int min_level = min(max((int)floorf(logf(min_length) /
+		log_mipmap_scale_factor_) - 1, 0), (int)scale_step_count_ - 1);
+
+	// If resolution is less than a mip-map block, edges are quantized
+	// to the mip-map blocks of this level of detail
+	const unsigned int quantum_power = (min_length >= mipmap_scale_factor_) ?
+		(min_level + 1) * mipmap_scale_power_ : 0;
+
+	// Edges can only be stored if their quantization blocks end in
+	// the range
+	const uint64_t search_end = (end >= block_length) ?
+		end - block_length + 1 : 0;
+
+	// The edge found last for each signal, the end of its quantization
+	// block, and the sample at which the signal resumes its search
+	uint64_t edge_index[64], final_index[64], resume_index[64];
 
 	// Store the initial state
-	last_sample = (get_sample(start) & sig_mask) != 0;
-	edges.push_back(pair<int64_t, bool>(index++, last_sample));
+	uint64_t last_bits = get_sample(start) & sig_mask;
+	for (uint64_t m = sig_mask; m; m &= m - 1) {
+		const int sig_index = lowest_set_bit(m);
+		edges[sig_index].push_back(pair<int64_t, bool>(start,
+			(last_bits >> sig_index) & 1));
+	}
 
-	while (index + block_length <= end)
+	// Each signal either searches for its next edge, or waits for the
+	// end of the quantization block of its last edge. All the searching
+	// signals are searched together, and stop the search at the first
+	// block where any of them changes
+	uint64_t index = pow2_ceil(start + 1, quantum_power);
+	uint64_t searching = 0, waiting = sig_mask, stored = 0;
+	uint64_t next_resume = index;
+	for (uint64_t m = sig_mask; m; m &= m - 1)
+		resume_index[lowest_set_bit(m)] = index;
+
+	while (searching | waiting)
 	{
-		//----- Continue to search -----//
-		level = min_level;
+		// Store the edges whose quantization blocks have ended, and
+		// resume the search of those signals. After a quantization
+		// block the signal may already differ from the last state
+		if (index >= next_resume) {
+			uint64_t sample = 0;
+			bool sample_valid = false;
+			next_resume = UINT64_MAX;
+			for (uint64_t m = waiting; m; m &= m - 1) {
+				const int sig_index = lowest_set_bit(m);
+				const uint64_t bit = 1ULL << sig_index;
+				if (resume_index[sig_index] > index) {
+					next_resume = min(next_resume,
+						resume_index[sig_index]);
+					continue;
+				}
 
-		// We cannot fast-forward if there is no mip-map data at
-		// at the minimum level.
-		fast_forward = (mip_map_[level].data != nullptr);
+				waiting &= ~bit;
+				if (stored & bit) {
+					const uint64_t final_sample =
+						get_sample(
+						final_index[sig_index] - 1) & bit;
+					last_bits = (last_bits & ~bit) | final_sample;
+					edges[sig_index].push_back(pair<int64_t, bool>(
+						edge_index[sig_index], final_sample != 0));
+					stored &= ~bit;
+				}
 
-		if (min_length < MipMapScaleFactor)
-		{
-			// Search individual samples up to the beginning of
-			// the next first level mip map block
-			const uint64_t final_index = min(end,
-				pow2_ceil(index, MipMapScalePower));
-
-			for (; index < final_index &&
-				(index & ~(~0 << MipMapScalePower)) != 0;
-				index++)
-			{
-				const bool sample =
-					(get_sample(index) & sig_mask) != 0;
+				if (index >= search_end)
+					continue;
 
-				// If there was a change we cannot fast forward
-				if (sample != last_sample) {
-					fast_forward = false;
-					break;
+				if (!sample_valid) {
+					sample = get_sample(index);
+					sample_valid = true;
 				}
+
+				if ((sample ^ last_bits) & bit) {
+					edge_index[sig_index] = index;
+					final_index[sig_index] = index + block_length;
+					resume_index[sig_index] = pow2_ceil(
+						final_index[sig_index], quantum_power);
+					next_resume = min(next_resume,
+						resume_index[sig_index]);
+					waiting |= bit;
+					stored |= bit;
+				} else
+					searching |= bit;
 			}
 		}
-		else
-		{
-			// If resolution is less than a mip map block,
-			// round up to the beginning of the mip-map block
-			// for this level of detail
-			const int min_level_scale_power =
-				(level + 1) * MipMapScalePower;
-			index = pow2_ceil(index, min_level_scale_power);
-			if (index >= end)
+
+		if (index >= search_end)
+			break;
+
+		if (!searching) {
+			index = next_resume;
+			continue;
+		}
+
+		// Find the next block where any of the searching signals
+		// changes, up to the next signal that resumes its search
+		const uint64_t limit = min(next_resume, search_end);
+		uint64_t changes = 0;
+		const uint64_t edge = find_mipmap_change(index, limit,
+			searching, min_level, quantum_power, changes);
+		if (edge >= limit) {
+			index = limit;
+			continue;
+		}
+
+		for (uint64_t m = changes; m; m &= m - 1) {
+			const int sig_index = lowest_set_bit(m);
+			const uint64_t bit = 1ULL << sig_index;
+			edge_index[sig_index] = edge;
+			final_index[sig_index] = edge + block_length;
+			resume_index[sig_index] = pow2_ceil(
+				final_index[sig_index], quantum_power);
+			next_resume = min(next_resume, resume_index[sig_index]);
+			searching &= ~bit;
+			waiting |= bit;
+			stored |= bit;
+		}
+
+		index = edge + (1ULL << quantum_power);
+	}
+
+	// Store the edges whose quantization blocks end after the search
+	for (uint64_t m = stored; m; m &= m - 1) {
+		const int sig_index = lowest_set_bit(m);
+		const uint64_t bit = 1ULL << sig_index;
+		const uint64_t final_sample = get_sample(
+			final_index[sig_index] - 1) & bit;
+		last_bits = (last_bits & ~bit) | final_sample;
+		edges[sig_index].push_back(pair<int64_t, bool>(
+			edge_index[sig_index], final_sample != 0));
+	}
+
+	// Add the final state
+	const uint64_t end_value = get_sample(end);
+	for (uint64_t m = sig_mask; m; m &= m - 1) {
+		const int sig_index = lowest_set_bit(m);
+		const bool last_sample = (last_bits >> sig_index) & 1;
+		const bool end_sample = (end_value >> sig_index) & 1;
+		if (last_sample != end_sample)
+			edges[sig_index].push_back(
+				pair<int64_t, bool>(end, end_sample));
+		edges[sig_index].push_back(
+			pair<int64_t, bool>(end + 1, end_sample));
+	}
+}
+
+uint64_t LogicSegment::find_mipmap_change(uint64_t index, uint64_t limit,
+	uint64_t sig_mask, unsigned int min_level, unsigned int quantum_power,
+	uint64_t &changes) const
+{
+	const int top_level = (int)scale_step_count_ - 1;
+	const uint64_t quantum = 1ULL << quantum_power;
+
+	// Without quantization the search zooms in from the first level of
+	// the mip-map to the individual samples
+	const int base_level = quantum_power ? (int)min_level : 0;
+	int max_level = top_level;
+
+	while (index < limit)
+	{
+		// Find the highest level mip-map block that begins here.
+		// Blocks which have not been built yet cannot be used
+		int level = base_level - 1;
+		for (int l = base_level; l <= max_level; l++) {
+			const int level_scale_power = (l + 1) * mipmap_scale_power_;
+			if ((index & ((1ULL << level_scale_power) - 1)) ||
+				!mip_map_[l].data ||
+				(index >> level_scale_power) >= mip_map_[l].length)
 				break;
+			level = l;
+		}
 
-			// We can fast forward only if there was no change
-			const bool sample =
-				(get_sample(index) & sig_mask) != 0;
-			if (last_sample != sample)
-				fast_forward = false;
-		}
-
-		if (fast_forward) {
-
-			// Fast forward: This involves zooming out to higher
-			// levels of the mip map searching for changes, then
-			// zooming in on them to find the point where the edge
-			// begins.
-
-			// Slide right and zoom out at the beginnings of mip-map
-			// blocks until we encounter a change
-			while (1) {
-				const int level_scale_power =
-					(level + 1) * MipMapScalePower;
-				const uint64_t offset =
-					index >> level_scale_power;
-
-				// Check if we reached the last block at this
-				// level, or if there was a change in this block
-				if (offset >= mip_map_[level].length ||
-					(get_subsample(level, offset) &
-						sig_mask))
-					break;
+		if (level >= base_level) {
+			const int level_scale_power =
+				(level + 1) * mipmap_scale_power_;
+			const uint64_t word = get_subsample(level,
+				index >> level_scale_power) & sig_mask;
+
+			// Slide right past blocks without changes, and zoom in on
+			// blocks with changes
+			if (!word) {
+				index += 1ULL << level_scale_power;
+				max_level = top_level;
+			} else if (quantum_power && level == base_level) {
+				changes = word;
+				return index;
+			} else
+				max_level = level - 1;
+			continue;
+		}
 
-				if ((offset & ~(~0 << MipMapScalePower)) == 0) {
-					// If we are now at the beginning of a
-					// higher level mip-map block ascend one
-					// level
-					if (level + 1 >= ScaleStepCount ||
-						!mip_map_[level + 1].data)
-						break;
-
-					level++;
-				} else {
-					// Slide right to the beginning of the
-					// next mip map block
-					index = pow2_ceil(index + 1,
-						level_scale_power);
-				}
+		// Search the individual samples up to the next mip-map block,
+		// or to the end of the samples if the mip-map does not cover
+		// them yet. A change quantizes to the block it falls in, which
+		// may begin before the limit, and gathers the changes of the
+		// whole block
+		uint64_t end_index = min(pow2_ceil(limit, quantum_power),
+			sample_count_);
+		if (!quantum_power && mip_map_[0].data &&
+			(index >> mipmap_scale_power_) < mip_map_[0].length)
+			end_index = min(end_index,
+				pow2_ceil(index + 1, mipmap_scale_power_));
+
+		uint64_t last = get_sample(index - 1), word = 0;
+		while (index < end_index && !word) {
+			const uint8_t *ptr = get_raw_sample(index);
+			const uint64_t span_end = min(end_index,
+				index + contiguous_samples(index));
+			for (; index < span_end; index++, ptr += unit_size_) {
+				const uint64_t sample = unpack_sample(ptr);
+				word = (last ^ sample) & sig_mask;
+				last = sample;
+				if (word)
+					break;
 			}
+		}
 
-			// Zoom in, and slide right until we encounter a change,
-			// and repeat until we reach min_level
-			while (1) {
-				assert(mip_map_[level].data);
-
-				const int level_scale_power =
-					(level + 1) * MipMapScalePower;
-				const uint64_t offset =
-					index >> level_scale_power;
-
-				// Check if we reached the last block at this
-				// level, or if there was a change in this block
-				if (offset >= mip_map_[level].length ||
-					(get_subsample(level, offset) &
-						sig_mask)) {
-					// Zoom in unless we reached the minimum
-					// zoom
-					if (level == min_level)
-						break;
-
-					level--;
-				} else {
-					// Slide right to the beginning of the
-					// next mip map block
-					index = pow2_ceil(index + 1,
-						level_scale_power);
-				}
+		if (word) {
+			const uint64_t block_start = index & ~(quantum - 1);
+			const uint64_t block_end = min(block_start + quantum,
+				sample_count_);
+			for (index++; index < block_end; index++) {
+				const uint64_t sample = get_sample(index);
+				word |= (last ^ sample) & sig_mask;
+				last = sample;
 			}
 
-			// If individual samples within the limit of resolution,
-			// do a linear search for the next transition within the
-			// block
-			if (min_length < MipMapScaleFactor) {
-				for (; index < end; index++) {
-					const bool sample = (get_sample(index) &
-						sig_mask) != 0;
-					if (sample != last_sample)
-						break;
-				}
-			}
+			changes = word;
+			return block_start;
+		}
+
+		max_level = top_level;
+	}
+
+	return limit;
+}
+
+void LogicSegment::get_indexed_edges(std::vector<EdgePair> &edges,
+	uint64_t start, uint64_t end,
+	float min_length, int sig_index) const
+{
+	const uint64_t block_length = (uint64_t)max(min_length, 1.0f);
+	const unsigned int min_level = min(max((int)floorf(logf(min_length) /
+		log_mipmap_scale_factor_) - 1, 0), (int)scale_step_count_ - 1);
+	const int min_level_scale_power = (min_level + 1) * mipmap_scale_power_;
+	const uint64_t sig_mask = 1ULL << sig_index;
+	const vector<uint64_t> &t = transitions_[sig_index];
+
+	// Store the initial state
+	bool last_sample = (get_sample(start) & sig_mask) != 0;
+	edges.push_back(pair<int64_t, bool>(start, last_sample));
+
+	uint64_t index = start + 1;
+	vector<uint64_t>::const_iterator i = t.begin();
+	while (index + block_length <= end)
+	{
+		// If resolution is less than a mip map block, edges are
+		// quantized to the mip-map blocks of this level of detail, as
+		// they are by the mip-map search
+		if (min_length >= mipmap_scale_factor_) {
+			index = pow2_ceil(index, min_level_scale_power);
+			if (index >= end)
+				break;
 		}
 
-		//----- Store the edge -----//
+		// Find the next transition. After a quantization block the
+		// signal may already differ from the last state
+		uint64_t edge_index = index;
+		if (((get_sample(index) & sig_mask) != 0) ==
+			last_sample) {
+			i = lower_bound(i, t.end(), index);
+			if (i == t.end())
+				break;
+			edge_index = *i;
+			if (min_length >= mipmap_scale_factor_)
+				edge_index &= ~((1ULL << min_level_scale_power) - 1);
+		}
 
-		// Take the last sample of the quanization block
-		const int64_t final_index = index + block_length;
-		if (index + block_length > end)
+		if (edge_index + block_length > end)
 			break;
 
-		// Store the final state
+		// Store the final state of the quantization block
+		const uint64_t final_index = edge_index + block_length;
 		const bool final_sample =
 			(get_sample(final_index - 1) & sig_mask) != 0;
-		edges.push_back(pair<int64_t, bool>(index, final_sample));
+		edges.push_back(pair<int64_t, bool>(edge_index, final_sample));
 
 		index = final_index;
 		last_sample = final_sample;
@@ -461,9 +1436,80 @@ uint64_t LogicSegment::get_subsample(int level, uint64_t offset) const
 
 uint64_t LogicSegment::pow2_ceil(uint64_t x, unsigned int power)
 {
-	const uint64_t p = 1 << power;
+	const uint64_t p = 1ULL << power;
 	return (x + p - 1) / p * p;
 }
 
+LogicSegment::MipMapKernelSet LogicSegment::fastest_mipmap_kernel_set()
+{
+#if defined(ENABLE_AVX2_KERNELS)
+	if (__builtin_cpu_supports("avx2"))
+		return AVX2Kernels;
+#endif
+
+#if defined(__SSE2__)
+	return SSE2Kernels;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	return NEONKernels;
+#else
+	return ScalarKernels;
+#endif
+}
+
+LogicSegment::MipMapKernel LogicSegment::mipmap_kernel(
+	unsigned int unit_size, MipMapKernelSet set)
+{
+	switch (set) {
+	case ScalarKernels:
+		switch (unit_size) {
+		case 1: return mipmap_kernel_scalar<1>;
+		case 2: return mipmap_kernel_scalar<2>;
+		case 4: return mipmap_kernel_scalar<4>;
+		case 8: return mipmap_kernel_scalar<8>;
+		}
+		break;
+
+#if defined(__SSE2__)
+	case SSE2Kernels:
+		switch (unit_size) {
+		case 1: return mipmap_kernel_sse2<1>;
+		case 2: return mipmap_kernel_sse2<2>;
+		case 4: return mipmap_kernel_sse2<4>;
+		case 8: return mipmap_kernel_sse2<8>;
+		}
+		break;
+#endif
+
+#if defined(ENABLE_AVX2_KERNELS)
+	case AVX2Kernels:
+		if (!__builtin_cpu_supports("avx2"))
+			break;
+		switch (unit_size) {
+		case 1: return mipmap_kernel_avx2<1>;
+		case 2: return mipmap_kernel_avx2<2>;
+		case 4: return mipmap_kernel_avx2<4>;
+		case 8: return mipmap_kernel_avx2<8>;
+		}
+		break;
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	case NEONKernels:
+		switch (unit_size) {
+		case 1: return mipmap_kernel_neon<1>;
+		case 2: return mipmap_kernel_neon<2>;
+		case 4: return mipmap_kernel_neon<4>;
+		case 8: return mipmap_kernel_neon<8>;
+		}
+		break;
+#endif
+
+	default:
+		break;
+	}
+
+	return nullptr;
+}
+
 } // namespace data
 } // namespace pv
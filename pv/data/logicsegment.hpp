@@ -23,14 +23,22 @@
 
 #include "segment.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 namespace sigrok {
 	class Logic;
 }
 
 namespace LogicSegmentTest {
+struct MipMapKernels;
+struct ScalePowerCheck;
 struct Pow2;
 struct Basic;
 struct LargeData;
@@ -52,33 +60,191 @@ private:
 	};
 
 private:
-	static const unsigned int ScaleStepCount = 10;
-	static const int MipMapScalePower;
-	static const int MipMapScaleFactor;
-	static const float LogMipMapScaleFactor;
+	/**
+	 * The mip-map has enough levels to cover segments of up to
+	 * 2^MipMapCoverageBits samples. The number of levels in use depends
+	 * on the scale power, and levels are only allocated once the level
+	 * below has grown long enough to need them.
+	 */
+	static const unsigned int MipMapCoverageBits = 60;
+	static const unsigned int MaxScaleStepCount = 15;
 	static const uint64_t MipMapDataUnit;
+	static const uint64_t MipMapBatchLength;
+
+	static const uint64_t CompressionProbeLength;
+	static const unsigned int MinCompressionRatio;
+	static const uint64_t ExpansionBatchLength;
+
+	static const uint64_t TransitionIndexProbeLength;
+	static const unsigned int MinTransitionSpacing;
+
+	/**
+	 * A kernel that computes level 0 mip-map samples from contiguous
+	 * samples of a fixed unit size.
+	 * @param src The samples to compute the mip-map samples from.
+	 * @param dest The buffer to write the mip-map samples into.
+	 * @param block_count The number of mip-map samples to compute.
+	 * @param block_length The number of samples per mip-map sample.
+	 * Must be a multiple of 16.
+	 * @param last_sample The sample preceding @c src. This is updated
+	 * with the last sample of the final block.
+	 */
+	typedef void (*MipMapKernel)(const uint8_t *src, uint8_t *dest,
+		uint64_t block_count, unsigned int block_length,
+		uint64_t &last_sample);
+
+	enum MipMapKernelSet {
+		ScalarKernels,
+		SSE2Kernels,
+		AVX2Kernels,
+		NEONKernels
+	};
 
 public:
 	typedef std::pair<int64_t, bool> EdgePair;
 
+public:
+	/**
+	 * Enables or disables run-length encoding for new logic segments.
+	 *
+	 * A run-length encoded segment stores one entry for each sample at
+	 * which any channel changes state, instead of every raw sample. The
+	 * samples are examined in windows as they arrive, and once a window
+	 * compresses poorly, the segment is converted to raw samples by the
+	 * mip-map worker, a batch at a time. Run-length encoded samples can
+	 * not be read in place, and have no mip-map, so this is disabled by
+	 * default.
+	 */
+	static void set_compression_enabled(bool enabled);
+
+	static bool compression_enabled();
+
+	/// The range of powers accepted by set_default_mipmap_scale_power().
+	static const unsigned int MinMipMapScalePower;
+	static const unsigned int MaxMipMapScalePower;
+
+	/**
+	 * Sets the fan-out of the mip-maps of new logic segments. Each
+	 * mip-map sample summarises 2^power samples of the level below.
+	 * A larger fan-out uses less memory for the mip-map, but leaves
+	 * more samples to be examined when searching for edges. The power
+	 * must be between 4 and 8, and is 4 by default.
+	 */
+	static void set_default_mipmap_scale_power(unsigned int power);
+
+	static unsigned int default_mipmap_scale_power();
+
 public:
 	LogicSegment(std::shared_ptr<sigrok::Logic> logic,
-		uint64_t samplerate, uint64_t expected_num_samples = 0);
+		uint64_t samplerate);
 
 	virtual ~LogicSegment();
 
+	/**
+	 * Appends the samples of a logic packet to the segment. The samples
+	 * are only copied here; the mip-map is built by a worker thread, which
+	 * catches up with the data asynchronously.
+	 */
 	void append_payload(std::shared_ptr<sigrok::Logic> logic);
 
 	void get_samples(uint8_t *const data,
 		int64_t start_sample, int64_t end_sample) const;
 
+	/**
+	 * Gets a pointer to a run of samples in the memory of the segment,
+	 * so that they can be read without copying. Once appended, raw
+	 * samples do not move for the lifetime of the segment.
+	 * @param start The index of the first sample.
+	 * @param end The index after the last sample wanted.
+	 * @param count Receives the number of samples at the pointer, which
+	 * is at least 1 and at most @c end - @c start .
+	 * @return The pointer, or @c nullptr if the samples are run-length
+	 * encoded, and must be copied with @c get_samples .
+	 */
+	const uint8_t* get_contiguous_samples(uint64_t start, uint64_t end,
+		uint64_t &count) const;
+
+	/**
+	 * Gets the mip-map watermark.
+	 * @return The number of samples from the start of the segment that
+	 * have been folded into the mip-map. Edge searches beyond this point
+	 * fall back to examining the raw samples.
+	 */
+	uint64_t get_mipmap_sample_count() const;
+
+	/**
+	 * Returns true if the samples are stored run-length encoded.
+	 */
+	bool is_compressed() const;
+
+	uint64_t memory_usage() const;
+
+	/**
+	 * Gets the memory used by each level of the mip-map.
+	 * @return The number of bytes allocated for each level, from the
+	 * finest level up to the coarsest level computed so far.
+	 */
+	std::vector<uint64_t> mipmap_memory_usage() const;
+
+	/**
+	 * Counts the transitions of a channel in a range of samples.
+	 * @param start The first sample of the range.
+	 * @param end The last sample of the range.
+	 * @param sig_index The index of the signal.
+	 * @return The number of samples in (start, end] that differ from
+	 * their preceding sample, or nothing if the channel changes too
+	 * often to be indexed, or the index does not yet cover the range.
+	 */
+	boost::optional<uint64_t> get_edge_count(uint64_t start, uint64_t end,
+		int sig_index) const;
+
 private:
 	uint64_t unpack_sample(const uint8_t *ptr) const;
 	void pack_sample(uint8_t *ptr, uint64_t value);
-	
+
 	void reallocate_mipmap_level(MipMapLevel &m);
 
-	void append_payload_to_mipmap();
+	/**
+	 * Extends the mip-map to cover the given number of samples. The
+	 * work is done in batches, and the watermark is published after
+	 * each batch.
+	 */
+	void append_payload_to_mipmap(uint64_t sample_count);
+
+	/**
+	 * Adds the transitions in a batch of level 0 mip-map blocks to the
+	 * transition index.
+	 */
+	void index_transitions(const uint8_t *src, uint64_t first_block,
+		uint64_t block_count);
+
+	void drop_dense_channels(uint64_t sample_count);
+
+	void mipmap_proc();
+
+	void append_payload_to_runs(const uint8_t *data, uint64_t samples);
+
+	/**
+	 * Converts a batch of the run-length encoded samples to raw samples.
+	 * Once all the samples have been converted, the segment switches to
+	 * raw samples, and the mip-map is built. This is called by the
+	 * mip-map worker, which releases the segment between batches.
+	 */
+	void expand_runs();
+
+	/**
+	 * Gets the index of the run that contains a sample.
+	 */
+	uint64_t find_run(uint64_t index, uint64_t first_run = 0) const;
+
+	void get_run_samples(uint8_t *dest, uint64_t start,
+		uint64_t count) const;
+
+	void get_run_edges(std::vector< std::vector<EdgePair> > &edges,
+		uint64_t start, uint64_t end,
+		float min_length, uint64_t sig_mask) const;
+
+	void stop_mipmap_thread();
 
 	uint64_t get_sample(uint64_t index) const;
 
@@ -97,15 +263,134 @@ public:
 		uint64_t start, uint64_t end,
 		float min_length, int sig_index);
 
+	/**
+	 * Parses a logic data segment to generate lists of transitions of
+	 * several signals at once. The segment is locked, and the search is
+	 * set up, only once for all the signals.
+	 * @param[out] edges The vectors to place the edges into, indexed by
+	 * signal index. The vector is enlarged to hold the highest signal in
+	 * @c sig_mask if needed.
+	 * @param[in] start The start sample index.
+	 * @param[in] end The end sample index.
+	 * @param[in] min_length The minimum number of samples that
+	 * can be resolved at this level of detail.
+	 * @param[in] sig_mask A bit mask of the signals to search.
+	 **/
+	void get_subsampled_edges(std::vector< std::vector<EdgePair> > &edges,
+		uint64_t start, uint64_t end,
+		float min_length, uint64_t sig_mask);
+
 private:
+	/**
+	 * Searches the mip-map for the edges of several signals at once.
+	 * The signals share one walk of the mip-map, which stops at the
+	 * changes of any of them.
+	 */
+	void get_mipmap_edges(std::vector< std::vector<EdgePair> > &edges,
+		uint64_t start, uint64_t end,
+		float min_length, uint64_t sig_mask) const;
+
+	/**
+	 * Finds the first quantization block in which any of a set of
+	 * signals changes.
+	 * @param index The sample to start at, aligned to the quantization
+	 * blocks.
+	 * @param limit The search ends at the first block that begins at or
+	 * after this sample.
+	 * @param sig_mask A bit mask of the signals to search.
+	 * @param min_level The mip-map level whose blocks are the
+	 * quantization blocks.
+	 * @param quantum_power The length of the quantization blocks as a
+	 * power of two, 0 to search the individual samples.
+	 * @param[out] changes The signals which change in the block.
+	 * @return The start of the block, or @c limit if there is none.
+	 */
+	uint64_t find_mipmap_change(uint64_t index, uint64_t limit,
+		uint64_t sig_mask, unsigned int min_level,
+		unsigned int quantum_power, uint64_t &changes) const;
+
+	void get_indexed_edges(std::vector<EdgePair> &edges,
+		uint64_t start, uint64_t end,
+		float min_length, int sig_index) const;
+
 	uint64_t get_subsample(int level, uint64_t offset) const;
 
 	static uint64_t pow2_ceil(uint64_t x, unsigned int power);
 
+	/**
+	 * Gets the fastest set of mip-map kernels supported by the CPU.
+	 */
+	static MipMapKernelSet fastest_mipmap_kernel_set();
+
+	/**
+	 * Gets a mip-map kernel.
+	 * @param unit_size The unit size of the samples.
+	 * @param set The kernel set to take the kernel from.
+	 * @return The kernel, or @c nullptr if the set is not available in
+	 * this build or has no kernel for this unit size.
+	 */
+	static MipMapKernel mipmap_kernel(unsigned int unit_size,
+		MipMapKernelSet set);
+
 private:
-	struct MipMapLevel mip_map_[ScaleStepCount];
+	static bool compression_enabled_;
+	static unsigned int default_mipmap_scale_power_;
+
+	/**
+	 * If true, the samples are stored as runs of equal samples in
+	 * run_starts_ and run_values_, and data_chunks_ is empty.
+	 */
+	bool compressed_;
+	std::vector<uint64_t> run_starts_;
+	std::vector<uint64_t> run_values_;
+
+	/// The first sample and run of the window of samples whose
+	/// compression is measured next.
+	uint64_t window_start_sample_;
+	uint64_t window_start_run_;
+
+	/// Set once the segment compresses poorly, until the mip-map worker
+	/// has converted it to raw samples. The runs stay in use until then.
+	std::atomic<bool> expanding_;
+
+	/// The number of samples converted to raw samples so far.
+	uint64_t expanded_samples_;
+
+	const unsigned int mipmap_scale_power_;
+	const unsigned int mipmap_scale_factor_;
+	const float log_mipmap_scale_factor_;
+	const unsigned int scale_step_count_;
+
+	struct MipMapLevel mip_map_[MaxScaleStepCount];
 	uint64_t last_append_sample_;
+	MipMapKernel mipmap_kernel_;
+
+	/**
+	 * Protects mip_map_. Readers take it after mutex_, the worker never
+	 * holds both at once.
+	 */
+	mutable std::mutex mipmap_mutex_;
+
+	/**
+	 * The sorted positions of the transitions of each channel, up to
+	 * the mip-map watermark. Only the channels in indexed_channels_ are
+	 * indexed, the others change too often.
+	 */
+	std::vector< std::vector<uint64_t> > transitions_;
+	uint64_t indexed_channels_;
+	uint64_t last_index_sample_;
+
+	std::atomic<uint64_t> mipmap_sample_count_;
+
+	std::mutex mipmap_input_mutex_;
+	std::condition_variable mipmap_input_cond_;
+	uint64_t mipmap_input_samples_;
+
+	std::thread mipmap_thread_;
+	std::atomic<bool> mipmap_interrupt_;
 
+	friend struct LogicSegmentTest::MipMapKernels;
+	friend struct LogicSegmentTest::ScalePowerCheck;
 	friend struct LogicSegmentTest::Pow2;
 	friend struct LogicSegmentTest::Basic;
 	friend struct LogicSegmentTest::LargeData;
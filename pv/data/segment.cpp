@@ -24,26 +24,77 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <new>
+
+#include <QDir>
+#include <QTemporaryFile>
+
+using std::atomic;
+using std::bad_alloc;
 using std::lock_guard;
+using std::min;
 using std::recursive_mutex;
 
 namespace pv {
 namespace data {
 
+const uint64_t Segment::MaxChunkSize = 10 * 1024 * 1024;	// bytes
+const uint64_t Segment::SpillFileAlignment = 64 * 1024;	// bytes
+
+atomic<uint64_t> Segment::heap_chunk_bytes_(0);
+uint64_t Segment::spill_threshold_ = 0;
+QString Segment::spill_directory_;
+
+void Segment::set_spill_threshold(uint64_t threshold)
+{
+	spill_threshold_ = threshold;
+}
+
+uint64_t Segment::spill_threshold()
+{
+	return spill_threshold_;
+}
+
+void Segment::set_spill_directory(const QString &directory)
+{
+	spill_directory_ = directory;
+}
+
+QString Segment::spill_directory()
+{
+	return spill_directory_;
+}
+
 Segment::Segment(uint64_t samplerate, unsigned int unit_size) :
 	sample_count_(0),
 	start_time_(0),
 	samplerate_(samplerate),
-	capacity_(0),
-	unit_size_(unit_size)
+	unit_size_(unit_size),
+	chunk_power_(0)
 {
 	lock_guard<recursive_mutex> lock(mutex_);
 	assert(unit_size_ > 0);
+
+	// Use the largest power-of-two number of samples that fits into a
+	// chunk, so that sample indices can be split with a shift and a mask
+	while (((2ULL << chunk_power_) * unit_size_) <= MaxChunkSize)
+		chunk_power_++;
+	chunk_mask_ = (1ULL << chunk_power_) - 1;
 }
 
 Segment::~Segment()
 {
 	lock_guard<recursive_mutex> lock(mutex_);
+
+	for (size_t i = 0; i < data_chunks_.size(); i++)
+		if (!chunk_spilled_[i]) {
+			delete[] data_chunks_[i];
+			heap_chunk_bytes_ -= chunk_bytes();
+		}
+
+	// Closing the spill file unmaps the spilled chunks, and removes the file
+	spill_file_.reset();
 }
 
 uint64_t Segment::get_sample_count() const
@@ -72,39 +123,137 @@ unsigned int Segment::unit_size() const
 	return unit_size_;
 }
 
-void Segment::set_capacity(const uint64_t new_capacity)
+uint64_t Segment::memory_usage() const
 {
 	lock_guard<recursive_mutex> lock(mutex_);
+	return data_chunks_.size() * chunk_bytes();
+}
 
-	assert(capacity_ >= sample_count_);
-	if (new_capacity > capacity_) {
-		// If we're out of memory, this will throw std::bad_alloc
-		data_.resize((new_capacity * unit_size_) + sizeof(uint64_t));
-		capacity_ = new_capacity;
+void Segment::append_data(const void *data, uint64_t samples)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	const uint8_t *src = (const uint8_t*)data;
+	while (samples > 0) {
+		uint64_t available;
+		uint8_t *const dest = get_append_pointer(available);
+
+		const uint64_t count = min(samples, available);
+		memcpy(dest, src, count * unit_size_);
+
+		src += count * unit_size_;
+		samples -= count;
+		sample_count_ += count;
 	}
 }
 
-uint64_t Segment::capacity() const
+uint8_t* Segment::get_append_pointer(uint64_t &available)
+{
+	return get_append_pointer(sample_count_, available);
+}
+
+uint8_t* Segment::get_append_pointer(uint64_t index, uint64_t &available)
 {
 	lock_guard<recursive_mutex> lock(mutex_);
-	return data_.size();
+
+	const uint64_t chunk_samples = 1ULL << chunk_power_;
+	assert(index <= data_chunks_.size() * chunk_samples);
+
+	if (index == data_chunks_.size() * chunk_samples) {
+		const bool spill = spill_threshold_ != 0 &&
+			heap_chunk_bytes_ + chunk_bytes() > spill_threshold_;
+
+		// If we're out of memory, this will throw std::bad_alloc
+		data_chunks_.push_back(nullptr);
+		chunk_spilled_.push_back(spill);
+		try {
+			data_chunks_.back() = spill ?
+				allocate_spill_chunk() : allocate_chunk();
+		} catch (...) {
+			data_chunks_.pop_back();
+			chunk_spilled_.pop_back();
+			throw;
+		}
+	}
+
+	available = contiguous_samples(index);
+	return data_chunks_[index >> chunk_power_] +
+		(index & chunk_mask_) * unit_size_;
 }
 
-void Segment::append_data(void *data, uint64_t samples)
+void Segment::get_raw_samples(uint8_t *dest,
+	uint64_t start, uint64_t count) const
 {
+	assert(dest);
+
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	assert(capacity_ >= sample_count_);
+	assert(start + count <= sample_count_);
+
+	while (count > 0) {
+		const uint64_t n = min(count, contiguous_samples(start));
+		memcpy(dest, get_raw_sample(start), n * unit_size_);
+
+		dest += n * unit_size_;
+		start += n;
+		count -= n;
+	}
+}
+
+const uint8_t* Segment::get_raw_sample(uint64_t index) const
+{
+	assert((index >> chunk_power_) < data_chunks_.size());
+	return data_chunks_[index >> chunk_power_] +
+		(index & chunk_mask_) * unit_size_;
+}
+
+uint64_t Segment::contiguous_samples(uint64_t index) const
+{
+	return (1ULL << chunk_power_) - (index & chunk_mask_);
+}
+
+uint64_t Segment::chunk_bytes() const
+{
+	// Padding is added to allow for the uint64_t read word
+	return (1ULL << chunk_power_) * unit_size_ + sizeof(uint64_t);
+}
+
+uint8_t* Segment::allocate_chunk()
+{
+	uint8_t *const chunk = new uint8_t[chunk_bytes()];
+	heap_chunk_bytes_ += chunk_bytes();
+	return chunk;
+}
 
-	// Ensure there's enough capacity to copy.
-	const uint64_t free_space = capacity_ - sample_count_;
-	if (free_space < samples) {
-		set_capacity(sample_count_ + samples);
+uint8_t* Segment::allocate_spill_chunk()
+{
+	if (!spill_file_) {
+		const QString dir = spill_directory_.isEmpty() ?
+			QDir::tempPath() : spill_directory_;
+		spill_file_.reset(new QTemporaryFile(
+			QDir(dir).filePath("pulseview-XXXXXX.tmp")));
+		if (!spill_file_->open()) {
+			spill_file_.reset();
+			throw bad_alloc();
+		}
 	}
 
-	memcpy((uint8_t*)data_.data() + sample_count_ * unit_size_,
-		data, samples * unit_size_);
-	sample_count_ += samples;
+	// Map offsets must be aligned to the page size of the platform
+	const qint64 stride = (chunk_bytes() + SpillFileAlignment - 1) /
+		SpillFileAlignment * SpillFileAlignment;
+	const qint64 offset = spill_file_->size();
+	assert(offset % stride == 0);
+
+	// Running out of disk space is treated the same as running out of
+	// memory
+	if (!spill_file_->resize(offset + stride))
+		throw bad_alloc();
+
+	uchar *const chunk = spill_file_->map(offset, chunk_bytes());
+	if (!chunk)
+		throw bad_alloc();
+
+	return chunk;
 }
 
 } // namespace data
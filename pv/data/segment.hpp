@@ -23,15 +23,52 @@
 
 #include "pv/util.hpp"
 
+#include <atomic>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <vector>
 
+#include <QString>
+
+class QTemporaryFile;
+
 namespace pv {
 namespace data {
 
 class Segment
 {
+private:
+	static const uint64_t MaxChunkSize;
+	static const uint64_t SpillFileAlignment;
+
+public:
+	/**
+	 * @brief Sets the spill threshold.
+	 *
+	 * Once the sample chunks of all segments together occupy more than
+	 * this many bytes of heap memory, new chunks are allocated in a
+	 * temporary file and accessed through a memory mapping. The operating
+	 * system may then evict the sample data from memory at will, so the
+	 * length of a capture is limited by disk space instead of RAM.
+	 *
+	 * @param[in] threshold The threshold in bytes, or 0 to keep all
+	 * 	samples in heap memory.
+	 */
+	static void set_spill_threshold(uint64_t threshold);
+
+	static uint64_t spill_threshold();
+
+	/**
+	 * @brief Sets the directory in which spill files are created.
+	 *
+	 * @param[in] directory The directory path, or an empty string to use
+	 * 	the system temporary directory.
+	 */
+	static void set_spill_directory(const QString &directory);
+
+	static QString spill_directory();
+
 public:
 	Segment(uint64_t samplerate, unsigned int unit_size);
 
@@ -47,43 +84,110 @@ public:
 	unsigned int unit_size() const;
 
 	/**
-	 * @brief Increase the capacity of the segment.
+	 * @brief Gets the number of bytes of memory used to store the samples.
+	 */
+	virtual uint64_t memory_usage() const;
+
+protected:
+	/**
+	 * @brief Appends samples to the end of the segment.
+	 *
+	 * Samples are stored in a list of fixed-size chunks. When the last chunk
+	 * is full a new one is allocated, so previously stored samples are never
+	 * moved or copied.
+	 *
+	 * @note If we're out of memory, this will throw std::bad_alloc.
+	 *
+	 * @param[in] data The samples to append.
+	 * @param[in] samples The number of samples to append.
+	 */
+	void append_data(const void *data, uint64_t samples);
+
+	/**
+	 * @brief Gets a pointer to the next unused sample slot.
 	 *
-	 * Increasing the capacity allows samples to be appended without needing
-	 * to reallocate memory.
+	 * Allocates a new chunk if the last chunk is full. The caller may write
+	 * up to @c available samples to the returned pointer, and must then
+	 * commit them by increasing @c sample_count_ accordingly.
 	 *
-	 * For the best efficiency @c set_capacity() should be called once before
-	 * @c append_data() is called to set up the segment with the expected number
-	 * of samples that will be appended in total.
+	 * @param[out] available The number of samples that can be written
+	 * 	contiguously at the returned pointer.
 	 *
-	 * @note The capacity will automatically be increased when @c append_data()
-	 * is called if there is not enough capacity in the buffer to store the samples.
+	 * @return A pointer to the first unused sample slot.
+	 */
+	uint8_t* get_append_pointer(uint64_t &available);
+
+	/**
+	 * @brief Gets a pointer to an unused sample slot, for a caller that
+	 * 	fills the chunks behind @c sample_count_ .
 	 *
-	 * @param[in] new_capacity The new capacity of the segment. If this value is
-	 * 	smaller or equal than the current capacity then the method has no effect.
+	 * @param[in] index The number of samples already written to the
+	 * 	chunks.
+	 * @param[out] available The number of samples that can be written
+	 * 	contiguously at the returned pointer.
+	 *
+	 * @return A pointer to the sample slot at @c index.
 	 */
-	void set_capacity(uint64_t new_capacity);
+	uint8_t* get_append_pointer(uint64_t index, uint64_t &available);
 
 	/**
-	 * @brief Get the current capacity of the segment.
+	 * @brief Copies a range of samples out of the segment.
 	 *
-	 * The capacity can be increased by calling @c set_capacity().
+	 * The range may span any number of chunks.
 	 *
-	 * @return The current capacity of the segment.
+	 * @param[out] dest The buffer to copy the samples into.
+	 * @param[in] start The index of the first sample to copy.
+	 * @param[in] count The number of samples to copy.
 	 */
-	uint64_t capacity() const;
+	void get_raw_samples(uint8_t *dest, uint64_t start, uint64_t count) const;
 
-protected:
-	void append_data(void *data, uint64_t samples);
+	/**
+	 * @brief Gets a pointer to a single sample.
+	 *
+	 * The samples of a chunk are contiguous, and the number of samples per
+	 * chunk is a power of two. Therefore any naturally aligned power-of-two
+	 * sized block of samples no larger than a chunk is contiguous in memory.
+	 * Each chunk is padded by @c sizeof(uint64_t) bytes, so that a whole
+	 * @c uint64_t may be read from the pointer of the last sample.
+	 *
+	 * @param[in] index The index of the sample.
+	 *
+	 * @return A pointer to the sample.
+	 */
+	const uint8_t* get_raw_sample(uint64_t index) const;
+
+	/**
+	 * @brief Gets the number of contiguous samples available in the chunk
+	 * 	that contains @c index, starting from @c index.
+	 */
+	uint64_t contiguous_samples(uint64_t index) const;
+
+private:
+	uint64_t chunk_bytes() const;
+
+	uint8_t* allocate_chunk();
+
+	uint8_t* allocate_spill_chunk();
+
+private:
+	static std::atomic<uint64_t> heap_chunk_bytes_;
+	static uint64_t spill_threshold_;
+	static QString spill_directory_;
+
+	std::unique_ptr<QTemporaryFile> spill_file_;
+	std::vector<bool> chunk_spilled_;
 
 protected:
 	mutable std::recursive_mutex mutex_;
-	std::vector<uint8_t> data_;
+	std::vector<uint8_t*> data_chunks_;
 	uint64_t sample_count_;
 	pv::util::Timestamp start_time_;
 	double samplerate_;
-	uint64_t capacity_;
 	unsigned int unit_size_;
+
+	/// The number of samples per chunk is 1 << chunk_power_.
+	unsigned int chunk_power_;
+	uint64_t chunk_mask_;
 };
 
 } // namespace data
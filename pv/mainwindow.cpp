@@ -45,6 +45,7 @@
 #include "mainwindow.hpp"
 
 #include "devicemanager.hpp"
+#include "util.hpp"
 #include "devices/hardwaredevice.hpp"
 #include "devices/inputfile.hpp"
 #include "devices/sessionfile.hpp"
@@ -58,6 +59,8 @@
 #include "widgets/exportmenu.hpp"
 #include "widgets/importmenu.hpp"
 #ifdef ENABLE_DECODE
+#include "data/decoderstack.hpp"
+#include "data/decode/scheduler.hpp"
 #include "widgets/decodermenu.hpp"
 #endif
 #include "widgets/hidingmenubar.hpp"
@@ -92,6 +95,8 @@ class ViewItem;
 const char *MainWindow::SettingOpenDirectory = "MainWindow/OpenDirectory";
 const char *MainWindow::SettingSaveDirectory = "MainWindow/SaveDirectory";
 
+const int MainWindow::DecodeStatisticsInterval = 1000;
+
 MainWindow::MainWindow(DeviceManager &device_manager,
 	string open_file_name, string open_file_format,
 	QWidget *parent) :
@@ -452,6 +457,10 @@ void MainWindow::setup_ui()
 		this, SLOT(add_decoder(srd_decoder*)));
 
 	menu_decoders->addMenu(menu_decoders_add_);
+
+	connect(&decode_statistics_timer_, SIGNAL(timeout()),
+		this, SLOT(update_decode_statistics()));
+	decode_statistics_timer_.start(DecodeStatisticsInterval);
 #endif
 
 	// Help Menu
@@ -781,6 +790,26 @@ void MainWindow::add_decoder(srd_decoder *decoder)
 #endif
 }
 
+void MainWindow::update_decode_statistics()
+{
+#ifdef ENABLE_DECODE
+	const data::decode::Scheduler::Statistics s =
+		data::DecoderStack::scheduler().take_statistics();
+
+	if (s.busy_slots == 0 && s.samples_per_second == 0.0) {
+		if (!statusBar()->currentMessage().isEmpty())
+			statusBar()->clearMessage();
+		return;
+	}
+
+	statusBar()->showMessage(tr("Decoding: %1 of %2 slots busy, "
+		"%3% utilised, %4").arg(s.busy_slots).arg(s.slot_count)
+		.arg((int)(s.utilisation * 100.0 + 0.5))
+		.arg(util::format_time_si(util::Timestamp(s.samples_per_second),
+			util::SIPrefix::unspecified, 1, "Sa/s", false)));
+#endif
+}
+
 void MainWindow::capture_state_changed(int state)
 {
 	main_bar_->set_capture_state((pv::Session::capture_state)state);
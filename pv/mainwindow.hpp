@@ -28,6 +28,7 @@
 #include <glibmm/variant.h>
 
 #include <QMainWindow>
+#include <QTimer>
 
 #include "session.hpp"
 
@@ -76,6 +77,12 @@ private:
 	 */
 	static const char *SettingSaveDirectory;
 
+	/**
+	 * The interval in milliseconds at which the decoder statistics in
+	 * the status bar are updated.
+	 */
+	static const int DecodeStatisticsInterval;
+
 public:
 	explicit MainWindow(DeviceManager &device_manager,
 		std::string open_file_name = std::string(),
@@ -168,6 +175,12 @@ private Q_SLOTS:
 
 	void always_zoom_to_fit_changed(bool state);
 
+	/**
+	 * Shows the utilisation and throughput of the decoders in the
+	 * status bar while they are decoding.
+	 */
+	void update_decode_statistics();
+
 private:
 	DeviceManager &device_manager_;
 
@@ -194,6 +207,8 @@ private:
 
 #ifdef ENABLE_DECODE
 	QMenu *const menu_decoders_add_;
+
+	QTimer decode_statistics_timer_;
 #endif
 };
 
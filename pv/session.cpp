@@ -479,8 +479,6 @@ void Session::feed_in_logic(shared_ptr<Logic> logic)
 {
 	lock_guard<recursive_mutex> lock(data_mutex_);
 
-	const size_t sample_count = logic->data_length() / logic->unit_size();
-
 	if (!logic_data_)
 	{
 		// The only reason logic_data_ would not have been created is
@@ -496,8 +494,7 @@ void Session::feed_in_logic(shared_ptr<Logic> logic)
 
 		// Create a new data segment
 		cur_logic_segment_ = shared_ptr<data::LogicSegment>(
-			new data::LogicSegment(
-				logic, cur_samplerate_, sample_count));
+			new data::LogicSegment(logic, cur_samplerate_));
 		logic_data_->push_segment(cur_logic_segment_);
 
 		// @todo Putting this here means that only listeners querying
@@ -525,6 +522,9 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 	const float *data = analog->data_pointer();
 	bool sweep_beginning = false;
 
+	vector< shared_ptr<data::AnalogSegment> > segments;
+	segments.reserve(channel_count);
+
 	for (auto channel : channels)
 	{
 		shared_ptr<data::AnalogSegment> segment;
@@ -543,8 +543,7 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 
 			// Create a segment, keep it in the maps of channels
 			segment = shared_ptr<data::AnalogSegment>(
-				new data::AnalogSegment(
-					cur_samplerate_, sample_count));
+				new data::AnalogSegment(cur_samplerate_));
 			cur_analog_segments_[channel] = segment;
 
 			// Find the analog data associated with the channel
@@ -561,12 +560,13 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 		}
 
 		assert(segment);
-
-		// Append the samples in the segment
-		segment->append_interleaved_samples(data++, sample_count,
-			channel_count);
+		segments.push_back(segment);
 	}
 
+	// Append the samples of all the channels in one pass
+	data::AnalogSegment::append_interleaved_samples(segments, data,
+		sample_count);
+
 	if (sweep_beginning) {
 		// This could be the first packet after a trigger
 		set_capture_state(Running);
@@ -575,6 +575,25 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 	data_received();
 }
 
+void Session::log_memory_usage() const
+{
+	if (cur_logic_segment_) {
+		QDebug d = qDebug();
+		d << "Logic segment:" << cur_logic_segment_->memory_usage() <<
+			"bytes, mip-map levels:";
+		for (uint64_t bytes : cur_logic_segment_->mipmap_memory_usage())
+			d << bytes;
+	}
+
+	for (const auto &entry : cur_analog_segments_) {
+		QDebug d = qDebug();
+		d << "Analog segment" << entry.first->name().c_str() << ":" <<
+			entry.second->memory_usage() << "bytes, envelope levels:";
+		for (uint64_t bytes : entry.second->envelope_memory_usage())
+			d << bytes;
+	}
+}
+
 void Session::data_feed_in(shared_ptr<sigrok::Device> device,
 	shared_ptr<Packet> packet)
 {
@@ -619,6 +638,7 @@ void Session::data_feed_in(shared_ptr<sigrok::Device> device,
 	{
 		{
 			lock_guard<recursive_mutex> lock(data_mutex_);
+			log_memory_usage();
 			cur_logic_segment_.reset();
 			cur_analog_segments_.clear();
 		}
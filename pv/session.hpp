@@ -150,6 +150,12 @@ private:
 
 	void feed_in_analog(std::shared_ptr<sigrok::Analog> analog);
 
+	/**
+	 * Logs the memory used by the segments of the current frame, and by
+	 * each level of their mip-maps and envelopes.
+	 */
+	void log_memory_usage() const;
+
 	void data_feed_in(std::shared_ptr<sigrok::Device> device,
 		std::shared_ptr<sigrok::Packet> packet);
 
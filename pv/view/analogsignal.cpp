@@ -58,7 +58,8 @@ AnalogSignal::AnalogSignal(
 	shared_ptr<data::Analog> data) :
 	Signal(session, channel),
 	data_(data),
-	scale_(1.0f)
+	scale_(1.0f),
+	paint_prepared_(false)
 {
 	colour_ = SignalColours[channel_->index() % countof(SignalColours)];
 }
@@ -77,9 +78,16 @@ shared_ptr<pv::data::Analog> AnalogSignal::analog_data() const
 	return data_;
 }
 
+void AnalogSignal::set_colour(QColor colour)
+{
+	Signal::set_colour(colour);
+	tile_cache_.clear();
+}
+
 void AnalogSignal::set_scale(float scale)
 {
 	scale_ = scale;
+	tile_cache_.clear();
 }
 
 std::pair<int, int> AnalogSignal::v_extents() const
@@ -93,12 +101,12 @@ void AnalogSignal::paint_back(QPainter &p, const ViewItemPaintParams &pp)
 		paint_axis(p, pp, get_visual_y());
 }
 
-void AnalogSignal::paint_mid(QPainter &p, const ViewItemPaintParams &pp)
+void AnalogSignal::prepare_paint_mid(const ViewItemPaintParams &pp)
 {
 	assert(data_);
 	assert(owner_);
 
-	const int y = get_visual_y();
+	paint_prepared_ = false;
 
 	if (!channel_->enabled())
 		return;
@@ -111,76 +119,162 @@ void AnalogSignal::paint_mid(QPainter &p, const ViewItemPaintParams &pp)
 	const shared_ptr<pv::data::AnalogSegment> &segment =
 		segments.front();
 
-	const double pixels_offset = pp.pixels_offset();
-	const double samplerate = segment->samplerate();
+	double samplerate = segment->samplerate();
+	if (samplerate == 0.0)
+		samplerate = 1.0;
+	const pv::util::Timestamp data_end = segment->start_time() +
+		((double)segment->get_sample_count() - 1) / samplerate;
+	tile_cache_.validate(pp.scale(), segment, data_end);
+
+	const int y = get_visual_y();
+	for (int64_t index : tile_cache_.missing_tiles(pp, y))
+		render_tile(segment, index, pp, y);
+
+	paint_prepared_ = true;
+}
+
+void AnalogSignal::paint_mid(QPainter &p, const ViewItemPaintParams &pp)
+{
+	// The tiles are normally rendered on a worker thread beforehand
+	if (!paint_prepared_)
+		prepare_paint_mid(pp);
+	if (!paint_prepared_)
+		return;
+
+	paint_prepared_ = false;
+
+	tile_cache_.paint(p, pp, get_visual_y());
+}
+
+void AnalogSignal::paint_fore(QPainter &p, const ViewItemPaintParams &pp)
+{
+	paint_cursor_measurement(p, pp);
+}
+
+QString AnalogSignal::cursor_measurement(const pv::util::Timestamp &start,
+	const pv::util::Timestamp &end) const
+{
+	assert(data_);
+
+	const deque< shared_ptr<pv::data::AnalogSegment> > &segments =
+		data_->analog_segments();
+	if (segments.empty())
+		return QString();
+
+	const shared_ptr<pv::data::AnalogSegment> &segment = segments.front();
+
+	int64_t first, last;
+	if (!get_cursor_samples(segment, start, end, first, last))
+		return QString();
+
+	const pv::data::AnalogSegment::Statistics stats =
+		segment->get_statistics(first, last + 1);
+	return tr("mean %1, RMS %2").arg(stats.mean, 0, 'g', 4).
+		arg(stats.rms, 0, 'g', 4);
+}
+
+void AnalogSignal::render_tile(
+	const shared_ptr<pv::data::AnalogSegment> &segment,
+	int64_t index, const ViewItemPaintParams &pp, int y)
+{
+	const ViewItemPaintParams tp = TileCache::tile_params(index, pp);
+
+	const double pixels_offset = tp.pixels_offset();
+	double samplerate = segment->samplerate();
+
+	// Show sample rate as 1Hz when it is unknown
+	if (samplerate == 0.0)
+		samplerate = 1.0;
+
 	const pv::util::Timestamp& start_time = segment->start_time();
 	const int64_t last_sample = segment->get_sample_count() - 1;
-	const double samples_per_pixel = samplerate * pp.scale();
-	const pv::util::Timestamp start = samplerate * (pp.offset() - start_time);
-	const pv::util::Timestamp end = start + samples_per_pixel * pp.width();
+	const double samples_per_pixel = samplerate * tp.scale();
+	const pv::util::Timestamp start = samplerate * (tp.offset() - start_time);
+	const pv::util::Timestamp end = start + samples_per_pixel * tp.width();
 
 	const int64_t start_sample = min(max(floor(start).convert_to<int64_t>(),
 		(int64_t)0), last_sample);
 	const int64_t end_sample = min(max((ceil(end) + 1).convert_to<int64_t>(),
 		(int64_t)0), last_sample);
 
+	trace_points_.clear();
+	envelope_rects_.clear();
+
 	if (samples_per_pixel < EnvelopeThreshold)
-		paint_trace(p, segment, y, pp.left(),
+		build_trace(segment, y, tp.left(),
 			start_sample, end_sample,
 			pixels_offset, samples_per_pixel);
 	else
-		paint_envelope(p, segment, y, pp.left(),
+		build_envelope(segment, y, tp.left(),
 			start_sample, end_sample,
 			pixels_offset, samples_per_pixel);
+
+	// Find the vertical extent of the geometry
+	float top = y, bottom = y;
+	for (const QPointF &pt : trace_points_) {
+		top = min(top, (float)pt.y());
+		bottom = max(bottom, (float)pt.y());
+	}
+	for (const QRectF &r : envelope_rects_) {
+		top = min(top, (float)min(r.top(), r.bottom()));
+		bottom = max(bottom, (float)max(r.top(), r.bottom()));
+	}
+
+	tile_cache_.render_tile(index, pp, y,
+		QRectF(0, top, TileCache::TileWidth, bottom - top),
+		[this](QPainter &p) {
+			if (!trace_points_.empty()) {
+				p.setPen(colour_);
+				p.drawPolyline(trace_points_.data(),
+					trace_points_.size());
+			}
+
+			if (!envelope_rects_.empty()) {
+				p.setPen(QPen(Qt::NoPen));
+				p.setBrush(colour_);
+				p.drawRects(envelope_rects_.data(),
+					envelope_rects_.size());
+			}
+		});
 }
 
-void AnalogSignal::paint_trace(QPainter &p,
+void AnalogSignal::build_trace(
 	const shared_ptr<pv::data::AnalogSegment> &segment,
 	int y, int left, const int64_t start, const int64_t end,
 	const double pixels_offset, const double samples_per_pixel)
 {
-	const int64_t sample_count = end - start;
-
-	const float *const samples = segment->get_samples(start, end);
-	assert(samples);
-
-	p.setPen(colour_);
-
-	QPointF *points = new QPointF[sample_count];
-	QPointF *point = points;
-
-	for (int64_t sample = start; sample != end; sample++) {
-		const float x = (sample / samples_per_pixel -
-			pixels_offset) + left;
-		*point++ = QPointF(x,
-			y - samples[sample - start] * scale_);
+	const pv::data::AnalogSegment::ReadView view(*segment);
+
+	trace_points_.reserve(end - start);
+	for (int64_t sample = start; sample != end;) {
+		uint64_t count;
+		const float *samples = view.samples(sample, end, count);
+		for (const float *const samples_end = samples + count;
+			samples != samples_end; samples++, sample++) {
+			const float x = (sample / samples_per_pixel -
+				pixels_offset) + left;
+			trace_points_.push_back(QPointF(x,
+				y - *samples * scale_));
+		}
 	}
-
-	p.drawPolyline(points, point - points);
-
-	delete[] samples;
-	delete[] points;
 }
 
-void AnalogSignal::paint_envelope(QPainter &p,
+void AnalogSignal::build_envelope(
 	const shared_ptr<pv::data::AnalogSegment> &segment,
 	int y, int left, const int64_t start, const int64_t end,
 	const double pixels_offset, const double samples_per_pixel)
 {
 	using pv::data::AnalogSegment;
 
+	const AnalogSegment::ReadView view(*segment);
+
 	AnalogSegment::EnvelopeSection e;
-	segment->get_envelope_section(e, start, end, samples_per_pixel);
+	view.get_envelope_section(e, start, end, samples_per_pixel);
 
 	if (e.length < 2)
 		return;
 
-	p.setPen(QPen(Qt::NoPen));
-	p.setBrush(colour_);
-
-	QRectF *const rects = new QRectF[e.length];
-	QRectF *rect = rects;
-
+	envelope_rects_.reserve(e.length - 1);
 	for (uint64_t sample = 0; sample < e.length-1; sample++) {
 		const float x = ((e.scale * sample + e.start) /
 			samples_per_pixel - pixels_offset) + left;
@@ -198,13 +292,8 @@ void AnalogSignal::paint_envelope(QPainter &p,
 		if (h <= 0.0f && h >= -1.0f)
 			h = -1.0f;
 
-		*rect++ = QRectF(x, t, 1.0f, h);
+		envelope_rects_.push_back(QRectF(x, t, 1.0f, h));
 	}
-
-	p.drawRects(rects, e.length);
-
-	delete[] rects;
-	delete[] e.samples;
 }
 
 } // namespace view
@@ -22,8 +22,13 @@
 #define PULSEVIEW_PV_VIEW_ANALOGSIGNAL_HPP
 
 #include "signal.hpp"
+#include "tilecache.hpp"
 
 #include <memory>
+#include <vector>
+
+#include <QPointF>
+#include <QRectF>
 
 namespace pv {
 
@@ -53,6 +58,11 @@ public:
 
 	std::shared_ptr<pv::data::Analog> analog_data() const;
 
+	/**
+	 * Set the colour of the signal.
+	 */
+	void set_colour(QColor colour);
+
 	void set_scale(float scale);
 
 	/**
@@ -68,6 +78,13 @@ public:
 	 **/
 	void paint_back(QPainter &p, const ViewItemPaintParams &pp);
 
+	/**
+	 * Prepares the mid-layer of the signal for painting, by rendering
+	 * the tiles that are missing from the tile cache.
+	 * @param pp the painting parameters object that will be painted with.
+	 **/
+	void prepare_paint_mid(const ViewItemPaintParams &pp);
+
 	/**
 	 * Paints the mid-layer of the signal with a QPainter
 	 * @param p the QPainter to paint into.
@@ -75,13 +92,32 @@ public:
 	 **/
 	void paint_mid(QPainter &p, const ViewItemPaintParams &pp);
 
+	/**
+	 * Paints the foreground layer of the signal with a QPainter
+	 * @param p the QPainter to paint into.
+	 * @param pp the painting parameters object to paint with.
+	 **/
+	void paint_fore(QPainter &p, const ViewItemPaintParams &pp);
+
+protected:
+	/**
+	 * Measures the mean and RMS of the samples between the cursors,
+	 * from the statistics levels of the segment.
+	 */
+	QString cursor_measurement(const pv::util::Timestamp &start,
+		const pv::util::Timestamp &end) const;
+
 private:
-	void paint_trace(QPainter &p,
+	void render_tile(
+		const std::shared_ptr<pv::data::AnalogSegment> &segment,
+		int64_t index, const ViewItemPaintParams &pp, int y);
+
+	void build_trace(
 		const std::shared_ptr<pv::data::AnalogSegment> &segment,
 		int y, int left, const int64_t start, const int64_t end,
 		const double pixels_offset, const double samples_per_pixel);
 
-	void paint_envelope(QPainter &p,
+	void build_envelope(
 		const std::shared_ptr<pv::data::AnalogSegment> &segment,
 		int y, int left, const int64_t start, const int64_t end,
 		const double pixels_offset, const double samples_per_pixel);
@@ -89,6 +125,11 @@ private:
 private:
 	std::shared_ptr<pv::data::Analog> data_;
 	float scale_;
+
+	std::vector<QPointF> trace_points_;
+	std::vector<QRectF> envelope_rects_;
+	TileCache tile_cache_;
+	bool paint_prepared_;
 };
 
 } // namespace view
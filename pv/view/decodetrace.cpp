@@ -85,6 +85,7 @@ const QColor DecodeTrace::NoDecodeColour = QColor(0x88, 0x8A, 0x85);
 const int DecodeTrace::ArrowSize = 4;
 const double DecodeTrace::EndCapWidth = 5;
 const int DecodeTrace::DrawPadding = 100;
+const double DecodeTrace::MinAnnotationWidth = 4;
 
 const QColor DecodeTrace::Colours[16] = {
 	QColor(0xEF, 0x29, 0x29),
@@ -193,6 +194,10 @@ void DecodeTrace::paint_mid(QPainter &p, const ViewItemPaintParams &pp)
 	pair<uint64_t, uint64_t> sample_range = get_sample_range(
 		pp.left(), pp.right());
 
+	double samples_per_pixel, pixels_offset;
+	tie(pixels_offset, samples_per_pixel) =
+		get_pixels_offset_samples_per_pixel();
+
 	assert(decoder_stack_);
 	const vector<Row> rows(decoder_stack_->get_visible_rows());
 
@@ -207,10 +212,33 @@ void DecodeTrace::paint_mid(QPainter &p, const ViewItemPaintParams &pp)
 		boost::hash_combine(base_colour, row.row());
 		base_colour >>= 16;
 
+		// When zoomed out, the spans of coverage that are too crowded
+		// to show their annotations are drawn as busy bands, and only
+		// the annotations of the other spans are extracted
 		vector<Annotation> annotations;
-		decoder_stack_->get_annotation_subset(annotations, row,
-			sample_range.first, sample_range.second);
-		if (!annotations.empty()) {
+		vector<RowData::Span> spans;
+		if (decoder_stack_->get_coverage_spans(spans, row,
+			sample_range.first, sample_range.second,
+			samples_per_pixel)) {
+			for (const RowData::Span &s : spans) {
+				if (s.annotation_count * MinAnnotationWidth *
+					samples_per_pixel >
+					s.end_sample - s.start_sample)
+					draw_busy_band(s, p, annotation_height,
+						base_colour, y);
+				else
+					decoder_stack_->get_annotation_subset(
+						annotations, row,
+						s.start_sample ?
+							s.start_sample - 1 : 0,
+						s.end_sample);
+			}
+		} else {
+			decoder_stack_->get_annotation_subset(annotations, row,
+				sample_range.first, sample_range.second);
+		}
+
+		if (!annotations.empty() || !spans.empty()) {
 			for (const Annotation &a : annotations)
 				draw_annotation(a, p, annotation_height,
 					pp, y, base_colour);
@@ -301,6 +329,11 @@ void DecodeTrace::populate_popup_form(QWidget *parent, QFormLayout *form)
 
 		form->addRow(new QLabel(
 			tr("<i>* Required channels</i>"), parent));
+
+		if (decoder_stack_->cache_status() ==
+			data::DecoderStack::CacheHit)
+			form->addRow(new QLabel(tr("<i>The annotations were "
+				"loaded from the decode cache</i>"), parent));
 	}
 
 	// Add stacking button
@@ -381,7 +414,7 @@ void DecodeTrace::draw_range(const pv::data::decode::Annotation &a, QPainter &p,
 {
 	const double top = y + .5 - h / 2;
 	const double bottom = y + .5 + h / 2;
-	const vector<QString> annotations = a.annotations();
+	const vector<QString> &annotations = a.annotations();
 
 	p.setPen(outline);
 	p.setBrush(fill);
@@ -434,6 +467,26 @@ void DecodeTrace::draw_range(const pv::data::decode::Annotation &a, QPainter &p,
 		best_annotation, Qt::ElideRight, rect.width()));
 }
 
+void DecodeTrace::draw_busy_band(const pv::data::decode::RowData::Span &s,
+	QPainter &p, int h, size_t base_colour, int y) const
+{
+	double samples_per_pixel, pixels_offset;
+	tie(pixels_offset, samples_per_pixel) =
+		get_pixels_offset_samples_per_pixel();
+
+	const double start = s.start_sample / samples_per_pixel -
+		pixels_offset;
+	const double end = s.end_sample / samples_per_pixel -
+		pixels_offset;
+
+	const size_t colour = base_colour % countof(Colours);
+	p.setPen(OutlineColours[colour]);
+	p.setBrush(Colours[colour]);
+
+	// Draw at least one pixel, so that isolated bursts remain visible
+	p.drawRect(QRectF(start, y + .5 - h / 2, max(end - start, 1.0), h));
+}
+
 void DecodeTrace::draw_error(QPainter &p, const QString &message,
 	const ViewItemPaintParams &pp)
 {
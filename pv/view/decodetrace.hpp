@@ -31,6 +31,7 @@
 
 #include <pv/binding/decoder.hpp>
 #include <pv/data/decode/row.hpp>
+#include <pv/data/decode/rowdata.hpp>
 
 struct srd_channel;
 struct srd_decoder;
@@ -77,6 +78,7 @@ private:
 	static const int ArrowSize;
 	static const double EndCapWidth;
 	static const int DrawPadding;
+	static const double MinAnnotationWidth;
 
 	static const QColor Colours[16];
 	static const QColor OutlineColours[16];
@@ -135,6 +137,9 @@ private:
 		QColor fill, QColor outline, int h, double start,
 		double end, int y) const;
 
+	void draw_busy_band(const pv::data::decode::RowData::Span &s,
+		QPainter &p, int h, size_t base_colour, int y) const;
+
 	void draw_error(QPainter &p, const QString &message,
 		const ViewItemPaintParams &pp);
 
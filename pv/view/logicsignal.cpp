@@ -24,6 +24,7 @@
 #include <cmath>
 
 #include <algorithm>
+#include <map>
 
 #include <QFormLayout>
 #include <QToolBar>
@@ -43,6 +44,7 @@
 using std::deque;
 using std::max;
 using std::make_pair;
+using std::map;
 using std::min;
 using std::pair;
 using std::shared_ptr;
@@ -105,6 +107,7 @@ LogicSignal::LogicSignal(
 	Signal(session, channel),
 	device_(device),
 	data_(data),
+	paint_prepared_(false),
 	trigger_none_(nullptr),
 	trigger_rising_(nullptr),
 	trigger_high_(nullptr),
@@ -158,135 +161,237 @@ void LogicSignal::paint_back(QPainter &p, const ViewItemPaintParams &pp)
 
 void LogicSignal::paint_mid(QPainter &p, const ViewItemPaintParams &pp)
 {
-	QLineF *line;
+	// The geometry is normally prepared on a worker thread beforehand
+	if (!paint_prepared_)
+		prepare_paint_mid(pp);
+	if (!paint_prepared_)
+		return;
 
-	vector< pair<int64_t, bool> > edges;
+	paint_prepared_ = false;
 
-	assert(channel_);
-	assert(data_);
-	assert(owner_);
+	tile_cache_.paint(p, pp, get_visual_y());
+}
 
-	const int y = get_visual_y();
+void LogicSignal::paint_fore(QPainter &p, const ViewItemPaintParams &pp)
+{
+	paint_cursor_measurement(p, pp);
 
-	if (!channel_->enabled())
+	// Draw the trigger marker
+	if (!trigger_match_)
 		return;
 
-	const float high_offset = y - SignalHeight + 0.5f;
-	const float low_offset = y + 0.5f;
+	const int y = get_visual_y();
+	const vector<int32_t> trig_types = get_trigger_types();
+	for (int32_t type_id : trig_types) {
+		const TriggerMatchType *const type =
+			TriggerMatchType::get(type_id);
+		if (trigger_match_ != type || type_id < 0 ||
+			(size_t)type_id >= countof(TriggerMarkerIcons) ||
+			!TriggerMarkerIcons[type_id])
+			continue;
+
+		const QPixmap *const pixmap = get_pixmap(
+			TriggerMarkerIcons[type_id]);
+		if (!pixmap)
+			continue;
+
+		const float pad = TriggerMarkerPadding - 0.5f;
+		const QSize size = pixmap->size();
+		const QPoint point(
+			pp.right() - size.width() - pad * 2,
+			y - (SignalHeight + size.height()) / 2);
+
+		p.setPen(QPen(TriggerMarkerBackgroundColour.darker()));
+		p.setBrush(TriggerMarkerBackgroundColour);
+		p.drawRoundedRect(QRectF(point, size).adjusted(
+			-pad, -pad, pad, pad), pad, pad);
+		p.drawPixmap(point, *pixmap);
+
+		break;
+	}
+}
+
+QString LogicSignal::cursor_measurement(const pv::util::Timestamp &start,
+	const pv::util::Timestamp &end) const
+{
+	assert(data_);
 
 	const deque< shared_ptr<pv::data::LogicSegment> > &segments =
 		data_->logic_segments();
 	if (segments.empty())
-		return;
+		return QString();
+
+	const shared_ptr<pv::data::LogicSegment> &segment = segments.front();
+	if (channel_->index() >= segment->unit_size() * 8)
+		return QString();
+
+	int64_t first, last;
+	if (!get_cursor_samples(segment, start, end, first, last))
+		return QString();
+
+	// Channels which change too often to be indexed are not counted
+	const boost::optional<uint64_t> count = segment->get_edge_count(
+		first, last, channel_->index());
+	return count ? tr("%1 edges").arg(*count) : QString();
+}
+
+void LogicSignal::prepare_paint_mid(const ViewItemPaintParams &pp)
+{
+	prepare_paint_mid(vector<LogicSignal*>(1, this), pp);
+}
+
+void LogicSignal::prepare_paint_mid(const vector<LogicSignal*> &group,
+	const ViewItemPaintParams &pp)
+{
+	// Group the signals by their data
+	map< shared_ptr<data::Logic>, vector<LogicSignal*> > groups;
+	for (LogicSignal *const s : group) {
+		assert(s);
+		assert(s->data_);
+		s->paint_prepared_ = false;
+		if (s->channel_->enabled() && s->channel_->index() < 64)
+			groups[s->data_].push_back(s);
+	}
+
+	for (const auto &g : groups) {
+		const deque< shared_ptr<pv::data::LogicSegment> > &segments =
+			g.first->logic_segments();
+		if (segments.empty())
+			continue;
 
-	const shared_ptr<pv::data::LogicSegment> &segment =
-		segments.front();
+		const shared_ptr<pv::data::LogicSegment> &segment =
+			segments.front();
+
+		double samplerate = segment->samplerate();
+		if (samplerate == 0.0)
+			samplerate = 1.0;
+		const pv::util::Timestamp data_end = segment->start_time() +
+			((double)segment->get_sample_count() - 1) / samplerate;
+
+		// Gather the signals that are missing each tile
+		map<int64_t, uint64_t> missing_tiles;
+		for (LogicSignal *const s : g.second) {
+			s->tile_cache_.validate(pp.scale(), segment, data_end);
+			for (int64_t index : s->tile_cache_.missing_tiles(
+				pp, s->get_visual_y()))
+				missing_tiles[index] |=
+					1ULL << s->channel_->index();
+			s->paint_prepared_ = true;
+		}
+
+		for (const auto &m : missing_tiles) {
+			const ViewItemPaintParams tp =
+				TileCache::tile_params(m.first, pp);
+
+			int64_t start_sample, end_sample;
+			double samples_per_pixel;
+			get_sample_range(segment, tp, start_sample, end_sample,
+				samples_per_pixel);
+
+			vector< vector< pair<int64_t, bool> > > edges;
+			segment->get_subsampled_edges(edges, start_sample,
+				end_sample, samples_per_pixel / Oversampling,
+				m.second);
+
+			for (LogicSignal *const s : g.second)
+				if (m.second & (1ULL << s->channel_->index()))
+					s->render_tile(m.first,
+						edges[s->channel_->index()],
+						pp, samples_per_pixel);
+		}
+	}
+}
 
+void LogicSignal::get_sample_range(
+	const shared_ptr<pv::data::LogicSegment> &segment,
+	const ViewItemPaintParams &pp, int64_t &start_sample,
+	int64_t &end_sample, double &samples_per_pixel)
+{
 	double samplerate = segment->samplerate();
 
 	// Show sample rate as 1Hz when it is unknown
 	if (samplerate == 0.0)
 		samplerate = 1.0;
 
-	const double pixels_offset = pp.pixels_offset();
 	const pv::util::Timestamp& start_time = segment->start_time();
 	const int64_t last_sample = segment->get_sample_count() - 1;
-	const double samples_per_pixel = samplerate * pp.scale();
+	samples_per_pixel = samplerate * pp.scale();
 	const pv::util::Timestamp start = samplerate * (pp.offset() - start_time);
 	const pv::util::Timestamp end = start + samples_per_pixel * pp.width();
 
-	const int64_t start_sample = min(max(floor(start).convert_to<int64_t>(),
+	start_sample = min(max(floor(start).convert_to<int64_t>(),
 		(int64_t)0), last_sample);
-	const uint64_t end_sample = min(max(ceil(end).convert_to<int64_t>(),
+	end_sample = min(max(ceil(end).convert_to<int64_t>(),
 		(int64_t)0), last_sample);
+}
 
-	segment->get_subsampled_edges(edges, start_sample, end_sample,
-		samples_per_pixel / Oversampling, channel_->index());
+void LogicSignal::build_geometry(
+	const vector< pair<int64_t, bool> > &edges,
+	const ViewItemPaintParams &pp, double samples_per_pixel)
+{
+	assert(owner_);
 	assert(edges.size() >= 2);
 
-	// Paint the edges
-	const unsigned int edge_count = edges.size() - 2;
-	QLineF *const edge_lines = new QLineF[edge_count];
-	line = edge_lines;
+	const int y = get_visual_y();
+	const float high_offset = y - SignalHeight + 0.5f;
+	const float low_offset = y + 0.5f;
+	const double pixels_offset = pp.pixels_offset();
 
+	// Build the edges
+	edge_lines_.clear();
 	for (auto i = edges.cbegin() + 1; i != edges.cend() - 1; i++) {
 		const float x = ((*i).first / samples_per_pixel -
 			pixels_offset) + pp.left();
-		*line++ = QLineF(x, high_offset, x, low_offset);
+		edge_lines_.push_back(QLineF(x, high_offset, x, low_offset));
 	}
 
-	p.setPen(EdgeColour);
-	p.drawLines(edge_lines, edge_count);
-	delete[] edge_lines;
-
-	// Paint the caps
-	const unsigned int max_cap_line_count = edges.size();
-	QLineF *const cap_lines = new QLineF[max_cap_line_count];
-
-	p.setPen(HighColour);
-	paint_caps(p, cap_lines, edges, true, samples_per_pixel,
+	// Build the caps
+	build_caps(high_cap_lines_, edges, true, samples_per_pixel,
 		pixels_offset, pp.left(), high_offset);
-	p.setPen(LowColour);
-	paint_caps(p, cap_lines, edges, false, samples_per_pixel,
+	build_caps(low_cap_lines_, edges, false, samples_per_pixel,
 		pixels_offset, pp.left(), low_offset);
-
-	delete[] cap_lines;
 }
 
-void LogicSignal::paint_fore(QPainter &p, const ViewItemPaintParams &pp)
+void LogicSignal::render_tile(int64_t index,
+	const vector< pair<int64_t, bool> > &edges,
+	const ViewItemPaintParams &pp, double samples_per_pixel)
 {
-	// Draw the trigger marker
-	if (!trigger_match_)
-		return;
+	const ViewItemPaintParams tp = TileCache::tile_params(index, pp);
+	build_geometry(edges, tp, samples_per_pixel);
 
 	const int y = get_visual_y();
-	const vector<int32_t> trig_types = get_trigger_types();
-	for (int32_t type_id : trig_types) {
-		const TriggerMatchType *const type =
-			TriggerMatchType::get(type_id);
-		if (trigger_match_ != type || type_id < 0 ||
-			(size_t)type_id >= countof(TriggerMarkerIcons) ||
-			!TriggerMarkerIcons[type_id])
-			continue;
-
-		const QPixmap *const pixmap = get_pixmap(
-			TriggerMarkerIcons[type_id]);
-		if (!pixmap)
-			continue;
-
-		const float pad = TriggerMarkerPadding - 0.5f;
-		const QSize size = pixmap->size();
-		const QPoint point(
-			pp.right() - size.width() - pad * 2,
-			y - (SignalHeight + size.height()) / 2);
-
-		p.setPen(QPen(TriggerMarkerBackgroundColour.darker()));
-		p.setBrush(TriggerMarkerBackgroundColour);
-		p.drawRoundedRect(QRectF(point, size).adjusted(
-			-pad, -pad, pad, pad), pad, pad);
-		p.drawPixmap(point, *pixmap);
+	const pair<int, int> extents = v_extents();
+	tile_cache_.render_tile(index, pp, y,
+		QRectF(0, y + extents.first, TileCache::TileWidth,
+			extents.second - extents.first),
+		[this](QPainter &p) { paint_geometry(p); });
+}
 
-		break;
-	}
+void LogicSignal::paint_geometry(QPainter &p) const
+{
+	p.setPen(EdgeColour);
+	p.drawLines(edge_lines_.data(), edge_lines_.size());
+	p.setPen(HighColour);
+	p.drawLines(high_cap_lines_.data(), high_cap_lines_.size());
+	p.setPen(LowColour);
+	p.drawLines(low_cap_lines_.data(), low_cap_lines_.size());
 }
 
-void LogicSignal::paint_caps(QPainter &p, QLineF *const lines,
-	vector< pair<int64_t, bool> > &edges, bool level,
+void LogicSignal::build_caps(vector<QLineF> &lines,
+	const vector< pair<int64_t, bool> > &edges, bool level,
 	double samples_per_pixel, double pixels_offset, float x_offset,
 	float y_offset)
 {
-	QLineF *line = lines;
+	lines.clear();
 
 	for (auto i = edges.begin(); i != (edges.end() - 1); i++)
 		if ((*i).second == level) {
-			*line++ = QLineF(
+			lines.push_back(QLineF(
 				((*i).first / samples_per_pixel -
 					pixels_offset) + x_offset, y_offset,
 				((*(i+1)).first / samples_per_pixel -
-					pixels_offset) + x_offset, y_offset);
+					pixels_offset) + x_offset, y_offset));
 		}
-
-	p.drawLines(lines, line - lines);
 }
 
 void LogicSignal::init_trigger_actions(QWidget *parent)
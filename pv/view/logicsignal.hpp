@@ -22,10 +22,13 @@
 #define PULSEVIEW_PV_VIEW_LOGICSIGNAL_HPP
 
 #include <QCache>
+#include <QLineF>
 
 #include "signal.hpp"
+#include "tilecache.hpp"
 
 #include <memory>
+#include <vector>
 
 class QIcon;
 class QToolBar;
@@ -42,6 +45,7 @@ class Device;
 
 namespace data {
 class Logic;
+class LogicSegment;
 }
 
 namespace view {
@@ -93,6 +97,23 @@ public:
 	 **/
 	void paint_back(QPainter &p, const ViewItemPaintParams &pp);
 
+	/**
+	 * Prepares the mid-layer of the signal for painting, by rendering
+	 * the tiles that are missing from the tile cache.
+	 * @param pp the painting parameters object that will be painted with.
+	 **/
+	void prepare_paint_mid(const ViewItemPaintParams &pp);
+
+	/**
+	 * Prepares the mid-layer of several signals for painting. The edges
+	 * of signals which share their logic data are fetched in one batch
+	 * for each missing tile.
+	 * @param group the signals to prepare.
+	 * @param pp the painting parameters object that will be painted with.
+	 **/
+	static void prepare_paint_mid(const std::vector<LogicSignal*> &group,
+		const ViewItemPaintParams &pp);
+
 	/**
 	 * Paints the mid-layer of the signal with a QPainter
 	 * @param p the QPainter to paint into.
@@ -107,9 +128,32 @@ public:
 	 **/
 	virtual void paint_fore(QPainter &p, const ViewItemPaintParams &pp);
 
+protected:
+	/**
+	 * Counts the edges of the signal between the cursors, from the
+	 * transition index of the segment.
+	 */
+	QString cursor_measurement(const pv::util::Timestamp &start,
+		const pv::util::Timestamp &end) const;
+
 private:
-	void paint_caps(QPainter &p, QLineF *const lines,
-		std::vector< std::pair<int64_t, bool> > &edges,
+	static void get_sample_range(
+		const std::shared_ptr<pv::data::LogicSegment> &segment,
+		const ViewItemPaintParams &pp, int64_t &start_sample,
+		int64_t &end_sample, double &samples_per_pixel);
+
+	void build_geometry(
+		const std::vector< std::pair<int64_t, bool> > &edges,
+		const ViewItemPaintParams &pp, double samples_per_pixel);
+
+	void render_tile(int64_t index,
+		const std::vector< std::pair<int64_t, bool> > &edges,
+		const ViewItemPaintParams &pp, double samples_per_pixel);
+
+	void paint_geometry(QPainter &p) const;
+
+	static void build_caps(std::vector<QLineF> &lines,
+		const std::vector< std::pair<int64_t, bool> > &edges,
 		bool level, double samples_per_pixel, double pixels_offset,
 		float x_offset, float y_offset);
 
@@ -133,6 +177,12 @@ private:
 	std::shared_ptr<pv::devices::Device> device_;
 	std::shared_ptr<pv::data::Logic> data_;
 
+	std::vector<QLineF> edge_lines_;
+	std::vector<QLineF> high_cap_lines_;
+	std::vector<QLineF> low_cap_lines_;
+	TileCache tile_cache_;
+	bool paint_prepared_;
+
 	const sigrok::TriggerMatchType *trigger_match_;
 	QToolBar *trigger_bar_;
 	QAction *trigger_none_;
@@ -23,6 +23,8 @@
 #include <assert.h>
 #include <cmath>
 
+#include <algorithm>
+
 #include <QApplication>
 #include <QFormLayout>
 #include <QKeyEvent>
@@ -31,10 +33,17 @@
 
 #include <libsigrokcxx/libsigrokcxx.hpp>
 
+#include "cursor.hpp"
+#include "cursorpair.hpp"
 #include "signal.hpp"
 #include "view.hpp"
 
+#include <pv/data/segment.hpp>
+
+using std::max;
+using std::min;
 using std::shared_ptr;
+using std::swap;
 
 using sigrok::Channel;
 
@@ -58,6 +67,8 @@ const char *const ChannelNames[] = {
 	"SCL"
 };
 
+const int Signal::MeasurementPadding = 4;
+
 Signal::Signal(pv::Session &session,
 	std::shared_ptr<sigrok::Channel> channel) :
 	Trace(QString::fromUtf8(channel->name().c_str())),
@@ -144,6 +155,68 @@ void Signal::delete_pressed()
 	on_disable();
 }
 
+QString Signal::cursor_measurement(const pv::util::Timestamp&,
+	const pv::util::Timestamp&) const
+{
+	return QString();
+}
+
+void Signal::paint_cursor_measurement(QPainter &p,
+	const ViewItemPaintParams &pp) const
+{
+	if (!owner_ || !channel_->enabled())
+		return;
+
+	const View *const view = owner_->view();
+	assert(view);
+	if (!view->cursors_shown())
+		return;
+
+	const shared_ptr<CursorPair> cursors = view->cursors();
+	pv::util::Timestamp start = cursors->first()->time();
+	pv::util::Timestamp end = cursors->second()->time();
+	if (end < start)
+		swap(start, end);
+
+	const QString text = cursor_measurement(start, end);
+	if (text.isEmpty())
+		return;
+
+	const int y = get_visual_y();
+	const std::pair<int, int> extents = v_extents();
+	const float x = ((end - pp.offset()) / pp.scale()).convert_to<float>() +
+		pp.left() + MeasurementPadding;
+
+	p.setPen(Cursor::FillColour.darker());
+	p.drawText(QRectF(x, y + extents.first, pp.right() - x,
+		extents.second - extents.first),
+		Qt::AlignLeft | Qt::AlignVCenter, text);
+}
+
+bool Signal::get_cursor_samples(const shared_ptr<pv::data::Segment> &segment,
+	const pv::util::Timestamp &start, const pv::util::Timestamp &end,
+	int64_t &first, int64_t &last)
+{
+	assert(segment);
+
+	double samplerate = segment->samplerate();
+	if (samplerate == 0.0)
+		samplerate = 1.0;
+
+	const int64_t sample_count = segment->get_sample_count();
+	if (sample_count == 0)
+		return false;
+
+	const pv::util::Timestamp start_sample =
+		samplerate * (start - segment->start_time());
+	const pv::util::Timestamp end_sample =
+		samplerate * (end - segment->start_time());
+
+	first = max(ceil(start_sample).convert_to<int64_t>(), (int64_t)0);
+	last = min(floor(end_sample).convert_to<int64_t>(), sample_count - 1);
+	return first <= last;
+}
+
 void Signal::on_disable()
 {
 	enable(false);
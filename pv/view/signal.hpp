@@ -28,6 +28,8 @@
 
 #include <stdint.h>
 
+#include <pv/util.hpp>
+
 #include "trace.hpp"
 
 namespace sigrok {
@@ -39,6 +41,7 @@ namespace pv {
 class Session;
 
 namespace data {
+class Segment;
 class SignalData;
 }
 
@@ -48,6 +51,9 @@ class Signal : public Trace
 {
 	Q_OBJECT
 
+private:
+	static const int MeasurementPadding;
+
 protected:
 	Signal(pv::Session &session,
 		std::shared_ptr<sigrok::Channel> channel);
@@ -75,6 +81,37 @@ public:
 
 	void delete_pressed();
 
+protected:
+	/**
+	 * Gets a measurement of the samples of the signal between the
+	 * cursors, which is shown beside the later cursor.
+	 * @param start The time of the earlier cursor.
+	 * @param end The time of the later cursor.
+	 * @return The text of the measurement, or an empty string if there
+	 * is none.
+	 */
+	virtual QString cursor_measurement(const pv::util::Timestamp &start,
+		const pv::util::Timestamp &end) const;
+
+	/**
+	 * Paints the measurement between the cursors, if they are shown.
+	 * @param p the QPainter to paint into.
+	 * @param pp the painting parameters object to paint with.
+	 */
+	void paint_cursor_measurement(QPainter &p,
+		const ViewItemPaintParams &pp) const;
+
+	/**
+	 * Gets the samples of a segment that lie between two times.
+	 * @param[out] first The first sample after @c start .
+	 * @param[out] last The last sample before @c end .
+	 * @return false if no sample lies between the times.
+	 */
+	static bool get_cursor_samples(
+		const std::shared_ptr<pv::data::Segment> &segment,
+		const pv::util::Timestamp &start,
+		const pv::util::Timestamp &end, int64_t &first, int64_t &last);
+
 private Q_SLOTS:
 	void on_disable();
 
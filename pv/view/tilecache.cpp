@@ -0,0 +1,174 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include <QPainter>
+
+#include "tilecache.hpp"
+#include "viewitempaintparams.hpp"
+
+using std::floor;
+using std::max;
+using std::min;
+using std::numeric_limits;
+using std::shared_ptr;
+using std::vector;
+
+namespace pv {
+namespace view {
+
+const int TileCache::TileWidth = 256;
+
+TileCache::TileCache() :
+	scale_(0.0),
+	data_end_(0.0)
+{
+}
+
+void TileCache::clear()
+{
+	tiles_.clear();
+	data_.reset();
+}
+
+void TileCache::validate(double scale, const shared_ptr<const void> &data,
+	const pv::util::Timestamp &data_end)
+{
+	assert(scale > 0.0);
+
+	const double end = (data_end / scale).convert_to<double>();
+
+	if (scale != scale_ || data != data_.lock() || end < data_end_) {
+		tiles_.clear();
+	} else if (end != data_end_) {
+		// The contents of the tiles from the last sample onwards
+		// depend on the samples that have been appended since
+		tiles_.erase(tiles_.lower_bound(
+			(int64_t)floor(data_end_ / TileWidth)), tiles_.end());
+	}
+
+	scale_ = scale;
+	data_ = data;
+	data_end_ = end;
+}
+
+vector<int64_t> TileCache::missing_tiles(const ViewItemPaintParams &pp,
+	int y) const
+{
+	vector<int64_t> missing;
+
+	int64_t first, last;
+	get_tile_range(pp, first, last);
+
+	const int need_top = pp.top() - y;
+	const int need_bottom = pp.bottom() + 1 - y;
+
+	for (int64_t i = first; i <= last; i++) {
+		const auto iter = tiles_.find(i);
+		if (iter == tiles_.end() ||
+			(*iter).second.clip_top > need_top ||
+			(*iter).second.clip_bottom < need_bottom)
+			missing.push_back(i);
+	}
+
+	return missing;
+}
+
+ViewItemPaintParams TileCache::tile_params(int64_t index,
+	const ViewItemPaintParams &pp)
+{
+	return ViewItemPaintParams(QRect(0, pp.top(), TileWidth, pp.height()),
+		pp.scale(), pv::util::Timestamp(index * TileWidth) * pp.scale());
+}
+
+void TileCache::render_tile(int64_t index, const ViewItemPaintParams &pp,
+	int y, const QRectF &bounds, PaintFunction paint)
+{
+	// Leave room for anti-aliasing around the contents
+	const QRect r = bounds.adjusted(-1, -1, 1, 1).toAlignedRect();
+
+	// Clip the tile to the view, with a margin of one view height on
+	// each side, so that tall traces do not require huge images
+	const int clip_top = pp.top() - pp.height();
+	const int clip_bottom = pp.bottom() + 1 + pp.height();
+	const int top = max(r.top(), clip_top);
+	const int bottom = min(r.bottom() + 1, clip_bottom);
+
+	Tile &tile = tiles_[index];
+	tile.top = top - y;
+	tile.clip_top = (r.top() < clip_top) ?
+		clip_top - y : numeric_limits<int>::min();
+	tile.clip_bottom = (r.bottom() + 1 > clip_bottom) ?
+		clip_bottom - y : numeric_limits<int>::max();
+
+	if (top >= bottom) {
+		tile.image = QImage();
+		return;
+	}
+
+	tile.image = QImage(TileWidth, bottom - top,
+		QImage::Format_ARGB32_Premultiplied);
+	tile.image.fill(Qt::transparent);
+
+	QPainter p(&tile.image);
+	p.setRenderHint(QPainter::Antialiasing);
+	p.translate(0, -top);
+	paint(p);
+}
+
+void TileCache::paint(QPainter &p, const ViewItemPaintParams &pp, int y)
+{
+	int64_t first, last;
+	get_tile_range(pp, first, last);
+
+	// Tiles are placed on whole pixels, so that they are blitted
+	// without resampling
+	const int64_t shift = (int64_t)floor(0.5 - pp.pixels_offset());
+
+	for (int64_t i = first; i <= last; i++) {
+		const auto iter = tiles_.find(i);
+		if (iter == tiles_.end() || (*iter).second.image.isNull())
+			continue;
+
+		const Tile &tile = (*iter).second;
+		p.drawImage(QPoint(pp.left() + i * TileWidth + shift,
+			y + tile.top), tile.image);
+	}
+
+	// Drop the tiles that are more than a view width out of view
+	const int64_t margin = last - first + 1;
+	tiles_.erase(tiles_.begin(), tiles_.lower_bound(first - margin));
+	tiles_.erase(tiles_.upper_bound(last + margin), tiles_.end());
+}
+
+void TileCache::get_tile_range(const ViewItemPaintParams &pp,
+	int64_t &first, int64_t &last)
+{
+	const double pixels_offset = pp.pixels_offset();
+	first = (int64_t)floor(pixels_offset / TileWidth);
+	last = (int64_t)floor((pixels_offset + pp.width()) / TileWidth);
+}
+
+} // namespace view
+} // namespace pv
@@ -0,0 +1,156 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef PULSEVIEW_PV_VIEW_TILECACHE_HPP
+#define PULSEVIEW_PV_VIEW_TILECACHE_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+#include <QImage>
+#include <QRectF>
+
+#include "pv/util.hpp"
+
+class QPainter;
+
+namespace pv {
+namespace view {
+
+class ViewItemPaintParams;
+
+/**
+ * A cache of pre-rendered strips of a trace.
+ *
+ * The time axis is divided into tiles of @c TileWidth pixels at the
+ * current scale. Tile @c n spans the time from @c n*TileWidth*scale to
+ * @c (n+1)*TileWidth*scale, so that the tiles stay valid while the view
+ * is panned, and only the newly exposed tiles have to be rendered.
+ * Tiles are stored relative to the visual y-offset of the trace, and so
+ * remain valid when the trace is moved vertically.
+ */
+class TileCache
+{
+public:
+	/**
+	 * The width of each tile in pixels.
+	 */
+	static const int TileWidth;
+
+	/**
+	 * A function that paints the contents of a tile.
+	 */
+	typedef std::function<void (QPainter&)> PaintFunction;
+
+private:
+	struct Tile
+	{
+		QImage image;
+
+		/// The top of the image relative to the trace y-offset.
+		int top;
+
+		/// The vertical span relative to the trace y-offset that the
+		/// image is complete within.
+		int clip_top, clip_bottom;
+	};
+
+public:
+	TileCache();
+
+	/**
+	 * Drops all the tiles. This must be called when the appearance of
+	 * the trace changes.
+	 */
+	void clear();
+
+	/**
+	 * Drops the tiles that are out of date with the view or the data.
+	 * When the data has been extended, only the tiles from the one
+	 * that contained the previous last sample onwards are dropped.
+	 * @param scale the scale of the view in seconds per pixel.
+	 * @param data the data being rendered. The cache only holds a weak
+	 * reference to it, so that new data is never mistaken for data that
+	 * has been freed from the same address.
+	 * @param data_end the time of the last sample of the data.
+	 */
+	void validate(double scale, const std::shared_ptr<const void> &data,
+		const pv::util::Timestamp &data_end);
+
+	/**
+	 * Lists the tiles needed to paint a view that are not in the cache.
+	 * @param pp the painting parameters of the view.
+	 * @param y the visual y-offset of the trace.
+	 * @return the indices of the missing tiles.
+	 */
+	std::vector<int64_t> missing_tiles(const ViewItemPaintParams &pp,
+		int y) const;
+
+	/**
+	 * Gets the painting parameters with which to build the contents
+	 * of a tile. The rectangle spans the tile horizontally and the view
+	 * vertically.
+	 * @param index the index of the tile.
+	 * @param pp the painting parameters of the view.
+	 */
+	static ViewItemPaintParams tile_params(int64_t index,
+		const ViewItemPaintParams &pp);
+
+	/**
+	 * Renders a tile into the cache.
+	 * @param index the index of the tile.
+	 * @param pp the painting parameters of the view.
+	 * @param y the visual y-offset of the trace.
+	 * @param bounds the bounding rectangle of the tile contents, in the
+	 * coordinates given by @c tile_params .
+	 * @param paint the function that paints the tile contents.
+	 */
+	void render_tile(int64_t index, const ViewItemPaintParams &pp, int y,
+		const QRectF &bounds, PaintFunction paint);
+
+	/**
+	 * Paints the cached tiles which are in view, and drops tiles that
+	 * are far out of view.
+	 * @param p the QPainter to paint into.
+	 * @param pp the painting parameters of the view.
+	 * @param y the visual y-offset of the trace.
+	 */
+	void paint(QPainter &p, const ViewItemPaintParams &pp, int y);
+
+private:
+	static void get_tile_range(const ViewItemPaintParams &pp,
+		int64_t &first, int64_t &last);
+
+private:
+	std::map<int64_t, Tile> tiles_;
+
+	double scale_;
+	std::weak_ptr<const void> data_;
+	double data_end_;
+};
+
+} // namespace view
+} // namespace pv
+
+#endif // PULSEVIEW_PV_VIEW_TILECACHE_HPP
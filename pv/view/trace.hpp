@@ -71,7 +71,7 @@ public:
 	/**
 	 * Set the colour of the signal.
 	 */
-	void set_colour(QColor colour);
+	virtual void set_colour(QColor colour);
 
 	/**
 	 * Computes the outline rectangle of the viewport hit-box.
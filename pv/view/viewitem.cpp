@@ -93,6 +93,11 @@ void ViewItem::paint_back(QPainter &p, const ViewItemPaintParams &pp)
 	(void)pp;
 }
 
+void ViewItem::prepare_paint_mid(const ViewItemPaintParams &pp)
+{
+	(void)pp;
+}
+
 void ViewItem::paint_mid(QPainter &p, const ViewItemPaintParams &pp)
 {
 	(void)p;
@@ -123,6 +123,15 @@ public:
 	 **/
 	virtual void paint_back(QPainter &p, const ViewItemPaintParams &pp);
 
+	/**
+	 * Prepares the mid-layer of the item for painting. This is called
+	 * from a worker thread before paint_mid(), while the GUI thread waits
+	 * for it. It may query the data layer and build geometry, but must
+	 * not paint or touch any widgets.
+	 * @param pp the painting parameters object that will be painted with.
+	 **/
+	virtual void prepare_paint_mid(const ViewItemPaintParams &pp);
+
 	/**
 	 * Paints the mid-layer of the item with a QPainter
 	 * @param p the QPainter to paint into.
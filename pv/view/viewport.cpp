@@ -21,21 +21,28 @@
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <functional>
 #include <limits>
+#include <map>
 
+#include "logicsignal.hpp"
 #include "signal.hpp"
 #include "view.hpp"
 #include "viewitempaintparams.hpp"
 #include "viewport.hpp"
 
+#include <pv/data/logic.hpp>
 #include <pv/session.hpp>
 
 #include <QMouseEvent>
+#include <QRunnable>
 
 using std::abs;
 using std::back_inserter;
 using std::copy;
 using std::dynamic_pointer_cast;
+using std::function;
+using std::map;
 using std::max;
 using std::min;
 using std::none_of;
@@ -47,6 +54,30 @@ using std::vector;
 namespace pv {
 namespace view {
 
+namespace {
+
+/**
+ * Runs a function on a thread pool.
+ */
+class PrepareRunnable : public QRunnable
+{
+public:
+	explicit PrepareRunnable(function<void()> f) :
+		f_(f)
+	{
+	}
+
+	void run()
+	{
+		f_();
+	}
+
+private:
+	const function<void()> f_;
+};
+
+} // anonymous namespace
+
 Viewport::Viewport(View &parent) :
 	ViewWidget(parent),
 	pinch_zoom_active_(false)
@@ -170,6 +201,8 @@ void Viewport::paintEvent(QPaintEvent*)
 	for (const shared_ptr<RowItem> r : row_items)
 		r->paint_back(p, pp);
 
+	prepare_paint_mid(row_items, pp);
+
 	for (const shared_ptr<TimeItem> t : time_items)
 		t->paint_mid(p, pp);
 	for (const shared_ptr<RowItem> r : row_items)
@@ -185,6 +218,56 @@ void Viewport::paintEvent(QPaintEvent*)
 	p.end();
 }
 
+void Viewport::prepare_paint_mid(
+	const vector< shared_ptr<RowItem> > &row_items,
+	const ViewItemPaintParams &pp)
+{
+	vector< function<void()> > jobs;
+
+	// Logic signals which share their data are prepared together, so
+	// that their edges are fetched in one batch
+	map< shared_ptr<data::Logic>, vector<LogicSignal*> > logic_groups;
+	for (const shared_ptr<RowItem> r : row_items) {
+		LogicSignal *const l = dynamic_cast<LogicSignal*>(r.get());
+		if (l)
+			logic_groups[l->logic_data()].push_back(l);
+		else
+			jobs.push_back([r, &pp]() { r->prepare_paint_mid(pp); });
+	}
+
+	// All the channels of a device share their data, so each group is
+	// split into a part for each thread. Each part fetches the edges of
+	// its own channels in a batch, and a signal is only ever prepared by
+	// one thread, since its geometry is built in its members
+	const size_t thread_count = max(paint_pool_.maxThreadCount(), 1);
+	vector< vector<LogicSignal*> > parts;
+	for (const auto &g : logic_groups) {
+		const vector<LogicSignal*> &group = g.second;
+		const size_t part_count = min(thread_count, group.size());
+		for (size_t i = 0; i < part_count; i++) {
+			parts.push_back(vector<LogicSignal*>());
+			for (size_t j = i; j < group.size(); j += part_count)
+				parts.back().push_back(group[j]);
+		}
+	}
+
+	for (const vector<LogicSignal*> &part : parts)
+		jobs.push_back([&part, &pp]() {
+			LogicSignal::prepare_paint_mid(part, pp); });
+
+	if (jobs.empty())
+		return;
+
+	// The GUI thread runs the last job itself, rather than only waiting
+	// for the pool
+	for (auto i = jobs.cbegin(); i != jobs.cend() - 1; i++)
+		paint_pool_.start(new PrepareRunnable(*i));
+	jobs.back()();
+
+	// The items are not modified while the GUI thread waits here
+	paint_pool_.waitForDone();
+}
+
 void Viewport::mouseDoubleClickEvent(QMouseEvent *event)
 {
 	assert(event);
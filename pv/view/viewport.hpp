@@ -23,6 +23,7 @@
 
 #include <boost/optional.hpp>
 
+#include <QThreadPool>
 #include <QTimer>
 #include <QTouchEvent>
 
@@ -36,7 +37,9 @@ class Session;
 namespace pv {
 namespace view {
 
+class RowItem;
 class View;
+class ViewItemPaintParams;
 
 class Viewport : public ViewWidget
 {
@@ -89,6 +92,16 @@ private:
 	 */
 	bool touch_event(QTouchEvent *e);
 
+	/**
+	 * Prepares the mid-layer geometry of the rows on the paint thread
+	 * pool, and waits for all of them to finish.
+	 * @param row_items the rows that are about to be painted.
+	 * @param pp the painting parameters object.
+	 */
+	void prepare_paint_mid(
+		const std::vector< std::shared_ptr<RowItem> > &row_items,
+		const ViewItemPaintParams &pp);
+
 private:
 	void paintEvent(QPaintEvent *event);
 
@@ -101,6 +114,8 @@ private:
 	double pinch_offset0_;
 	double pinch_offset1_;
 	bool pinch_zoom_active_;
+
+	QThreadPool paint_pool_;
 };
 
 } // namespace view
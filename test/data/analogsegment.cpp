@@ -21,12 +21,474 @@
 #include <extdef.h>
 
 #include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
 #include <pv/data/analogsegment.hpp>
 
 using pv::data::AnalogSegment;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(AnalogSegmentTest)
+
+bool equal_envelopes(const AnalogSegment::EnvelopeSample *a,
+	const AnalogSegment::EnvelopeSample *b, uint64_t length)
+{
+	for (uint64_t i = 0; i < length; i++)
+		if (a[i].min != b[i].min || a[i].max != b[i].max)
+			return false;
+	return true;
+}
+
+vector<float> make_random_samples(uint64_t sample_count)
+{
+	vector<float> data(sample_count);
+	for (float &f : data)
+		f = (rand() - RAND_MAX / 2) / 1000.0f;
+	return data;
+}
+
+/*
+ * Checks that every vectorised envelope kernel produces exactly the same
+ * output as the scalar kernels, for each of the supported block lengths.
+ * The data is processed in several calls with varying block counts, to
+ * exercise the handling of the blocks that remain after the unrolled
+ * loops.
+ */
+BOOST_AUTO_TEST_CASE(EnvelopeKernels)
+{
+	const uint64_t BlockCount = 4099;
+	const unsigned int BlockLengths[] = {16, 64, 256};
+	const AnalogSegment::EnvelopeKernelSet Sets[] = {
+		AnalogSegment::SSEKernels,
+		AnalogSegment::NEONKernels
+	};
+
+	srand(0);
+
+	AnalogSegment::EnvelopeKernel scalar;
+	AnalogSegment::EnvelopeReduceKernel scalar_reduce;
+	BOOST_REQUIRE(AnalogSegment::envelope_kernels(
+		AnalogSegment::ScalarKernels, scalar, scalar_reduce));
+
+	for (unsigned int BlockLength : BlockLengths) {
+		const vector<float> data = make_random_samples(
+			BlockCount * BlockLength);
+
+		vector<AnalogSegment::EnvelopeSample> expected(BlockCount);
+		scalar(data.data(), expected.data(), BlockCount, BlockLength);
+
+		const uint64_t ReducedCount = BlockCount / BlockLength;
+		vector<AnalogSegment::EnvelopeSample> expected_reduced(
+			ReducedCount);
+		scalar_reduce(expected.data(), expected_reduced.data(),
+			ReducedCount, BlockLength);
+
+		// Check the scalar kernel itself against a plain reduction
+		for (uint64_t b = 0; b < BlockCount; b++) {
+			const float *const block = data.data() + b * BlockLength;
+			BOOST_CHECK_EQUAL(expected[b].min,
+				*std::min_element(block, block + BlockLength));
+			BOOST_CHECK_EQUAL(expected[b].max,
+				*std::max_element(block, block + BlockLength));
+		}
+
+		for (AnalogSegment::EnvelopeKernelSet set : Sets) {
+			AnalogSegment::EnvelopeKernel kernel;
+			AnalogSegment::EnvelopeReduceKernel reduce;
+			if (!AnalogSegment::envelope_kernels(set, kernel, reduce))
+				continue;
+
+			vector<AnalogSegment::EnvelopeSample> result(BlockCount);
+			for (uint64_t block = 0, count = 1; block < BlockCount;
+				block += count, count = count * 3 + 1) {
+				count = std::min(count, BlockCount - block);
+				kernel(data.data() + block * BlockLength,
+					result.data() + block, count, BlockLength);
+			}
+			BOOST_CHECK(equal_envelopes(result.data(),
+				expected.data(), BlockCount));
+
+			vector<AnalogSegment::EnvelopeSample> reduced(
+				ReducedCount);
+			reduce(expected.data(), reduced.data(), ReducedCount,
+				BlockLength);
+			BOOST_CHECK(equal_envelopes(reduced.data(),
+				expected_reduced.data(), ReducedCount));
+		}
+	}
+}
+
+/*
+ * Compares the throughput of the envelope kernel sets when building the
+ * envelope of a segment, in packets of the size delivered by the sampling
+ * thread. The timings are reported as test messages (run with
+ * --log_level=message).
+ */
+struct EnvelopeBenchmark
+{
+	typedef std::chrono::steady_clock Clock;
+
+	static double build(AnalogSegment &s,
+		AnalogSegment::EnvelopeKernelSet set, const vector<float> &data)
+	{
+		const size_t PacketLength = 64 * 1024;
+
+		if (!AnalogSegment::envelope_kernels(set, s.envelope_kernel_,
+			s.envelope_reduce_kernel_))
+			return 0.0;
+
+		const Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < data.size(); i += PacketLength) {
+			const size_t count = std::min(PacketLength,
+				data.size() - i);
+			s.append_interleaved_samples(data.data() + i, count, 1);
+		}
+		return std::chrono::duration<double, std::milli>(
+			Clock::now() - start).count();
+	}
+
+	static double reduce(AnalogSegment::EnvelopeKernelSet set,
+		const vector<float> &data)
+	{
+		AnalogSegment::EnvelopeKernel kernel;
+		AnalogSegment::EnvelopeReduceKernel reduce_kernel;
+		if (!AnalogSegment::envelope_kernels(set, kernel, reduce_kernel))
+			return 0.0;
+
+		const unsigned int BlockLength = 16;
+		vector<AnalogSegment::EnvelopeSample> envelope(
+			data.size() / BlockLength);
+
+		const Clock::time_point start = Clock::now();
+		kernel(data.data(), envelope.data(), envelope.size(),
+			BlockLength);
+		for (uint64_t length = envelope.size() / BlockLength;
+			length != 0; length /= BlockLength)
+			reduce_kernel(envelope.data(), envelope.data(), length,
+				BlockLength);
+		return std::chrono::duration<double, std::milli>(
+			Clock::now() - start).count();
+	}
+
+	static void run()
+	{
+		const uint64_t SampleCount = 1 << 24;
+		const AnalogSegment::EnvelopeKernelSet Sets[] = {
+			AnalogSegment::SSEKernels,
+			AnalogSegment::NEONKernels
+		};
+
+		const vector<float> data = make_random_samples(SampleCount);
+
+		AnalogSegment scalar_segment(1);
+		const double scalar_ms = build(scalar_segment,
+			AnalogSegment::ScalarKernels, data);
+		const double scalar_reduce_ms = reduce(
+			AnalogSegment::ScalarKernels, data);
+
+		for (AnalogSegment::EnvelopeKernelSet set : Sets) {
+			AnalogSegment s(1);
+			const double ms = build(s, set, data);
+			if (ms == 0.0)
+				continue;
+
+			for (unsigned int level = 0;
+				level < s.scale_step_count_; level++) {
+				const AnalogSegment::Envelope &a =
+					s.envelope_levels_[level];
+				const AnalogSegment::Envelope &b =
+					scalar_segment.envelope_levels_[level];
+				BOOST_REQUIRE_EQUAL(a.length, b.length);
+				BOOST_CHECK(equal_envelopes(a.samples, b.samples,
+					a.length));
+			}
+
+			const double reduce_ms = reduce(set, data);
+
+			BOOST_TEST_MESSAGE("Appending " << SampleCount <<
+				" samples: " << scalar_ms << " ms scalar, " <<
+				ms << " ms vectorised; envelope only: " <<
+				scalar_reduce_ms << " ms scalar, " <<
+				reduce_ms << " ms vectorised (" <<
+				SampleCount / (reduce_ms * 1000.0) << " MS/s)");
+		}
+	}
+};
+
+BOOST_AUTO_TEST_CASE(EnvelopeThroughput)
+{
+	srand(0);
+	EnvelopeBenchmark::run();
+}
+
+/*
+ * Checks that a read view gives in-place access to samples that span
+ * several chunks, and to the envelope.
+ */
+BOOST_AUTO_TEST_CASE(ReadView)
+{
+	const uint64_t SampleCount = 5 * 1024 * 1024 + 123;
+
+	vector<float> data(SampleCount);
+	for (uint64_t i = 0; i < SampleCount; i++)
+		data[i] = (float)(i % 1000);
+
+	AnalogSegment s(1);
+	s.append_interleaved_samples(data.data(), SampleCount, 1);
+
+	const AnalogSegment::ReadView view(s);
+	BOOST_CHECK_EQUAL(view.sample_count(), SampleCount);
+
+	// Read the samples back in runs
+	uint64_t runs = 0;
+	bool match = true;
+	for (uint64_t i = 17; i < SampleCount - 5; runs++) {
+		uint64_t count;
+		const float *const samples = view.samples(i, SampleCount - 5,
+			count);
+		BOOST_REQUIRE(count >= 1);
+		BOOST_REQUIRE(i + count <= SampleCount - 5);
+		match = match && std::equal(samples, samples + count,
+			data.begin() + i);
+		i += count;
+	}
+	BOOST_CHECK(match);
+	BOOST_CHECK(runs > 1);
+
+	// Get an envelope section of 16 samples per envelope sample
+	AnalogSegment::EnvelopeSection e;
+	view.get_envelope_section(e, 1000, 5000, 20.0f);
+	BOOST_CHECK_EQUAL(e.start, 992);
+	BOOST_CHECK_EQUAL(e.scale, 16);
+	BOOST_REQUIRE_EQUAL(e.length, 250);
+	for (uint64_t i = 0; i < e.length; i++) {
+		const float *const block = data.data() + e.start + i * e.scale;
+		BOOST_CHECK_EQUAL(e.samples[i].min,
+			*std::min_element(block, block + e.scale));
+		BOOST_CHECK_EQUAL(e.samples[i].max,
+			*std::max_element(block, block + e.scale));
+	}
+}
+
+/*
+ * Compares the statistics of random ranges, computed from the envelope,
+ * with the statistics computed from the raw samples.
+ */
+void check_statistics(const AnalogSegment &s, const vector<float> &data)
+{
+	const uint64_t sample_count = data.size();
+
+	const AnalogSegment::Statistics empty = s.get_statistics(10, 10);
+	BOOST_CHECK_EQUAL(empty.count, 0);
+
+	for (int i = 0; i < 200; i++) {
+		uint64_t start = rand() % sample_count;
+		uint64_t end = rand() % (sample_count + 1);
+		if (i == 0)
+			start = 0, end = sample_count;
+		if (start > end)
+			std::swap(start, end);
+		if (start == end)
+			continue;
+
+		float min = data[start], max = data[start];
+		double sum = 0.0, square = 0.0;
+		for (uint64_t j = start; j < end; j++) {
+			min = std::min(min, data[j]);
+			max = std::max(max, data[j]);
+			sum += data[j];
+			square += (double)data[j] * data[j];
+		}
+
+		const AnalogSegment::Statistics st =
+			s.get_statistics(start, end);
+		BOOST_CHECK_EQUAL(st.count, end - start);
+		BOOST_CHECK_EQUAL(st.min, min);
+		BOOST_CHECK_EQUAL(st.max, max);
+		BOOST_CHECK_CLOSE(st.mean, sum / (end - start), 1e-6);
+		BOOST_CHECK_CLOSE(st.rms, sqrt(square / (end - start)), 1e-6);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Statistics)
+{
+	const uint64_t SampleCount = 1000003;
+
+	srand(0);
+
+	const vector<float> data = make_random_samples(SampleCount);
+
+	AnalogSegment s(1);
+	s.append_interleaved_samples(data.data(), SampleCount, 1);
+	check_statistics(s, data);
+}
+
+/*
+ * Checks that segments with other envelope fan-outs give the same
+ * statistics, and that the envelope grows until its top level is shorter
+ * than the fan-out.
+ */
+BOOST_AUTO_TEST_CASE(ScalePower)
+{
+	const uint64_t SampleCount = 1000003;
+	const unsigned int scale_power =
+		AnalogSegment::default_envelope_scale_power();
+
+	srand(0);
+
+	const vector<float> data = make_random_samples(SampleCount);
+
+	for (unsigned int power = 5; power <= 8; power++) {
+		AnalogSegment::set_default_envelope_scale_power(power);
+
+		AnalogSegment s(1);
+		for (uint64_t i = 0; i < SampleCount; i += 65536)
+			s.append_interleaved_samples(data.data() + i,
+				std::min<uint64_t>(65536, SampleCount - i), 1);
+		check_statistics(s, data);
+
+		unsigned int depth = 0;
+		while ((SampleCount >> ((depth + 1) * power)) != 0)
+			depth++;
+
+		const vector<uint64_t> usage = s.envelope_memory_usage();
+		BOOST_CHECK_EQUAL(usage.size(), depth);
+		for (unsigned int level = 1; level < usage.size(); level++)
+			BOOST_CHECK(usage[level] <= usage[level - 1]);
+
+		// Sections coarser than the top level are clamped to it
+		const AnalogSegment::ReadView view(s);
+		AnalogSegment::EnvelopeSection section;
+		view.get_envelope_section(section, 0, SampleCount, 1e18f);
+		BOOST_CHECK_EQUAL(section.start, 0);
+		BOOST_CHECK(section.length < (1U << power));
+	}
+
+	AnalogSegment::set_default_envelope_scale_power(scale_power);
+}
+
+/*
+ * Appends interleaved packets of random lengths to one segment per
+ * channel, and checks that the samples of every channel come out in
+ * order.
+ */
+void check_multi_channel_append(unsigned int channel_count,
+	uint64_t sample_count)
+{
+	using std::make_shared;
+	using std::shared_ptr;
+
+	const vector<float> data = make_random_samples(
+		sample_count * channel_count);
+
+	vector< shared_ptr<AnalogSegment> > segments;
+	for (unsigned int c = 0; c < channel_count; c++)
+		segments.push_back(make_shared<AnalogSegment>(1));
+
+	for (uint64_t i = 0; i < sample_count;) {
+		const uint64_t count = std::min<uint64_t>(rand() % 50000 + 1,
+			sample_count - i);
+		AnalogSegment::append_interleaved_samples(segments,
+			data.data() + i * channel_count, count);
+		i += count;
+	}
+
+	for (unsigned int c = 0; c < channel_count; c++) {
+		const AnalogSegment::ReadView view(*segments[c]);
+		BOOST_REQUIRE_EQUAL(view.sample_count(), sample_count);
+
+		bool match = true;
+		for (uint64_t i = 0; i < sample_count;) {
+			uint64_t count;
+			const float *const samples = view.samples(i,
+				sample_count, count);
+			for (uint64_t j = 0; j < count; j++)
+				match = match && samples[j] ==
+					data[(i + j) * channel_count + c];
+			i += count;
+		}
+		BOOST_CHECK_MESSAGE(match, "Channel " << c << " of " <<
+			channel_count);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(MultiChannelAppend)
+{
+	srand(0);
+
+	for (unsigned int channel_count : {1, 2, 3, 4, 8})
+		check_multi_channel_append(channel_count, 300007);
+
+	// Cross a chunk boundary
+	check_multi_channel_append(2, (1 << 21) + 1001);
+}
+
+/*
+ * Compares appending an interleaved packet stream with one strided pass
+ * per channel against the single pass de-interleave. The timings are
+ * reported as test messages (run with --log_level=message).
+ */
+BOOST_AUTO_TEST_CASE(MultiChannelAppendBenchmark)
+{
+	typedef std::chrono::steady_clock Clock;
+	using std::make_shared;
+	using std::shared_ptr;
+
+	const uint64_t SampleCount = 1 << 20;
+	const uint64_t PacketLength = 4096;
+
+	srand(0);
+
+	for (unsigned int channel_count : {2, 4, 8}) {
+		const vector<float> data = make_random_samples(
+			SampleCount * channel_count);
+
+		// Take the best of several alternating runs, because the
+		// timings are dominated by page faults on the new chunks
+		double ms[2] = {0.0, 0.0};
+		for (int run = 0; run < 6; run++) {
+			const int mode = run % 2;
+
+			vector< shared_ptr<AnalogSegment> > segments;
+			for (unsigned int c = 0; c < channel_count; c++)
+				segments.push_back(make_shared<AnalogSegment>(1));
+
+			const Clock::time_point start = Clock::now();
+			for (uint64_t i = 0; i < SampleCount;
+				i += PacketLength) {
+				const float *const packet =
+					data.data() + i * channel_count;
+				if (mode == 0) {
+					for (unsigned int c = 0; c < channel_count; c++)
+						segments[c]->append_interleaved_samples(
+							packet + c, PacketLength,
+							channel_count);
+				} else {
+					AnalogSegment::append_interleaved_samples(
+						segments, packet, PacketLength);
+				}
+			}
+
+			const double t = std::chrono::duration<double,
+				std::milli>(Clock::now() - start).count();
+			if (run < 2 || t < ms[mode])
+				ms[mode] = t;
+		}
+
+		BOOST_TEST_MESSAGE(channel_count << " channels: " <<
+			ms[0] << " ms per channel, " << ms[1] <<
+			" ms single pass");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
 
 #if 0
 BOOST_AUTO_TEST_SUITE(AnalogSegmentTest)
@@ -50,7 +512,7 @@ BOOST_AUTO_TEST_CASE(Basic)
 	//----- Test AnalogSegment::push_analog -----//
 
 	BOOST_CHECK(s.get_sample_count() == 0);
-	for (unsigned int i = 0; i < AnalogSegment::ScaleStepCount; i++)
+	for (unsigned int i = 0; i < s.scale_step_count_; i++)
 	{
 		const AnalogSegment::Envelope &m = s.envelope_levels_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
@@ -64,7 +526,7 @@ BOOST_AUTO_TEST_CASE(Basic)
 	BOOST_CHECK(s.get_sample_count() == 8);
 
 	// There should not be enough samples to have a single mip map sample
-	for (unsigned int i = 0; i < AnalogSegment::ScaleStepCount; i++)
+	for (unsigned int i = 0; i < s.scale_step_count_; i++)
 	{
 		const AnalogSegment::Envelope &m = s.envelope_levels_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
@@ -85,7 +547,7 @@ BOOST_AUTO_TEST_CASE(Basic)
 	BOOST_CHECK_EQUAL(e0.samples[0].max, 1.0f);
 
 	// The higher levels should still be empty
-	for (unsigned int i = 1; i < AnalogSegment::ScaleStepCount; i++)
+	for (unsigned int i = 1; i < s.scale_step_count_; i++)
 	{
 		const AnalogSegment::Envelope &m = s.envelope_levels_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
@@ -0,0 +1,191 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <QCryptographicHash>
+
+#include <libsigrokcxx/libsigrokcxx.hpp>
+
+#include <pv/data/logicsegment.hpp>
+#include <pv/data/decode/feeder.hpp>
+
+using pv::data::LogicSegment;
+using pv::data::decode::Feeder;
+using std::atomic;
+using std::dynamic_pointer_cast;
+using std::shared_ptr;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(FeederTest)
+
+shared_ptr<sigrok::Logic> make_logic(
+	const shared_ptr<sigrok::Context> &context,
+	uint8_t *data, size_t length, unsigned int unit_size)
+{
+	return dynamic_pointer_cast<sigrok::Logic>(
+		context->create_logic_packet(data, length, unit_size)->payload());
+}
+
+/*
+ * Reads the samples of a segment through a feeder for a number of
+ * decoder stacks at the same pace, and checks that the chunks hold the
+ * samples of the segment.
+ */
+void check_samples(Feeder &feeder, const vector<uint8_t> &data,
+	int64_t start, int64_t sample_count, unsigned int stack_count = 1)
+{
+	const unsigned int unit_size = feeder.unit_size();
+	for (int64_t i = start; i < sample_count;) {
+		const shared_ptr<const Feeder::Chunk> chunk = feeder.get_chunk(i);
+		for (unsigned int s = 1; s < stack_count; s++)
+			BOOST_CHECK_EQUAL(feeder.get_chunk(i), chunk);
+		BOOST_REQUIRE(chunk->start <= i);
+		BOOST_REQUIRE(chunk->end > i);
+		BOOST_REQUIRE(chunk->end <= sample_count);
+		BOOST_CHECK(memcmp(chunk->data, data.data() +
+			chunk->start * unit_size,
+			(chunk->end - chunk->start) * unit_size) == 0);
+		i = chunk->end;
+	}
+}
+
+/*
+ * Checks that decoder stacks at the same pace share the chunks of a
+ * feeder, that one which falls behind reads its chunks again, and that
+ * chunks are read again as the segment grows.
+ */
+BOOST_AUTO_TEST_CASE(SharedChunks)
+{
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+	const unsigned int UnitSizes[] = {1, 3};
+
+	srand(0);
+
+	for (bool compressed : {false, true})
+	for (unsigned int unit_size : UnitSizes) {
+		// Enough chunks to overflow the cache. A chunk is shorter
+		// than twice Feeder::ChunkBytes
+		const int64_t SampleCount = (Feeder::CacheLength + 2) * 2 *
+			Feeder::ChunkBytes / unit_size + 123;
+
+		// Long runs, so that compression is kept
+		vector<uint8_t> data(SampleCount * unit_size);
+		for (int64_t i = 0; i < SampleCount; i += 1000) {
+			const uint8_t value = rand();
+			std::fill(data.begin() + i * unit_size, data.begin() +
+				std::min(i + 1000, SampleCount) * unit_size, value);
+		}
+
+		LogicSegment::set_compression_enabled(compressed);
+		const int64_t first_count = SampleCount / 2 + 77;
+		const shared_ptr<LogicSegment> segment =
+			std::make_shared<LogicSegment>(make_logic(context,
+				data.data(), first_count * unit_size, unit_size),
+				1);
+		LogicSegment::set_compression_enabled(compression);
+
+		const shared_ptr<Feeder> feeder = Feeder::get(segment);
+		BOOST_CHECK_EQUAL(Feeder::get(segment), feeder);
+		const int64_t chunk_length = feeder->chunk_length();
+		BOOST_CHECK(chunk_length * unit_size >= Feeder::ChunkBytes);
+		BOOST_CHECK(chunk_length * unit_size < 2 * Feeder::ChunkBytes);
+		BOOST_CHECK_EQUAL(chunk_length & (chunk_length - 1), 0);
+
+		// The chunks of an uncompressed segment refer to its samples
+		// in place
+		if (!compressed)
+			BOOST_CHECK(feeder->get_chunk(0)->buffer.empty());
+
+		// Two stacks at the same pace read each chunk once
+		const int64_t chunk_count = (first_count +
+			feeder->chunk_length() - 1) / feeder->chunk_length();
+		check_samples(*feeder, data, 0, first_count, 2);
+		BOOST_CHECK_EQUAL(feeder->chunks_read(), chunk_count);
+
+		// The last chunk is read again when the segment grows
+		segment->append_payload(make_logic(context,
+			data.data() + first_count * unit_size,
+			(SampleCount - first_count) * unit_size, unit_size));
+		const uint64_t reads = feeder->chunks_read();
+		check_samples(*feeder, data, first_count - 1, SampleCount);
+		const int64_t new_chunk_count = (SampleCount +
+			feeder->chunk_length() - 1) / feeder->chunk_length();
+		BOOST_CHECK_EQUAL(feeder->chunks_read() - reads,
+			new_chunk_count - chunk_count + 1);
+
+		// A stack that has fallen out of the cache reads its chunks
+		// again, while chunks that are held stay shared
+		const shared_ptr<const Feeder::Chunk> held = feeder->get_chunk(0);
+		const uint64_t reads2 = feeder->chunks_read();
+		check_samples(*feeder, data, 0, SampleCount);
+		BOOST_CHECK_EQUAL(feeder->chunks_read() - reads2,
+			new_chunk_count - 1);
+		BOOST_CHECK_EQUAL(feeder->get_chunk(0), held);
+	}
+}
+
+/*
+ * Checks that the digest of the samples is computed once, and that an
+ * interrupted digest is not kept.
+ */
+BOOST_AUTO_TEST_CASE(SampleDigest)
+{
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const unsigned int unit_size = 2;
+	const int64_t SampleCount = 3 * Feeder::ChunkBytes / unit_size + 5;
+
+	vector<uint8_t> data(SampleCount * unit_size);
+	for (uint8_t &d : data)
+		d = rand();
+
+	const shared_ptr<LogicSegment> segment =
+		std::make_shared<LogicSegment>(make_logic(context,
+			data.data(), data.size(), unit_size), 1);
+	const shared_ptr<Feeder> feeder = Feeder::get(segment);
+
+	atomic<bool> interrupt(true);
+	BOOST_CHECK(feeder->sample_digest(SampleCount, interrupt).isEmpty());
+
+	interrupt = false;
+	const QByteArray digest = feeder->sample_digest(SampleCount,
+		interrupt);
+	BOOST_CHECK(digest == QCryptographicHash::hash(QByteArray(
+		(const char*)data.data(), data.size()),
+		QCryptographicHash::Sha1));
+
+	// The digest is kept, so the samples are not read again
+	const uint64_t reads = feeder->chunks_read();
+	BOOST_CHECK(feeder->sample_digest(SampleCount, interrupt) == digest);
+	BOOST_CHECK_EQUAL(feeder->chunks_read(), reads);
+
+	// The digest of fewer samples differs
+	BOOST_CHECK(feeder->sample_digest(SampleCount - 1, interrupt) !=
+		digest);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
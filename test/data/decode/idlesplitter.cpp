@@ -0,0 +1,98 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <libsigrokcxx/libsigrokcxx.hpp>
+
+#include <pv/data/logicsegment.hpp>
+#include <pv/data/decode/idlesplitter.hpp>
+
+using pv::data::LogicSegment;
+using pv::data::decode::IdleSplitter;
+using std::dynamic_pointer_cast;
+using std::shared_ptr;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(IdleSplitterTest)
+
+/*
+ * Splits a capture of bursts of activity on channel 0, separated by idle
+ * stretches, with a clock that runs throughout on channel 1. Checks that
+ * the boundaries fall in the middle of idle stretches, and that the
+ * capture is not split if a channel is never idle.
+ */
+BOOST_AUTO_TEST_CASE(IdleBoundaries)
+{
+	const int64_t BurstLength = 10000;
+	const int64_t IdleLength = 5000;
+	const int64_t MinIdleLength = 2000;
+	const unsigned int BurstCount = 100;
+	const unsigned int RangeCount = 4;
+
+	vector<uint8_t> data;
+	for (unsigned int b = 0; b < BurstCount; b++) {
+		for (int64_t i = 0; i < BurstLength; i++)
+			data.push_back(((i / 10) & 1) | ((data.size() & 1) << 1));
+		for (int64_t i = 0; i < IdleLength; i++)
+			data.push_back((data.size() & 1) << 1);
+	}
+	const int64_t sample_count = data.size();
+
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+
+	for (int compressed = 0; compressed < 2; compressed++) {
+		LogicSegment::set_compression_enabled(compressed);
+		LogicSegment segment(dynamic_pointer_cast<sigrok::Logic>(
+			context->create_logic_packet(data.data(), data.size(),
+				1)->payload()), 1);
+
+		const vector<int64_t> points = IdleSplitter::split(segment, 1,
+			sample_count, RangeCount, MinIdleLength);
+		BOOST_REQUIRE_EQUAL(points.size(), RangeCount + 1);
+		BOOST_CHECK_EQUAL(points.front(), 0);
+		BOOST_CHECK_EQUAL(points.back(), sample_count);
+
+		for (size_t p = 1; p < RangeCount; p++) {
+			BOOST_CHECK(points[p] > points[p - 1]);
+
+			// Channel 0 must be idle for half the minimum idle length
+			// on either side of the boundary
+			for (int64_t i = points[p] - MinIdleLength / 2;
+				i < points[p] + MinIdleLength / 2; i++)
+				BOOST_REQUIRE_EQUAL(data[i] & 1, 0);
+		}
+
+		// The clock is never idle, and the idle stretches of channel 0
+		// are too short for a longer minimum
+		BOOST_CHECK_EQUAL(IdleSplitter::split(segment, 3, sample_count,
+			RangeCount, MinIdleLength).size(), 2);
+		BOOST_CHECK_EQUAL(IdleSplitter::split(segment, 1, sample_count,
+			RangeCount, IdleLength * 2).size(), 2);
+	}
+
+	LogicSegment::set_compression_enabled(compression);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
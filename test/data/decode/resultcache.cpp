@@ -0,0 +1,159 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <libsigrokdecode/libsigrokdecode.h> /* First, so we avoid a _POSIX_C_SOURCE warning. */
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <QDir>
+#include <QFile>
+
+#include <pv/data/decode/annotation.hpp>
+#include <pv/data/decode/decoder.hpp>
+#include <pv/data/decode/resultcache.hpp>
+#include <pv/data/decode/row.hpp>
+#include <pv/data/decode/rowdata.hpp>
+#include <pv/data/decode/stringtable.hpp>
+
+using pv::data::decode::Annotation;
+using pv::data::decode::Decoder;
+using pv::data::decode::ResultCache;
+using pv::data::decode::Row;
+using pv::data::decode::RowData;
+using pv::data::decode::StringTable;
+using std::map;
+using std::shared_ptr;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(ResultCacheTest)
+
+/*
+ * Stores the rows of a decoder with and without a list of annotation
+ * rows, and checks that they are loaded unchanged.
+ */
+BOOST_AUTO_TEST_CASE(StoreAndLoad)
+{
+	const QString dir = QDir(QDir::tempPath()).filePath(
+		"pulseview-resultcache-test");
+	const QString previous_dir = ResultCache::directory();
+	ResultCache::set_directory(dir);
+
+	char row_id[] = "bytes", row_desc[] = "Bytes";
+	srd_decoder_annotation_row ann_row;
+	memset(&ann_row, 0, sizeof(ann_row));
+	ann_row.id = row_id;
+	ann_row.desc = row_desc;
+
+	char id_a[] = "a", id_b[] = "b";
+	srd_decoder decoder_a, decoder_b;
+	memset(&decoder_a, 0, sizeof(decoder_a));
+	memset(&decoder_b, 0, sizeof(decoder_b));
+	decoder_a.id = id_a;
+	decoder_a.annotation_rows = g_slist_append(nullptr, &ann_row);
+	decoder_b.id = id_b;
+
+	// Five classes of annotations for each decoder
+	char class_id[] = "class", class_desc[] = "Class";
+	char *ann_class[] = {class_id, class_desc};
+	for (int i = 0; i < 5; i++) {
+		decoder_a.annotations = g_slist_append(
+			decoder_a.annotations, ann_class);
+		decoder_b.annotations = g_slist_append(
+			decoder_b.annotations, ann_class);
+	}
+
+	const vector<Decoder::Config> stack = {
+		Decoder(&decoder_a).config(),
+		Decoder(&decoder_b).config()
+	};
+
+	// Build the rows with repeated texts
+	const shared_ptr<StringTable> strings =
+		std::make_shared<StringTable>();
+	map<const Row, RowData> rows;
+	char t0[] = "Start", t1[] = "S", t2[] = "", t3[] = "Data: 5A";
+	char *texts_0[] = {t0, t1, nullptr};
+	char *texts_1[] = {t2, t3, nullptr};
+	for (int i = 0; i < 1000; i++) {
+		rows[Row(&decoder_a, &ann_row)].push_annotation(Annotation(
+			i * 10, i * 10 + 5, i % 3, strings,
+			strings->intern((i % 2) ? texts_0 : texts_1)));
+		rows[Row(&decoder_b)].push_annotation(Annotation(
+			i * 7, i * 7, 4, strings, strings->intern(texts_0)));
+	}
+
+	const QByteArray key("0123456789abcdefghij");
+	BOOST_REQUIRE(ResultCache::store(key, stack, rows));
+
+	const shared_ptr<StringTable> loaded_strings =
+		std::make_shared<StringTable>();
+	map<const Row, RowData> loaded;
+	BOOST_REQUIRE(ResultCache::load(key, stack, loaded,
+		loaded_strings));
+	BOOST_CHECK_EQUAL(loaded_strings->size(), 2);
+
+	BOOST_REQUIRE_EQUAL(loaded.size(), rows.size());
+	for (const auto &r : rows) {
+		const auto iter = loaded.find(r.first);
+		BOOST_REQUIRE(iter != loaded.end());
+
+		const auto &expected = r.second.annotations();
+		const auto &found = (*iter).second.annotations();
+		BOOST_REQUIRE_EQUAL(found.size(), expected.size());
+		for (size_t i = 0; i < found.size(); i++) {
+			BOOST_CHECK_EQUAL(found[i].start_sample(),
+				expected[i].start_sample());
+			BOOST_CHECK_EQUAL(found[i].end_sample(),
+				expected[i].end_sample());
+			BOOST_CHECK_EQUAL(found[i].format(),
+				expected[i].format());
+			BOOST_CHECK(found[i].annotations() ==
+				expected[i].annotations());
+		}
+	}
+
+	// Another key misses
+	map<const Row, RowData> missed;
+	BOOST_CHECK(!ResultCache::load(QByteArray("another key"), stack,
+		missed, loaded_strings));
+
+	// Records of classes that the decoder does not declare are rejected
+	decoder_b.annotations = g_slist_delete_link(decoder_b.annotations,
+		g_slist_last(decoder_b.annotations));
+	map<const Row, RowData> rejected;
+	BOOST_CHECK(!ResultCache::load(key, stack, rejected,
+		loaded_strings));
+
+	for (const QString &f : QDir(dir).entryList(QDir::Files))
+		QFile::remove(QDir(dir).filePath(f));
+	QDir().rmdir(dir);
+	ResultCache::set_directory(previous_dir);
+
+	g_slist_free(decoder_a.annotation_rows);
+	g_slist_free(decoder_a.annotations);
+	g_slist_free(decoder_b.annotations);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,184 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <libsigrokdecode/libsigrokdecode.h> /* First, so we avoid a _POSIX_C_SOURCE warning. */
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <pv/data/decode/annotation.hpp>
+#include <pv/data/decode/rowdata.hpp>
+#include <pv/data/decode/stringtable.hpp>
+
+using pv::data::decode::Annotation;
+using pv::data::decode::RowData;
+using pv::data::decode::StringTable;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(RowDataTest)
+
+const std::shared_ptr<StringTable> strings =
+	std::make_shared<StringTable>();
+
+Annotation make_annotation(uint64_t start, uint64_t end, int ann_class)
+{
+	char text[] = "A";
+	char *ann_text[] = {text, nullptr};
+	srd_proto_data_annotation pda;
+	pda.ann_class = ann_class;
+	pda.ann_text = ann_text;
+
+	srd_proto_data pdata;
+	pdata.start_sample = start;
+	pdata.end_sample = end;
+	pdata.pdo = nullptr;
+	pdata.data = &pda;
+
+	return Annotation(&pdata, strings);
+}
+
+/*
+ * Pushes short annotations in roughly ascending order, with a few long
+ * ones and a few that arrive late, and compares the annotations found in
+ * random ranges with those found by a linear search.
+ */
+BOOST_AUTO_TEST_CASE(AnnotationSubset)
+{
+	const int AnnotationCount = 100000;
+
+	srand(0);
+
+	RowData row;
+	vector<Annotation> all;
+	uint64_t t = 0, max_sample = 0;
+	for (int i = 0; i < AnnotationCount; i++) {
+		t += rand() % 100;
+		uint64_t start = t, length = rand() % 50 + 1;
+		if (rand() % 1000 == 0)
+			length = rand() % 100000;
+		if (rand() % 100 == 0)
+			start -= std::min<uint64_t>(start, rand() % 1000);
+
+		const Annotation a = make_annotation(start, start + length, i);
+		row.push_annotation(a);
+		all.push_back(a);
+		max_sample = std::max(max_sample, start + length);
+	}
+
+	BOOST_CHECK_EQUAL(row.get_max_sample(), max_sample);
+
+	// A stable sort gives the order in which the row keeps annotations
+	// with the same start sample
+	std::stable_sort(all.begin(), all.end(),
+		[](const Annotation &a, const Annotation &b) {
+			return a.start_sample() < b.start_sample(); });
+
+	for (int i = 0; i < 200; i++) {
+		const uint64_t start = rand() % (t + 1000);
+		const uint64_t end = start + rand() % ((i % 2) ? 100 : 100000);
+
+		vector<Annotation> expected;
+		for (const Annotation &a : all)
+			if (a.end_sample() > start && a.start_sample() <= end)
+				expected.push_back(a);
+
+		vector<Annotation> found;
+		row.get_annotation_subset(found, start, end);
+
+		BOOST_REQUIRE_EQUAL(found.size(), expected.size());
+		for (size_t j = 0; j < found.size(); j++)
+			BOOST_CHECK_EQUAL(found[j].format(),
+				expected[j].format());
+	}
+}
+
+/*
+ * Checks the spans of coverage against spans merged from the sorted
+ * annotations, and checks that the spans account for every annotation.
+ */
+BOOST_AUTO_TEST_CASE(CoverageSpans)
+{
+	const int AnnotationCount = 20000;
+
+	srand(1);
+
+	RowData row;
+	vector<Annotation> all;
+	uint64_t t = 0;
+	for (int i = 0; i < AnnotationCount; i++) {
+		t += (i % 500 == 0) ? 100000 : rand() % 200;
+		uint64_t start = t, length = rand() % 20;
+		if (rand() % 50 == 0)
+			start -= std::min<uint64_t>(start, rand() % 5000);
+
+		const Annotation a = make_annotation(start, start + length, 0);
+		row.push_annotation(a);
+		all.push_back(a);
+	}
+
+	std::sort(all.begin(), all.end(),
+		[](const Annotation &a, const Annotation &b) {
+			return a.start_sample() < b.start_sample(); });
+
+	vector<RowData::Span> spans;
+	BOOST_CHECK(!row.get_coverage_spans(spans, 0, t, 1.0));
+	BOOST_CHECK(spans.empty());
+
+	for (uint64_t gap = 16; gap <= (1 << 20); gap *= 4) {
+		vector<RowData::Span> expected;
+		for (const Annotation &a : all) {
+			if (!expected.empty() && a.start_sample() <
+				expected.back().end_sample + gap) {
+				RowData::Span &s = expected.back();
+				s.end_sample = std::max(s.end_sample,
+					a.end_sample());
+				s.annotation_count++;
+			} else {
+				const RowData::Span s = {a.start_sample(),
+					a.end_sample(), 1};
+				expected.push_back(s);
+			}
+		}
+
+		// Any gap up to the next level selects the same level
+		spans.clear();
+		BOOST_REQUIRE(row.get_coverage_spans(spans, 0, t + 100,
+			gap * 3.5));
+
+		BOOST_REQUIRE_EQUAL(spans.size(), expected.size());
+		uint64_t count = 0;
+		for (size_t i = 0; i < spans.size(); i++) {
+			BOOST_CHECK_EQUAL(spans[i].start_sample,
+				expected[i].start_sample);
+			BOOST_CHECK_EQUAL(spans[i].end_sample,
+				expected[i].end_sample);
+			BOOST_CHECK_EQUAL(spans[i].annotation_count,
+				expected[i].annotation_count);
+			count += spans[i].annotation_count;
+		}
+		BOOST_CHECK_EQUAL(count, AnnotationCount);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
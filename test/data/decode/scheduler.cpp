@@ -0,0 +1,88 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <pv/data/decode/scheduler.hpp>
+
+using pv::data::decode::Scheduler;
+using std::atomic;
+using std::thread;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(SchedulerTest)
+
+/*
+ * Runs more threads than there are slots, and checks that no more
+ * sessions than slots are ever decoding at once, and that all the
+ * decoded samples are accounted for.
+ */
+BOOST_AUTO_TEST_CASE(BoundedSlots)
+{
+	const unsigned int SlotCount = 2;
+	const unsigned int ThreadCount = 6;
+	const unsigned int ChunkCount = 50;
+	const unsigned int ChunkLength = 4096;
+
+	Scheduler scheduler(SlotCount);
+	BOOST_CHECK_EQUAL(scheduler.slot_count(), SlotCount);
+	scheduler.take_statistics();
+
+	atomic<unsigned int> active(0), max_active(0);
+
+	vector<thread> threads;
+	for (unsigned int t = 0; t < ThreadCount; t++)
+		threads.emplace_back([&]() {
+			for (unsigned int c = 0; c < ChunkCount; c++) {
+				Scheduler::Slot slot(scheduler);
+				const unsigned int a = ++active;
+				unsigned int m = max_active;
+				while (a > m && !max_active.compare_exchange_weak(m, a));
+				std::this_thread::sleep_for(
+					std::chrono::microseconds(100));
+				slot.add_samples(ChunkLength);
+				active--;
+			}
+		});
+
+	for (thread &t : threads)
+		t.join();
+
+	BOOST_CHECK(max_active <= SlotCount);
+
+	const Scheduler::Statistics s = scheduler.take_statistics();
+	BOOST_CHECK_EQUAL(s.slot_count, SlotCount);
+	BOOST_CHECK_EQUAL(s.busy_slots, 0);
+	BOOST_CHECK(s.utilisation > 0.0 && s.utilisation <= 1.0);
+	BOOST_CHECK(s.samples_per_second > 0.0);
+
+	// A new period begins after the statistics are taken
+	const Scheduler::Statistics idle = scheduler.take_statistics();
+	BOOST_CHECK_EQUAL(idle.utilisation, 0.0);
+	BOOST_CHECK_EQUAL(idle.samples_per_second, 0.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
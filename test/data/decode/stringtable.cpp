@@ -0,0 +1,134 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <libsigrokdecode/libsigrokdecode.h> /* First, so we avoid a _POSIX_C_SOURCE warning. */
+
+#include <stdio.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <pv/data/decode/annotation.hpp>
+#include <pv/data/decode/stringtable.hpp>
+
+using pv::data::decode::Annotation;
+using pv::data::decode::StringTable;
+using std::shared_ptr;
+using std::weak_ptr;
+
+BOOST_AUTO_TEST_SUITE(StringTableTest)
+
+BOOST_AUTO_TEST_CASE(Intern)
+{
+	StringTable strings;
+
+	char ack[] = "ACK", a[] = "A", nack[] = "NACK";
+	char *ack_texts[] = {ack, a, nullptr};
+	char *ack_texts2[] = {ack, a, nullptr};
+	char *nack_texts[] = {nack, nullptr};
+	char *ack_only_texts[] = {ack, nullptr};
+
+	const StringTable::StringList &l = strings.intern(ack_texts);
+	BOOST_REQUIRE_EQUAL(l.size(), 2);
+	BOOST_CHECK(l[0] == "ACK");
+	BOOST_CHECK(l[1] == "A");
+
+	// Equal lists are stored once, and the lists stay in place as
+	// other lists are added
+	BOOST_CHECK_EQUAL(&strings.intern(ack_texts2), &l);
+	for (int i = 0; i < 1000; i++) {
+		char text[16];
+		snprintf(text, sizeof(text), "%02X", i);
+		char *texts[] = {text, nullptr};
+		strings.intern(texts);
+	}
+	BOOST_CHECK_EQUAL(&strings.intern(ack_texts), &l);
+	BOOST_CHECK(l[0] == "ACK");
+
+	// A list that is a prefix of another is distinct from it
+	BOOST_CHECK(&strings.intern(ack_only_texts) != &l);
+	BOOST_CHECK_EQUAL(strings.intern(nack_texts).size(), 1);
+
+	BOOST_CHECK_EQUAL(strings.size(), 1003);
+	BOOST_CHECK(strings.memory_usage() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(AnnotationTexts)
+{
+	const shared_ptr<StringTable> strings =
+		std::make_shared<StringTable>();
+
+	char start[] = "Start", s[] = "S";
+	char *texts[] = {start, s, nullptr};
+	srd_proto_data_annotation pda;
+	pda.ann_class = 3;
+	pda.ann_text = texts;
+
+	srd_proto_data pdata;
+	pdata.start_sample = 10;
+	pdata.end_sample = 20;
+	pdata.pdo = nullptr;
+	pdata.data = &pda;
+
+	const Annotation a(&pdata, strings), b(&pdata, strings);
+	BOOST_CHECK_EQUAL(a.start_sample(), 10);
+	BOOST_CHECK_EQUAL(a.end_sample(), 20);
+	BOOST_CHECK_EQUAL(a.format(), 3);
+	BOOST_REQUIRE_EQUAL(a.annotations().size(), 2);
+	BOOST_CHECK(a.annotations()[0] == "Start");
+	BOOST_CHECK_EQUAL(&a.annotations(), &b.annotations());
+	BOOST_CHECK_EQUAL(strings->size(), 1);
+
+	// The annotation is a fixed-size record
+	BOOST_CHECK(sizeof(Annotation) <= 48);
+}
+
+BOOST_AUTO_TEST_CASE(TableLifetime)
+{
+	char text[] = "A";
+	char *texts[] = {text, nullptr};
+	srd_proto_data_annotation pda;
+	pda.ann_class = 0;
+	pda.ann_text = texts;
+
+	srd_proto_data pdata;
+	pdata.start_sample = 0;
+	pdata.end_sample = 1;
+	pdata.pdo = nullptr;
+	pdata.data = &pda;
+
+	shared_ptr<StringTable> strings = std::make_shared<StringTable>();
+	const weak_ptr<StringTable> table = strings;
+	{
+		Annotation *const a = new Annotation(&pdata, strings);
+		const Annotation copy(*a);
+
+		// A copy keeps the table alive once the decoder stack and the
+		// rows have dropped it
+		strings.reset();
+		delete a;
+		BOOST_CHECK(!table.expired());
+		BOOST_CHECK(copy.annotations()[0] == "A");
+	}
+
+	// The table is freed with the last annotation that refers to it
+	BOOST_CHECK(table.expired());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -23,17 +23,553 @@
 
 #include <libsigrokcxx/libsigrokcxx.hpp>
 
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include <QDir>
+#include <QFile>
+
 #include "../../pv/data/decoderstack.hpp"
+#include "../../pv/data/decode/annotation.hpp"
+#include "../../pv/data/decode/decoder.hpp"
+#include "../../pv/data/decode/feeder.hpp"
+#include "../../pv/data/decode/resultcache.hpp"
+#include "../../pv/data/logic.hpp"
+#include "../../pv/data/logicsegment.hpp"
 #include "../../pv/devicemanager.hpp"
 #include "../../pv/session.hpp"
 #include "../../pv/view/decodetrace.hpp"
+#include "../../pv/view/logicsignal.hpp"
 
 using pv::data::DecoderStack;
+using pv::data::LogicSegment;
+using pv::data::decode::Annotation;
 using pv::data::decode::Decoder;
+using pv::data::decode::Feeder;
+using pv::data::decode::ResultCache;
+using pv::data::decode::Row;
 using pv::view::DecodeTrace;
+using pv::view::LogicSignal;
+using std::dynamic_pointer_cast;
+using std::map;
 using std::shared_ptr;
+using std::string;
 using std::vector;
 
+BOOST_AUTO_TEST_SUITE(DecoderStackTest)
+
+const uint64_t BenchmarkSamplerate = 1000000;
+
+/*
+ * Appends samples of the given value until the length of the data reaches
+ * the given time in samples.
+ */
+void append_level(vector<uint8_t> &data, uint8_t value, double end)
+{
+	while (data.size() < end)
+		data.push_back(value);
+}
+
+/*
+ * Generates UART frames of random bytes at 115200 baud on channel 0.
+ */
+vector<uint8_t> make_uart_samples(uint64_t sample_count)
+{
+	const double SamplesPerBit = (double)BenchmarkSamplerate / 115200;
+
+	vector<uint8_t> data;
+	double t = 0.0;
+	while (data.size() < sample_count) {
+		// A start bit, 8 data bits from the LSB, and a stop bit
+		const unsigned int frame = 0x200 | ((rand() & 0xFF) << 1);
+		for (unsigned int bit = 0; bit < 10; bit++)
+			append_level(data, (frame >> bit) & 1,
+				t += SamplesPerBit);
+
+		// Idle for up to three bits between frames
+		append_level(data, 1, t += SamplesPerBit * (rand() % 4));
+	}
+
+	data.resize(sample_count);
+	return data;
+}
+
+/*
+ * Generates SPI mode 0 transfers of random bytes, with the clock on
+ * channel 0 and MOSI on channel 1.
+ */
+vector<uint8_t> make_spi_samples(uint64_t sample_count)
+{
+	vector<uint8_t> data;
+	while (data.size() < sample_count) {
+		const unsigned int byte = rand() & 0xFF;
+		for (int bit = 7; bit >= 0; bit--) {
+			const uint8_t mosi = ((byte >> bit) & 1) << 1;
+			append_level(data, mosi, data.size() + 4);
+			append_level(data, mosi | 1, data.size() + 4);
+		}
+		append_level(data, 0, data.size() + 8);
+	}
+
+	data.resize(sample_count);
+	return data;
+}
+
+/*
+ * Generates I2C writes of random bytes, with SCL on channel 0 and SDA on
+ * channel 1.
+ */
+vector<uint8_t> make_i2c_samples(uint64_t sample_count)
+{
+	vector<uint8_t> data;
+	while (data.size() < sample_count) {
+		// Start condition
+		append_level(data, 3, data.size() + 8);
+		append_level(data, 1, data.size() + 4);
+		append_level(data, 0, data.size() + 4);
+
+		// The address, and four data bytes, each acknowledged
+		for (unsigned int i = 0; i < 5; i++) {
+			const unsigned int byte = (i == 0) ? 0x50 << 1 :
+				rand() & 0xFF;
+			for (int bit = 8; bit >= 0; bit--) {
+				const uint8_t sda = (bit > 0) ?
+					((byte >> (bit - 1)) & 1) << 1 : 0;
+				append_level(data, sda, data.size() + 2);
+				append_level(data, sda | 1, data.size() + 4);
+				append_level(data, sda, data.size() + 2);
+			}
+		}
+
+		// Stop condition
+		append_level(data, 0, data.size() + 2);
+		append_level(data, 1, data.size() + 4);
+		append_level(data, 3, data.size() + 4);
+	}
+
+	data.resize(sample_count);
+	return data;
+}
+
+/*
+ * Compares the decode throughput of fixed chunks of 4096 bytes copied out
+ * of the segment, with adaptive chunks sent through the shared feeder of
+ * the segment, for a few standard decoders. Both must give the same
+ * annotations. The results are reported as test messages (run with
+ * --log_level=message).
+ */
+struct DecodeBenchmark
+{
+	typedef std::chrono::steady_clock Clock;
+
+	/// The start sample, end sample and class of an annotation.
+	typedef std::tuple<uint64_t, uint64_t, int> AnnotationKey;
+
+	static void collect_annotation(srd_proto_data *pdata,
+		void *annotations)
+	{
+		const srd_proto_data_annotation *const pda =
+			(const srd_proto_data_annotation*)pdata->data;
+		((vector<AnnotationKey>*)annotations)->push_back(AnnotationKey(
+			pdata->start_sample, pdata->end_sample, pda->ann_class));
+	}
+
+	static double decode(const char *id, const map<string, int> &channels,
+		shared_ptr<const LogicSegment> segment, bool adaptive,
+		vector<AnnotationKey> &annotations)
+	{
+		const int64_t sample_count = segment->get_sample_count();
+		const unsigned int unit_size = segment->unit_size();
+
+		annotations.clear();
+
+		srd_session *session;
+		srd_session_new(&session);
+		BOOST_REQUIRE(session);
+
+		GHashTable *const options = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+		srd_decoder_inst *const di = srd_inst_new(session, id, options);
+		g_hash_table_destroy(options);
+		BOOST_REQUIRE(di);
+
+		GHashTable *const channel_hash = g_hash_table_new_full(
+			g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+		for (const auto &c : channels) {
+			GVariant *const gvar = g_variant_new_int32(c.second);
+			g_variant_ref_sink(gvar);
+			g_hash_table_insert(channel_hash,
+				g_strdup(c.first.c_str()), gvar);
+		}
+		srd_inst_channel_set_all(di, channel_hash);
+
+		srd_session_metadata_set(session, SRD_CONF_SAMPLERATE,
+			g_variant_new_uint64(BenchmarkSamplerate));
+		srd_pd_output_callback_add(session, SRD_OUTPUT_ANN,
+			collect_annotation, &annotations);
+		srd_session_start(session);
+
+		const Clock::time_point start = Clock::now();
+
+		if (adaptive) {
+			const shared_ptr<Feeder> feeder = Feeder::get(segment);
+			int64_t length = DecoderStack::MinDecodeChunkLength /
+				unit_size;
+			for (int64_t i = 0; i < sample_count;) {
+				const Clock::time_point chunk_start = Clock::now();
+				const int64_t end = DecoderStack::send_chunk(
+					session, *feeder, i,
+					std::min(i + length, sample_count), 0);
+				BOOST_REQUIRE(end > i);
+				length = DecoderStack::adapt_chunk_length(length,
+					end - i, Clock::now() - chunk_start,
+					unit_size);
+				i = end;
+			}
+		} else {
+			const int64_t length = 4096 / unit_size;
+			vector<uint8_t> chunk(length * unit_size);
+			for (int64_t i = 0; i < sample_count; i += length) {
+				const int64_t end = std::min(i + length,
+					sample_count);
+				segment->get_samples(chunk.data(), i, end);
+				BOOST_REQUIRE(srd_session_send(session, i, end,
+					chunk.data(), (end - i) * unit_size,
+					unit_size) == SRD_OK);
+			}
+		}
+
+		const double seconds = std::chrono::duration<double>(
+			Clock::now() - start).count();
+
+		srd_session_destroy(session);
+
+		return sample_count / seconds;
+	}
+
+	static void run(const char *id, const map<string, int> &channels,
+		vector<uint8_t> &data)
+	{
+		if (srd_decoder_load(id) != SRD_OK) {
+			BOOST_TEST_MESSAGE("Decoder " << id << " not available");
+			return;
+		}
+
+		// Raw segments are needed for the samples to be sent in place
+		const bool compression = LogicSegment::compression_enabled();
+		LogicSegment::set_compression_enabled(false);
+
+		const shared_ptr<sigrok::Context> context =
+			sigrok::Context::create();
+		const shared_ptr<LogicSegment> segment =
+			std::make_shared<LogicSegment>(
+				dynamic_pointer_cast<sigrok::Logic>(
+					context->create_logic_packet(data.data(),
+						data.size(), 1)->payload()),
+				BenchmarkSamplerate);
+		LogicSegment::set_compression_enabled(compression);
+
+		vector<AnnotationKey> fixed_annotations, adaptive_annotations;
+		const double fixed = decode(id, channels, segment, false,
+			fixed_annotations);
+		const double adaptive = decode(id, channels, segment, true,
+			adaptive_annotations);
+
+		// The chunking must not change where the annotations are, or
+		// which they are
+		BOOST_CHECK(!fixed_annotations.empty());
+		BOOST_CHECK_EQUAL(fixed_annotations.size(),
+			adaptive_annotations.size());
+		BOOST_CHECK(fixed_annotations == adaptive_annotations);
+
+		BOOST_TEST_MESSAGE(id << ": " << fixed / 1e6 <<
+			" MS/s in fixed copied chunks, " << adaptive / 1e6 <<
+			" MS/s in adaptive in-place chunks");
+	}
+};
+
+BOOST_AUTO_TEST_CASE(DecodeThroughput)
+{
+	const uint64_t SampleCount = 2000000;
+
+	BOOST_REQUIRE(srd_init(nullptr) == SRD_OK);
+
+	srand(0);
+
+	vector<uint8_t> uart = make_uart_samples(SampleCount);
+	DecodeBenchmark::run("uart", {{"rx", 0}}, uart);
+
+	vector<uint8_t> spi = make_spi_samples(SampleCount);
+	DecodeBenchmark::run("spi", {{"clk", 0}, {"mosi", 1}}, spi);
+
+	vector<uint8_t> i2c = make_i2c_samples(SampleCount);
+	DecodeBenchmark::run("i2c", {{"scl", 0}, {"sda", 1}}, i2c);
+
+	srd_exit();
+}
+
+/*
+ * Drives the decodes of decoder stacks on a complete segment, for the
+ * tests of how the stacks are decoded.
+ */
+struct StackDecode
+{
+	/**
+	 * Decodes the whole segment of a stack, and waits for the decode
+	 * to finish. The frame is complete before the decode thread first
+	 * looks at it, as it is when a capture is loaded from a file.
+	 */
+	static void run(DecoderStack &stack)
+	{
+		{
+			std::lock_guard<std::mutex> lock(stack.input_mutex_);
+			stack.begin_decode();
+			stack.frame_complete_ = true;
+		}
+		stack.input_cond_.notify_one();
+		if (stack.decode_thread_.joinable())
+			stack.decode_thread_.join();
+		BOOST_CHECK(stack.error_message().isEmpty());
+	}
+
+	/**
+	 * Gets the annotations of each visible row of a stack.
+	 */
+	static vector< vector<Annotation> > annotations(
+		const DecoderStack &stack)
+	{
+		vector< vector<Annotation> > rows;
+		for (const Row &row : stack.get_visible_rows()) {
+			rows.push_back(vector<Annotation>());
+			stack.get_annotation_subset(rows.back(), row, 0,
+				UINT64_MAX);
+		}
+		return rows;
+	}
+
+	/**
+	 * Checks that two sets of rows hold the same annotations.
+	 */
+	static void check_equal(const vector< vector<Annotation> > &found,
+		const vector< vector<Annotation> > &expected)
+	{
+		BOOST_REQUIRE_EQUAL(found.size(), expected.size());
+		for (size_t r = 0; r < found.size(); r++) {
+			BOOST_REQUIRE_EQUAL(found[r].size(), expected[r].size());
+			for (size_t i = 0; i < found[r].size(); i++) {
+				const Annotation &a = found[r][i];
+				const Annotation &b = expected[r][i];
+				BOOST_CHECK_EQUAL(a.start_sample(),
+					b.start_sample());
+				BOOST_CHECK_EQUAL(a.end_sample(), b.end_sample());
+				BOOST_CHECK_EQUAL(a.format(), b.format());
+				BOOST_CHECK(a.annotations() == b.annotations());
+			}
+		}
+	}
+
+	/**
+	 * Removes the files of the decode cache, so that the next decode
+	 * is not loaded from it.
+	 */
+	static void clear_cache()
+	{
+		const QDir dir(ResultCache::directory());
+		for (const QString &f : dir.entryList(QDir::Files))
+			QFile::remove(dir.filePath(f));
+	}
+};
+
+/*
+ * A session on the demo device, with the decode cache in a temporary
+ * directory. The captures to decode are put in the data of the first
+ * logic channel.
+ */
+struct SessionFixture
+{
+	SessionFixture() :
+		context(sigrok::Context::create()),
+		device_manager(context),
+		session(device_manager),
+		previous_cache_dir(ResultCache::directory())
+	{
+		BOOST_REQUIRE(srd_init(nullptr) == SRD_OK);
+		ResultCache::set_directory(QDir(QDir::tempPath()).filePath(
+			"pulseview-decoderstack-test"));
+
+		session.set_default_device();
+		BOOST_REQUIRE(session.device());
+
+		for (const shared_ptr<pv::view::Signal> &s : session.signals())
+			if ((signal = dynamic_pointer_cast<LogicSignal>(s)) &&
+				signal->channel()->index() == 0)
+				break;
+		BOOST_REQUIRE(signal && signal->channel()->index() == 0);
+	}
+
+	~SessionFixture()
+	{
+		StackDecode::clear_cache();
+		QDir().rmdir(ResultCache::directory());
+		ResultCache::set_directory(previous_cache_dir);
+		srd_exit();
+	}
+
+	/**
+	 * Puts a capture in the data of the signal.
+	 */
+	void push_samples(vector<uint8_t> &data)
+	{
+		shared_ptr<LogicSegment> segment =
+			std::make_shared<LogicSegment>(
+				dynamic_pointer_cast<sigrok::Logic>(
+					context->create_logic_packet(data.data(),
+						data.size(), 1)->payload()),
+				BenchmarkSamplerate);
+		signal->logic_data()->push_segment(segment);
+	}
+
+	/**
+	 * Gets the channels of a decoder that has one channel, on the
+	 * signal.
+	 */
+	map<const srd_channel*, shared_ptr<LogicSignal> > channels(
+		const srd_decoder *decoder, const char *id) const
+	{
+		for (const GSList *l : {decoder->channels, decoder->opt_channels})
+			for (; l; l = l->next)
+				if (strcmp(((const srd_channel*)l->data)->id,
+					id) == 0)
+					return {{(const srd_channel*)l->data,
+						signal}};
+		BOOST_FAIL("Decoder channel not found");
+		return {};
+	}
+
+	shared_ptr<sigrok::Context> context;
+	pv::DeviceManager device_manager;
+	pv::Session session;
+	shared_ptr<LogicSignal> signal;
+	const QString previous_cache_dir;
+};
+
+/*
+ * Decodes a UART capture with a Modbus decoder stacked on the UART
+ * decoder, changes an option of the Modbus decoder, and decodes it again.
+ * The rows of the UART decoder are kept, and must hold the same
+ * annotations, without duplicates or gaps, as a fresh decode of the
+ * changed stack.
+ */
+BOOST_FIXTURE_TEST_CASE(KeptRows, SessionFixture)
+{
+	const uint64_t SampleCount = 2000000;
+
+	if (srd_decoder_load("uart") != SRD_OK ||
+		srd_decoder_load("modbus") != SRD_OK) {
+		BOOST_TEST_MESSAGE("Decoders uart and modbus not available");
+		return;
+	}
+	const srd_decoder *const uart = srd_decoder_get_by_id("uart");
+	const srd_decoder *const modbus = srd_decoder_get_by_id("modbus");
+
+	srand(0);
+	vector<uint8_t> data = make_uart_samples(SampleCount);
+	push_samples(data);
+
+	GVariant *const framegap = g_variant_ref_sink(
+		g_variant_new_int64(14));
+
+	// Decode, change the upper decoder, and decode again
+	DecoderStack kept(session, uart);
+	kept.stack().front()->set_channels(channels(uart, "rx"));
+	kept.push(std::make_shared<Decoder>(modbus));
+	StackDecode::clear_cache();
+	StackDecode::run(kept);
+	const size_t uart_annotation_count =
+		StackDecode::annotations(kept).front().size();
+	BOOST_CHECK(uart_annotation_count != 0);
+
+	kept.stack().back()->set_option("framegap", framegap);
+	StackDecode::clear_cache();
+	StackDecode::run(kept);
+
+	// Decode the changed stack afresh
+	DecoderStack fresh(session, uart);
+	fresh.stack().front()->set_channels(channels(uart, "rx"));
+	fresh.push(std::make_shared<Decoder>(modbus));
+	fresh.stack().back()->set_option("framegap", framegap);
+	StackDecode::clear_cache();
+	StackDecode::run(fresh);
+	BOOST_CHECK(fresh.cache_status() != DecoderStack::CacheHit);
+
+	const vector< vector<Annotation> > kept_rows =
+		StackDecode::annotations(kept);
+	BOOST_CHECK_EQUAL(kept_rows.front().size(), uart_annotation_count);
+	StackDecode::check_equal(kept_rows, StackDecode::annotations(fresh));
+
+	g_variant_unref(framegap);
+}
+
+/*
+ * Decodes a UART capture of bursts separated by idle stretches in one
+ * session, and in parallel ranges split in the idle stretches, and checks
+ * that both give the same annotations.
+ */
+BOOST_FIXTURE_TEST_CASE(ParallelRanges, SessionFixture)
+{
+	const uint64_t SampleCount = 4000000;
+	const uint64_t BurstLength = 100000;
+	const uint64_t IdleLength = 20000;
+
+	if (srd_decoder_load("uart") != SRD_OK) {
+		BOOST_TEST_MESSAGE("Decoder uart not available");
+		return;
+	}
+	if (DecoderStack::scheduler().slot_count() < 2) {
+		BOOST_TEST_MESSAGE("Parallel decoding needs two decode slots");
+		return;
+	}
+	const srd_decoder *const uart = srd_decoder_get_by_id("uart");
+
+	srand(0);
+	vector<uint8_t> data;
+	while (data.size() < SampleCount) {
+		const vector<uint8_t> burst = make_uart_samples(BurstLength);
+		data.insert(data.end(), burst.begin(), burst.end());
+		append_level(data, 1, data.size() + IdleLength);
+	}
+	push_samples(data);
+
+	const bool parallel_decode = DecoderStack::parallel_decode_enabled();
+
+	DecoderStack sequential(session, uart);
+	sequential.stack().front()->set_channels(channels(uart, "rx"));
+	DecoderStack::set_parallel_decode_enabled(false);
+	StackDecode::clear_cache();
+	StackDecode::run(sequential);
+
+	DecoderStack ranges(session, uart);
+	ranges.stack().front()->set_channels(channels(uart, "rx"));
+	DecoderStack::set_parallel_decode_enabled(true);
+	StackDecode::clear_cache();
+	StackDecode::run(ranges);
+
+	DecoderStack::set_parallel_decode_enabled(parallel_decode);
+
+	const vector< vector<Annotation> > expected =
+		StackDecode::annotations(sequential);
+	BOOST_REQUIRE(!expected.empty());
+	BOOST_CHECK(!expected.front().empty());
+	StackDecode::check_equal(StackDecode::annotations(ranges), expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
 #if 0
 BOOST_AUTO_TEST_SUITE(DecoderStackTest)
 
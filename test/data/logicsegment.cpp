@@ -20,13 +20,26 @@
 
 #include <extdef.h>
 
+#include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
 
 #include <boost/test/unit_test.hpp>
 
+#include <libsigrokcxx/libsigrokcxx.hpp>
+
 #include <pv/data/logicsegment.hpp>
 
 using pv::data::LogicSegment;
+using std::dynamic_pointer_cast;
+using std::min;
+using std::shared_ptr;
 using std::vector;
 
 // Dummy, remove again when unit tests are fixed.
@@ -37,6 +50,615 @@ BOOST_AUTO_TEST_CASE(DummyTestCase)
 }
 BOOST_AUTO_TEST_SUITE_END()
 
+BOOST_AUTO_TEST_SUITE(LogicSegmentTest)
+
+BOOST_AUTO_TEST_CASE(Pow2)
+{
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(0, 0), 0U);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(1, 0), 1U);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(2, 0), 2U);
+
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(1ULL << 63, 0), 1ULL << 63);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(INT64_MAX, 0),
+		(uint64_t)INT64_MAX);
+
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(0, 1), 0U);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(1, 1), 2U);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(2, 1), 2U);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(3, 1), 4U);
+
+	// Blocks of the upper mip-map levels are longer than 2^32 samples
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(1, 32), 1ULL << 32);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil((1ULL << 32) + 1, 32),
+		1ULL << 33);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(5, 36), 1ULL << 36);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(1ULL << 40, 40), 1ULL << 40);
+	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil((1ULL << 56) - 1, 56),
+		1ULL << 56);
+}
+
+/*
+ * Checks that every vectorised mip-map kernel produces exactly the same
+ * output as the scalar kernel. The data is processed in several calls with
+ * varying block counts, to exercise the hand-over of the last sample
+ * between calls, and the odd-block handling of the kernels that process
+ * multiple blocks at a time.
+ */
+BOOST_AUTO_TEST_CASE(MipMapKernels)
+{
+	const unsigned int BlockLength = 16;
+	const uint64_t BlockCount = 4099;
+	const unsigned int UnitSizes[] = {1, 2, 4, 8};
+	const LogicSegment::MipMapKernelSet Sets[] = {
+		LogicSegment::SSE2Kernels,
+		LogicSegment::AVX2Kernels,
+		LogicSegment::NEONKernels
+	};
+
+	srand(0);
+
+	for (unsigned int unit_size : UnitSizes) {
+		const LogicSegment::MipMapKernel scalar =
+			LogicSegment::mipmap_kernel(unit_size,
+				LogicSegment::ScalarKernels);
+		BOOST_REQUIRE(scalar);
+
+		// Make runs of random lengths, so that there are blocks with
+		// and without transitions
+		vector<uint8_t> data(BlockCount * BlockLength * unit_size);
+		for (size_t i = 0; i < data.size();) {
+			const size_t run = (rand() % 64) * unit_size + unit_size;
+			const uint8_t value = rand();
+			for (size_t j = 0; j < run && i < data.size(); j++)
+				data[i++] = value;
+		}
+
+		vector<uint8_t> expected(BlockCount * unit_size);
+		uint64_t expected_last = 0x5A;
+		scalar(data.data(), expected.data(), BlockCount, BlockLength,
+			expected_last);
+
+		for (LogicSegment::MipMapKernelSet set : Sets) {
+			const LogicSegment::MipMapKernel kernel =
+				LogicSegment::mipmap_kernel(unit_size, set);
+			if (!kernel)
+				continue;
+
+			vector<uint8_t> result(BlockCount * unit_size);
+			uint64_t last = 0x5A;
+			for (uint64_t block = 0, count = 1; block < BlockCount;
+				block += count, count = count * 3 + 1) {
+				count = std::min(count, BlockCount - block);
+				kernel(data.data() + block * BlockLength * unit_size,
+					result.data() + block * unit_size, count,
+					BlockLength, last);
+			}
+
+			BOOST_CHECK(result == expected);
+			BOOST_CHECK_EQUAL(last, expected_last);
+		}
+	}
+}
+
+shared_ptr<sigrok::Logic> make_logic(
+	const shared_ptr<sigrok::Context> &context,
+	uint8_t *data, size_t length, unsigned int unit_size)
+{
+	return dynamic_pointer_cast<sigrok::Logic>(
+		context->create_logic_packet(data, length, unit_size)->payload());
+}
+
+/*
+ * Generates samples in which a random channel toggles at random intervals
+ * with the given mean.
+ */
+vector<uint8_t> make_sparse_samples(uint64_t sample_count,
+	unsigned int unit_size, unsigned int mean_interval)
+{
+	vector<uint8_t> data(sample_count * unit_size);
+	uint64_t value = 0;
+	for (uint64_t i = 0; i < sample_count;) {
+		const uint64_t run = min<uint64_t>(sample_count - i,
+			rand() % (2 * mean_interval) + 1);
+		for (uint64_t j = 0; j < run; j++, i++)
+			for (unsigned int b = 0; b < unit_size; b++)
+				data[i * unit_size + b] = value >> (b * 8);
+		value ^= 1ULL << (rand() % (unit_size * 8));
+	}
+	return data;
+}
+
+/*
+ * Feeds samples into a segment in packets of varying length.
+ */
+shared_ptr<LogicSegment> feed_segment(
+	const shared_ptr<sigrok::Context> &context,
+	shared_ptr<LogicSegment> segment,
+	vector<uint8_t> &data, unsigned int unit_size)
+{
+	const uint64_t sample_count = data.size() / unit_size;
+	for (uint64_t i = 0, n = 1; i < sample_count; i += n, n = n * 5 + 3) {
+		n = min(n, sample_count - i);
+		const shared_ptr<sigrok::Logic> logic = make_logic(context,
+			data.data() + i * unit_size, n * unit_size, unit_size);
+		if (segment)
+			segment->append_payload(logic);
+		else
+			segment = std::make_shared<LogicSegment>(logic, 1);
+	}
+	return segment;
+}
+
+/*
+ * Checks that run-length encoded segments return the same samples and
+ * edges as segments of raw samples, and that they fall back to raw
+ * samples when the data is dense.
+ */
+BOOST_AUTO_TEST_CASE(CompressedSamples)
+{
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+	const uint64_t SampleCount = 300000;
+	const unsigned int UnitSizes[] = {1, 2, 3, 4, 8};
+
+	srand(0);
+
+	for (unsigned int unit_size : UnitSizes) {
+		vector<uint8_t> data = make_sparse_samples(SampleCount,
+			unit_size, 1000);
+
+		LogicSegment::set_compression_enabled(true);
+		shared_ptr<LogicSegment> compressed = feed_segment(context,
+			nullptr, data, unit_size);
+		LogicSegment::set_compression_enabled(false);
+		const shared_ptr<LogicSegment> raw = feed_segment(context,
+			nullptr, data, unit_size);
+
+		BOOST_CHECK(compressed->is_compressed());
+		BOOST_CHECK(!raw->is_compressed());
+		BOOST_CHECK(compressed->memory_usage() * 100 <
+			raw->memory_usage());
+
+		vector<uint8_t> samples(data.size());
+		compressed->get_samples(samples.data(), 0, SampleCount);
+		BOOST_CHECK(samples == data);
+		compressed->get_samples(samples.data(), 12345, 23456);
+		BOOST_CHECK(std::equal(samples.begin(), samples.begin() +
+			(23456 - 12345) * unit_size,
+			data.begin() + 12345 * unit_size));
+
+		// Only raw samples can be read in place
+		uint64_t count;
+		BOOST_CHECK(!compressed->get_contiguous_samples(12345, 23456,
+			count));
+		const uint8_t *const in_place = raw->get_contiguous_samples(
+			12345, 23456, count);
+		BOOST_REQUIRE(in_place);
+		BOOST_CHECK_EQUAL(count, 23456 - 12345);
+		BOOST_CHECK(std::equal(in_place, in_place + count * unit_size,
+			data.begin() + 12345 * unit_size));
+
+		// At full resolution both representations give exact edges
+		for (int sig = 0; sig < (int)unit_size * 8; sig++) {
+			vector<LogicSegment::EdgePair> a, b;
+			compressed->get_subsampled_edges(a, 777,
+				SampleCount - 1, 1.0f, sig);
+			raw->get_subsampled_edges(b, 777,
+				SampleCount - 1, 1.0f, sig);
+			BOOST_CHECK(a == b);
+		}
+
+		// Appending noise must make the mip-map worker convert the
+		// segment to raw samples. The samples read the same before
+		// and after
+		vector<uint8_t> noise(SampleCount * unit_size);
+		for (uint8_t &b : noise)
+			b = rand();
+		compressed = feed_segment(context, compressed, noise, unit_size);
+
+		data.insert(data.end(), noise.begin(), noise.end());
+		samples.resize(data.size());
+		compressed->get_samples(samples.data(), 0, 2 * SampleCount);
+		BOOST_CHECK(samples == data);
+
+		const std::chrono::steady_clock::time_point deadline =
+			std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (compressed->is_compressed() &&
+			std::chrono::steady_clock::now() < deadline)
+			std::this_thread::yield();
+		BOOST_CHECK(!compressed->is_compressed());
+
+		std::fill(samples.begin(), samples.end(), 0);
+		compressed->get_samples(samples.data(), 0, 2 * SampleCount);
+		BOOST_CHECK(samples == data);
+		BOOST_CHECK(compressed->get_contiguous_samples(12345, 23456,
+			count));
+	}
+
+	LogicSegment::set_compression_enabled(compression);
+}
+
+/*
+ * Checks the edge counts of the transition index against the samples, and
+ * that channels which change often are dropped from the index.
+ */
+BOOST_AUTO_TEST_CASE(TransitionIndex)
+{
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+	const uint64_t SampleCount = 300000;
+	const unsigned int UnitSize = 2;
+
+	srand(0);
+
+	// Channel 15 toggles on every sample
+	vector<uint8_t> data = make_sparse_samples(SampleCount, UnitSize, 500);
+	for (uint64_t i = 1; i < SampleCount; i += 2)
+		data[i * UnitSize + 1] ^= 0x80;
+
+	LogicSegment::set_compression_enabled(false);
+	const shared_ptr<LogicSegment> segment = feed_segment(context,
+		nullptr, data, UnitSize);
+	while (segment->get_mipmap_sample_count() < SampleCount / 16 * 16)
+		std::this_thread::yield();
+
+	const uint64_t Ranges[][2] = {
+		{0, SampleCount / 2}, {1234, 5678}, {100000, 100000}};
+
+	for (int sig = 0; sig < 15; sig++)
+		for (const uint64_t *r : Ranges) {
+			uint64_t expected = 0;
+			for (uint64_t i = r[0] + 1; i <= r[1]; i++) {
+				const uint16_t a = data[(i - 1) * UnitSize] |
+					data[(i - 1) * UnitSize + 1] << 8;
+				const uint16_t b = data[i * UnitSize] |
+					data[i * UnitSize + 1] << 8;
+				if ((a ^ b) & (1 << sig))
+					expected++;
+			}
+
+			const boost::optional<uint64_t> count =
+				segment->get_edge_count(r[0], r[1], sig);
+			BOOST_REQUIRE(count);
+			BOOST_CHECK_EQUAL(*count, expected);
+		}
+
+	BOOST_CHECK(!segment->get_edge_count(0, SampleCount / 2, 15));
+
+	LogicSegment::set_compression_enabled(compression);
+}
+
+/*
+ * Takes the edges of a signal from the raw samples, quantized to the
+ * mip-map blocks of the level of detail in the same way as the search.
+ */
+vector<LogicSegment::EdgePair> quantized_edges(const vector<uint8_t> &data,
+	unsigned int unit_size, int sig, uint64_t start, uint64_t end,
+	float min_length)
+{
+	const unsigned int power = LogicSegment::default_mipmap_scale_power();
+	const float scale_factor = 1 << power;
+	const uint64_t block_length = (uint64_t)std::max(min_length, 1.0f);
+	const int level = std::max((int)floorf(logf(min_length) /
+		logf(scale_factor)) - 1, 0);
+	const uint64_t quantum = (min_length >= scale_factor) ?
+		1ULL << ((level + 1) * power) : 1;
+
+	auto sample = [&](uint64_t i) {
+		return ((data[i * unit_size + sig / 8] >> (sig % 8)) & 1) != 0;
+	};
+
+	vector<LogicSegment::EdgePair> edges;
+	bool last = sample(start);
+	edges.push_back(LogicSegment::EdgePair(start, last));
+
+	for (uint64_t index = start + 1;;) {
+		index = (index + quantum - 1) / quantum * quantum;
+		if (index >= end)
+			break;
+
+		uint64_t edge = index;
+		if (sample(index) == last) {
+			while (edge < end && sample(edge) == sample(edge - 1))
+				edge++;
+			edge = edge / quantum * quantum;
+		}
+
+		if (edge + block_length > end)
+			break;
+
+		index = edge + block_length;
+		last = sample(index - 1);
+		edges.push_back(LogicSegment::EdgePair(edge, last));
+	}
+
+	if (last != sample(end))
+		edges.push_back(LogicSegment::EdgePair(end, sample(end)));
+	edges.push_back(LogicSegment::EdgePair(end + 1, sample(end)));
+	return edges;
+}
+
+/*
+ * Checks that channels which change too often to be indexed are searched
+ * together in one walk of the mip-map, with the same results as searching
+ * them one at a time and as taking the edges from the raw samples. The
+ * time taken both ways is reported as a test message (run with
+ * --log_level=message).
+ */
+BOOST_AUTO_TEST_CASE(MipMapEdges)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+	const uint64_t SampleCount = 1 << 20;
+	const unsigned int UnitSize = 2;
+	const float MinLengths[] = {1.0f, 7.0f, 20.0f, 300.0f, 5000.0f};
+	const uint64_t Ranges[][2] = {
+		{0, SampleCount - 1}, {12345, 654321}, {4097, 4100}};
+
+	srand(0);
+
+	// The low channels toggle every 16 samples on average, the high
+	// channels do the same in bursts between long idle stretches
+	vector<uint8_t> data(SampleCount * UnitSize);
+	uint16_t value = 0;
+	for (uint64_t i = 0; i < SampleCount; i++) {
+		for (int sig = 0; sig < 16; sig++)
+			if (rand() % 16 == 0 &&
+				(sig < 8 || (i / 2048) % 10 == 0))
+				value ^= 1 << sig;
+		data[i * UnitSize] = value;
+		data[i * UnitSize + 1] = value >> 8;
+	}
+
+	LogicSegment::set_compression_enabled(false);
+	const shared_ptr<LogicSegment> segment = feed_segment(context,
+		nullptr, data, UnitSize);
+	while (segment->get_mipmap_sample_count() < SampleCount)
+		std::this_thread::yield();
+
+	// No channel is indexed, so all of them are searched in the mip-map
+	for (int sig = 0; sig < 16; sig++)
+		BOOST_CHECK(!segment->get_edge_count(0, SampleCount - 1, sig));
+
+	double single_ms = 0, batched_ms = 0;
+	for (const uint64_t *r : Ranges)
+		for (float min_length : MinLengths) {
+			vector< vector<LogicSegment::EdgePair> > single(16),
+				batched;
+
+			Clock::time_point start = Clock::now();
+			for (int sig = 0; sig < 16; sig++)
+				segment->get_subsampled_edges(single[sig], r[0], r[1],
+					min_length, sig);
+			single_ms += std::chrono::duration<double,
+				std::milli>(Clock::now() - start).count();
+
+			start = Clock::now();
+			segment->get_subsampled_edges(batched, r[0], r[1],
+				min_length, 0xFFFFULL);
+			batched_ms += std::chrono::duration<double,
+				std::milli>(Clock::now() - start).count();
+
+			BOOST_CHECK(single == batched);
+			for (int sig = 0; sig < 16; sig++)
+				BOOST_CHECK(batched[sig] == quantized_edges(data,
+					UnitSize, sig, r[0], r[1], min_length));
+		}
+
+	BOOST_TEST_MESSAGE("Mip-map walk, 16 channels: " << single_ms <<
+		" ms per channel, " << batched_ms << " ms batched");
+
+	LogicSegment::set_compression_enabled(compression);
+}
+
+/*
+ * Checks that segments with different mip-map fan-outs find the same
+ * edges, and that the mip-map grows until its top level is shorter than
+ * the fan-out.
+ */
+struct ScalePowerCheck
+{
+	static void run(const shared_ptr<sigrok::Context> &context,
+		vector<uint8_t> &data, unsigned int unit_size,
+		const vector< vector<LogicSegment::EdgePair> > &reference)
+	{
+		const uint64_t sample_count = data.size() / unit_size;
+		const shared_ptr<LogicSegment> segment = feed_segment(context,
+			nullptr, data, unit_size);
+		const LogicSegment &s = *segment;
+
+		BOOST_REQUIRE_EQUAL(s.mipmap_scale_power_,
+			LogicSegment::default_mipmap_scale_power());
+		while (segment->get_mipmap_sample_count() <
+			sample_count / s.mipmap_scale_factor_ *
+			s.mipmap_scale_factor_)
+			std::this_thread::yield();
+
+		vector< vector<LogicSegment::EdgePair> > edges;
+		segment->get_subsampled_edges(edges, 0, sample_count - 1, 1.0f,
+			(1ULL << (unit_size * 8)) - 1);
+		BOOST_CHECK(edges == reference);
+
+		// Searches coarser than the top level must not overrun it
+		vector<LogicSegment::EdgePair> coarse;
+		segment->get_subsampled_edges(coarse, 0, sample_count - 1,
+			1e18f, 0);
+		BOOST_CHECK(!coarse.empty());
+
+		const vector<uint64_t> usage = segment->mipmap_memory_usage();
+		BOOST_REQUIRE(!usage.empty());
+		BOOST_REQUIRE(usage.size() < s.scale_step_count_);
+		BOOST_CHECK(s.mip_map_[usage.size()].data == nullptr);
+		BOOST_CHECK(s.mip_map_[usage.size() - 1].length <
+			s.mipmap_scale_factor_);
+		for (unsigned int level = 1; level < usage.size(); level++)
+			BOOST_CHECK(usage[level] <= usage[level - 1]);
+	}
+};
+
+BOOST_AUTO_TEST_CASE(ScalePower)
+{
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+	const unsigned int scale_power =
+		LogicSegment::default_mipmap_scale_power();
+	const uint64_t SampleCount = 1000000;
+	const unsigned int UnitSize = 1;
+
+	srand(0);
+	vector<uint8_t> data = make_sparse_samples(SampleCount, UnitSize, 50);
+
+	// Take the exact edges from the raw samples
+	vector< vector<LogicSegment::EdgePair> > reference(UnitSize * 8);
+	for (unsigned int sig = 0; sig < UnitSize * 8; sig++) {
+		bool last = data[0] & (1 << sig);
+		reference[sig].push_back(LogicSegment::EdgePair(0, last));
+		for (uint64_t i = 1; i < SampleCount; i++)
+			if (((data[i] & (1 << sig)) != 0) != last) {
+				last = !last;
+				reference[sig].push_back(
+					LogicSegment::EdgePair(i, last));
+			}
+		reference[sig].push_back(
+			LogicSegment::EdgePair(SampleCount, last));
+	}
+
+	LogicSegment::set_compression_enabled(false);
+	for (unsigned int power = 4; power <= 8; power += 2) {
+		LogicSegment::set_default_mipmap_scale_power(power);
+		ScalePowerCheck::run(context, data, UnitSize, reference);
+	}
+
+	LogicSegment::set_default_mipmap_scale_power(scale_power);
+	LogicSegment::set_compression_enabled(compression);
+}
+
+/*
+ * Compares the memory use, and the time taken to store and search sparse
+ * samples, with and without run-length encoding. The results are reported
+ * as test messages (run with --log_level=message).
+ */
+BOOST_AUTO_TEST_CASE(CompressionBenchmark)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+	const uint64_t SampleCount = 1 << 22;
+	const unsigned int UnitSize = 2;
+	const bool Modes[] = {false, true};
+
+	srand(0);
+
+	vector<uint8_t> data = make_sparse_samples(SampleCount, UnitSize,
+		10000);
+
+	for (bool mode : Modes) {
+		LogicSegment::set_compression_enabled(mode);
+
+		Clock::time_point start = Clock::now();
+		const shared_ptr<LogicSegment> segment = feed_segment(context,
+			nullptr, data, UnitSize);
+		while (!segment->is_compressed() &&
+			segment->get_mipmap_sample_count() < SampleCount)
+			std::this_thread::yield();
+		const double store_ms = std::chrono::duration<double,
+			std::milli>(Clock::now() - start).count();
+
+		BOOST_CHECK_EQUAL(segment->is_compressed(), mode);
+
+		start = Clock::now();
+		size_t edge_count = 0;
+		for (int sig = 0; sig < (int)UnitSize * 8; sig++)
+			for (float min_length = 1.0f; min_length < 100000.0f;
+				min_length *= 10.0f) {
+				vector<LogicSegment::EdgePair> edges;
+				segment->get_subsampled_edges(edges, 0,
+					SampleCount - 1, min_length, sig);
+				edge_count += edges.size();
+			}
+		const double search_ms = std::chrono::duration<double,
+			std::milli>(Clock::now() - start).count();
+
+		BOOST_TEST_MESSAGE((mode ? "Run-length encoded" : "Raw") <<
+			": " << segment->memory_usage() << " bytes, stored in " <<
+			store_ms << " ms, " << edge_count << " edges in " <<
+			search_ms << " ms");
+	}
+
+	LogicSegment::set_compression_enabled(compression);
+}
+
+/*
+ * Compares fetching the edges of 8, 16, 32 and 64 channels in one batch
+ * with fetching them one channel at a time, for raw and run-length encoded
+ * segments. The results are reported as test messages (run with
+ * --log_level=message).
+ */
+BOOST_AUTO_TEST_CASE(BatchedEdgesBenchmark)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const shared_ptr<sigrok::Context> context = sigrok::Context::create();
+	const bool compression = LogicSegment::compression_enabled();
+	const uint64_t SampleCount = 1 << 20;
+	const unsigned int UnitSize = 8;
+	const int ChannelCounts[] = {8, 16, 32, 64};
+	const float MinLengths[] = {1.0f, 100.0f, 10000.0f};
+	const bool Modes[] = {false, true};
+
+	srand(0);
+
+	vector<uint8_t> data = make_sparse_samples(SampleCount, UnitSize, 50);
+
+	for (bool mode : Modes) {
+		LogicSegment::set_compression_enabled(mode);
+		const shared_ptr<LogicSegment> segment = feed_segment(context,
+			nullptr, data, UnitSize);
+		while (!segment->is_compressed() &&
+			segment->get_mipmap_sample_count() < SampleCount)
+			std::this_thread::yield();
+		BOOST_CHECK_EQUAL(segment->is_compressed(), mode);
+
+		for (int channel_count : ChannelCounts) {
+			const uint64_t sig_mask = (channel_count == 64) ? ~0ULL :
+				(1ULL << channel_count) - 1;
+			double single_ms = 0, batched_ms = 0;
+
+			for (float min_length : MinLengths) {
+				vector< vector<LogicSegment::EdgePair> > single(
+					channel_count), batched;
+
+				Clock::time_point start = Clock::now();
+				for (int sig = 0; sig < channel_count; sig++)
+					segment->get_subsampled_edges(single[sig], 0,
+						SampleCount - 1, min_length, sig);
+				single_ms += std::chrono::duration<double,
+					std::milli>(Clock::now() - start).count();
+
+				start = Clock::now();
+				segment->get_subsampled_edges(batched, 0,
+					SampleCount - 1, min_length, sig_mask);
+				batched_ms += std::chrono::duration<double,
+					std::milli>(Clock::now() - start).count();
+
+				BOOST_CHECK(single == batched);
+			}
+
+			BOOST_TEST_MESSAGE((mode ? "Run-length encoded, " :
+				"Raw, ") << channel_count << " channels: " <<
+				single_ms << " ms per channel, " << batched_ms <<
+				" ms batched");
+		}
+	}
+
+	LogicSegment::set_compression_enabled(compression);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
 #if 0
 BOOST_AUTO_TEST_SUITE(LogicSegmentTest)
 
@@ -51,23 +673,6 @@ void push_logic(LogicSegment &s, unsigned int length, uint8_t value)
 	delete[] (uint8_t*)logic.data;
 }
 
-BOOST_AUTO_TEST_CASE(Pow2)
-{
-	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(0, 0), 0);
-	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(1, 0), 1);
-	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(2, 0), 2);
-
-	BOOST_CHECK_EQUAL(
-		LogicSegment::pow2_ceil(INT64_MIN, 0), INT64_MIN);
-	BOOST_CHECK_EQUAL(
-		LogicSegment::pow2_ceil(INT64_MAX, 0), INT64_MAX);
-
-	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(0, 1), 0);
-	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(1, 1), 2);
-	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(2, 1), 2);
-	BOOST_CHECK_EQUAL(LogicSegment::pow2_ceil(3, 1), 4);
-}
-
 BOOST_AUTO_TEST_CASE(Basic)
 {
 	// Create an empty LogicSegment object
@@ -81,7 +686,7 @@ BOOST_AUTO_TEST_CASE(Basic)
 	//----- Test LogicSegment::push_logic -----//
 
 	BOOST_CHECK(s.get_sample_count() == 0);
-	for (unsigned int i = 0; i < LogicSegment::ScaleStepCount; i++)
+	for (unsigned int i = 0; i < s.scale_step_count_; i++)
 	{
 		const LogicSegment::MipMapLevel &m = s.mip_map_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
@@ -95,7 +700,7 @@ BOOST_AUTO_TEST_CASE(Basic)
 	BOOST_CHECK(s.get_sample_count() == 8);
 
 	// There should not be enough samples to have a single mip map sample
-	for (unsigned int i = 0; i < LogicSegment::ScaleStepCount; i++)
+	for (unsigned int i = 0; i < s.scale_step_count_; i++)
 	{
 		const LogicSegment::MipMapLevel &m = s.mip_map_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
@@ -115,7 +720,7 @@ BOOST_AUTO_TEST_CASE(Basic)
 	BOOST_CHECK_EQUAL(((uint8_t*)m0.data)[0], 0x11);
 
 	// The higher levels should still be empty
-	for (unsigned int i = 1; i < LogicSegment::ScaleStepCount; i++)
+	for (unsigned int i = 1; i < s.scale_step_count_; i++)
 	{
 		const LogicSegment::MipMapLevel &m = s.mip_map_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
@@ -251,7 +856,7 @@ BOOST_AUTO_TEST_CASE(LargeData)
 			0xFF);
 
 	// Check the higher levels
-	for (unsigned int i = 4; i < LogicSegment::ScaleStepCount; i++)
+	for (unsigned int i = 4; i < s.scale_step_count_; i++)
 	{
 		const LogicSegment::MipMapLevel &m = s.mip_map_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
@@ -318,7 +923,7 @@ BOOST_AUTO_TEST_CASE(Pulses)
 
 		for (int j = 1;
 			i < s.mip_map_[0].length &&
-			j < Period/LogicSegment::MipMapScaleFactor; j++) {
+			j < Period/s.mipmap_scale_factor_; j++) {
 			BOOST_TEST_MESSAGE(
 				"Testing mip_map[0].data[" << i << "]");
 			BOOST_CHECK_EQUAL(s.get_subsample(0, i++) & 0xFF, 0x00);
@@ -326,7 +931,7 @@ BOOST_AUTO_TEST_CASE(Pulses)
 	}
 
 	// Check the higher levels are all inactive
-	for (unsigned int i = 1; i < LogicSegment::ScaleStepCount; i++) {
+	for (unsigned int i = 1; i < s.scale_step_count_; i++) {
 		const LogicSegment::MipMapLevel &m = s.mip_map_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
 		BOOST_CHECK_EQUAL(m.data_length, 0);
@@ -384,7 +989,7 @@ BOOST_AUTO_TEST_CASE(LongPulses)
 		}
 
 		for (; i < s.mip_map_[0].length &&
-			j < Period/LogicSegment::MipMapScaleFactor; j++) {
+			j < Period/s.mipmap_scale_factor_; j++) {
 			BOOST_TEST_MESSAGE(
 				"Testing mip_map[0].data[" << i << "]");
 			BOOST_CHECK_EQUAL(s.get_subsample(0, i++), 0);
@@ -392,7 +997,7 @@ BOOST_AUTO_TEST_CASE(LongPulses)
 	}
 
 	// Check the higher levels are all inactive
-	for (unsigned int i = 1; i < LogicSegment::ScaleStepCount; i++) {
+	for (unsigned int i = 1; i < s.scale_step_count_; i++) {
 		const LogicSegment::MipMapLevel &m = s.mip_map_[i];
 		BOOST_CHECK_EQUAL(m.length, 0);
 		BOOST_CHECK_EQUAL(m.data_length, 0);
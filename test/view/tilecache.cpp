@@ -0,0 +1,128 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2015 Joel Holdsworth <joel@airwebreathe.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <QPainter>
+
+#include "pv/view/tilecache.hpp"
+#include "pv/view/viewitempaintparams.hpp"
+
+using pv::view::TileCache;
+using pv::view::ViewItemPaintParams;
+using std::make_shared;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+	const double Scale = 0.001;
+
+	// A view which spans tiles 0 to 4
+	const ViewItemPaintParams pp(
+		QRect(0, 0, 4 * TileCache::TileWidth, 100), Scale,
+		pv::util::Timestamp(0));
+
+	void render_missing_tiles(TileCache &cache, int y)
+	{
+		for (int64_t index : cache.missing_tiles(pp, y))
+			cache.render_tile(index, pp, y,
+				QRectF(0, 0, TileCache::TileWidth, 10),
+				[](QPainter&) {});
+	}
+};
+
+BOOST_AUTO_TEST_SUITE(TileCacheTest)
+
+BOOST_AUTO_TEST_CASE(KeepTiles)
+{
+	const shared_ptr<int> data = make_shared<int>(0);
+	const pv::util::Timestamp data_end(10);
+
+	TileCache cache;
+	cache.validate(Scale, data, data_end);
+	BOOST_CHECK_EQUAL(cache.missing_tiles(pp, 0).size(), 5);
+
+	render_missing_tiles(cache, 0);
+	BOOST_CHECK(cache.missing_tiles(pp, 0).empty());
+
+	// The tiles stay valid while the view and the data are unchanged,
+	// and when the trace is moved vertically
+	cache.validate(Scale, data, data_end);
+	BOOST_CHECK(cache.missing_tiles(pp, 0).empty());
+	BOOST_CHECK(cache.missing_tiles(pp, 50).empty());
+
+	// A new scale drops all the tiles
+	cache.validate(Scale * 2, data, data_end);
+	BOOST_CHECK_EQUAL(cache.missing_tiles(pp, 0).size(), 5);
+
+	render_missing_tiles(cache, 0);
+	cache.clear();
+	cache.validate(Scale * 2, data, data_end);
+	BOOST_CHECK_EQUAL(cache.missing_tiles(pp, 0).size(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(AppendedData)
+{
+	const shared_ptr<int> data = make_shared<int>(0);
+
+	// The last sample is at pixel 500, in tile 1
+	TileCache cache;
+	cache.validate(Scale, data, pv::util::Timestamp("0.5"));
+	render_missing_tiles(cache, 0);
+
+	// Only the tiles from the one that held the last sample onwards
+	// depend on the new samples
+	cache.validate(Scale, data, pv::util::Timestamp("0.6"));
+	const vector<int64_t> expected = {1, 2, 3, 4};
+	const vector<int64_t> missing = cache.missing_tiles(pp, 0);
+	BOOST_CHECK(missing == expected);
+
+	// Fewer samples than before means the data was replaced
+	render_missing_tiles(cache, 0);
+	cache.validate(Scale, data, pv::util::Timestamp("0.4"));
+	BOOST_CHECK_EQUAL(cache.missing_tiles(pp, 0).size(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(ReplacedData)
+{
+	const pv::util::Timestamp data_end(10);
+	TileCache cache;
+
+	shared_ptr<int> data = make_shared<int>(0);
+	cache.validate(Scale, data, data_end);
+	render_missing_tiles(cache, 0);
+
+	// New data must not be taken for the old data, even if it has been
+	// allocated where the old data was freed
+	data.reset();
+	data = make_shared<int>(0);
+	cache.validate(Scale, data, data_end);
+	BOOST_CHECK_EQUAL(cache.missing_tiles(pp, 0).size(), 5);
+
+	render_missing_tiles(cache, 0);
+	const shared_ptr<int> other = make_shared<int>(0);
+	cache.validate(Scale, other, data_end);
+	BOOST_CHECK_EQUAL(cache.missing_tiles(pp, 0).size(), 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()